@@ -0,0 +1,450 @@
+// hdTantoBench drives HdTantoDelegate through an HdRenderIndex without a
+// window or a USD stage. A synthetic scene delegate makes a grid of meshes,
+// and the bench times each phase of every frame: Sync, CommitResources,
+// _Execute and the readback of the aovs by Map, which includes waiting for
+// the GPU to finish the frame. The results are written as one line of JSON,
+// with the resident memory after every frame.
+//
+//   hdTantoBench [--prims N] [--triangles N] [--topologies N]
+//                [--animate none|transforms|points] [--frames N]
+//                [--width N] [--height N] [--mode raster|software|ray]
+//                [--output FILE]
+//
+// --triangles is per prim and --topologies is how many different
+// topologies the prims share, 0 for one per prim. Prims with the same
+// topology still have points of their own. The delegate logs to stdout, so
+// the JSON is its last line unless --output names a file. Without a GPU,
+// point VK_ICD_FILENAMES at the lavapipe ICD to rasterize on the CPU
+// through Vulkan.
+
+#include "renderDelegate.h"
+#include "renderBuffer.h"
+
+#include <pxr/base/gf/frustum.h>
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/rotation.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/imaging/hd/changeTracker.h>
+#include <pxr/imaging/hd/meshTopology.h>
+#include <pxr/imaging/hd/renderIndex.h>
+#include <pxr/imaging/hd/renderPass.h>
+#include <pxr/imaging/hd/renderPassState.h>
+#include <pxr/imaging/hd/rprimCollection.h>
+#include <pxr/imaging/hd/sceneDelegate.h>
+#include <pxr/imaging/hd/task.h>
+#include <pxr/imaging/hd/tokens.h>
+#include <pxr/imaging/pxOsd/tokens.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+struct Options {
+    size_t      prims      = 1000;
+    size_t      triangles  = 1000;
+    size_t      topologies = 1;
+    std::string animate    = "none";
+    size_t      frames     = 10;
+    int         width      = 512;
+    int         height     = 512;
+    // Empty for the default of the delegate.
+    std::string mode;
+    std::string output     = "-";
+};
+
+// Quads on a grid in the xy plane, about half as many as the triangles
+// asked for. Each topology lists the same faces starting from a different
+// one, so they triangulate alike but do not match.
+class BenchScene final : public HdSceneDelegate {
+public:
+    BenchScene(HdRenderIndex* index, const Options& options)
+        : HdSceneDelegate(index, SdfPath::AbsoluteRootPath())
+        , _options(options)
+        , _time(0)
+    {
+        const size_t quads = std::max<size_t>(1, (options.triangles + 1) / 2);
+        _columns = std::max<size_t>(1, (size_t)std::ceil(std::sqrt((double)quads)));
+        _rows    = (quads + _columns - 1) / _columns;
+
+        const size_t topologyCount = options.topologies ? std::min(options.topologies, options.prims) :
+            options.prims;
+        const size_t faceCount = _columns * _rows;
+        const VtIntArray counts(faceCount, 4);
+        for (size_t t = 0; t < topologyCount; t++)
+        {
+            VtIntArray indices(faceCount * 4);
+            for (size_t f = 0; f < faceCount; f++)
+            {
+                const size_t face = (f + t) % faceCount;
+                const int    x    = face % _columns;
+                const int    y    = face / _columns;
+                const int    row  = _columns + 1;
+                indices[f * 4 + 0] = y * row + x;
+                indices[f * 4 + 1] = y * row + x + 1;
+                indices[f * 4 + 2] = (y + 1) * row + x + 1;
+                indices[f * 4 + 3] = (y + 1) * row + x;
+            }
+            _topologies.emplace_back(PxOsdOpenSubdivTokens->none, HdTokens->rightHanded, counts, indices);
+        }
+
+        _across = std::max<size_t>(1, (size_t)std::ceil(std::sqrt((double)options.prims)));
+        for (size_t i = 0; i < options.prims; i++)
+        {
+            const SdfPath id(TfStringPrintf("/mesh%zu", i));
+            _ids.push_back(id);
+            index->InsertRprim(HdPrimTypeTokens->mesh, this, id);
+        }
+    }
+
+    const SdfPathVector& GetIds() const { return _ids; }
+    // Prims are laid out in a square of this many across, one unit apart.
+    size_t GetAcross() const { return _across; }
+
+    void SetTime(double time) { _time = time; }
+
+    HdMeshTopology GetMeshTopology(SdfPath const& id) override
+    {
+        return _topologies[_GetIndex(id) % _topologies.size()];
+    }
+
+    GfMatrix4d GetTransform(SdfPath const& id) override
+    {
+        const size_t i = _GetIndex(id);
+        GfMatrix4d xform(1);
+        xform.SetTranslateOnly(GfVec3d(i % _across, i / _across, 0));
+        if (_options.animate == "transforms")
+            xform.SetTranslateOnly(xform.ExtractTranslation() + GfVec3d(0, 0, 0.25 * std::sin(_time + i)));
+        return xform;
+    }
+
+    VtValue Get(SdfPath const& id, TfToken const& key) override
+    {
+        const size_t i = _GetIndex(id);
+        if (key == HdTokens->points)
+            return VtValue(_GetPoints(i));
+        if (key == HdTokens->displayColor)
+        {
+            const float hue = (float)(i % 7) / 7;
+            return VtValue(VtVec3fArray(1, GfVec3f(0.3f + 0.7f * hue, 0.5f, 1.0f - 0.7f * hue)));
+        }
+        return VtValue();
+    }
+
+    HdPrimvarDescriptorVector GetPrimvarDescriptors(SdfPath const& id, HdInterpolation interpolation) override
+    {
+        HdPrimvarDescriptorVector primvars;
+        if (interpolation == HdInterpolationVertex)
+            primvars.emplace_back(HdTokens->points, interpolation, HdPrimvarRoleTokens->point);
+        else if (interpolation == HdInterpolationConstant)
+            primvars.emplace_back(HdTokens->displayColor, interpolation, HdPrimvarRoleTokens->color);
+        return primvars;
+    }
+
+private:
+    size_t _GetIndex(SdfPath const& id) const
+    {
+        return std::strtoull(id.GetName().c_str() + std::strlen("mesh"), nullptr, 10);
+    }
+
+    // A gently waving sheet inside its unit square, with a phase of its own
+    // so that prims sharing a topology do not share their geometry.
+    VtVec3fArray _GetPoints(size_t i) const
+    {
+        const double time = _options.animate == "points" ? _time : 0;
+        VtVec3fArray points((_columns + 1) * (_rows + 1));
+        for (size_t y = 0; y <= _rows; y++)
+        {
+            for (size_t x = 0; x <= _columns; x++)
+            {
+                const float u = 0.9f * x / _columns;
+                const float v = 0.9f * y / _rows;
+                const float z = 0.05f * std::sin(6 * (u + v) + i + time);
+                points[y * (_columns + 1) + x] = GfVec3f(u, v, z);
+            }
+        }
+        return points;
+    }
+
+    const Options&              _options;
+    double                      _time;
+    size_t                      _columns;
+    size_t                      _rows;
+    size_t                      _across;
+    std::vector<HdMeshTopology> _topologies;
+    SdfPathVector               _ids;
+};
+
+// Syncs and executes one render pass over all the meshes, which is what
+// makes SyncAll sync them. SyncAll only takes tasks in the render index.
+class BenchTask final : public HdTask {
+public:
+    BenchTask(HdSceneDelegate*, SdfPath const& id)
+        : HdTask(id)
+        , _renderTags({HdRenderTagTokens->geometry})
+    {}
+
+    void SetRenderPass(HdRenderPassSharedPtr const& renderPass,
+            HdRenderPassStateSharedPtr const& renderPassState)
+    {
+        _renderPass      = renderPass;
+        _renderPassState = renderPassState;
+    }
+
+    void Sync(HdSceneDelegate*, HdTaskContext*, HdDirtyBits* dirtyBits) override
+    {
+        _renderPass->Sync();
+        *dirtyBits = HdChangeTracker::Clean;
+    }
+
+    void Prepare(HdTaskContext*, HdRenderIndex*) override
+    {
+        _renderPassState->Prepare(_renderPass->GetRenderIndex()->GetResourceRegistry());
+    }
+
+    void Execute(HdTaskContext*) override
+    {
+        _renderPass->Execute(_renderPassState, _renderTags);
+    }
+
+    const TfTokenVector& GetRenderTags() const override { return _renderTags; }
+
+private:
+    HdRenderPassSharedPtr      _renderPass;
+    HdRenderPassStateSharedPtr _renderPassState;
+    TfTokenVector              _renderTags;
+};
+
+struct FrameTimes {
+    double sync;
+    double commit;
+    double execute;
+    double readback;
+    size_t residentBytes;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double Milliseconds(Clock::time_point begin, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+size_t ResidentBytes()
+{
+    size_t pages = 0, resident = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        if (std::fscanf(statm, "%zu %zu", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+size_t PeakResidentBytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss * 1024;
+}
+
+bool ParseOptions(int argc, char** argv, Options* options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--prims")
+            options->prims = std::strtoull(value, nullptr, 10);
+        else if (arg == "--triangles")
+            options->triangles = std::strtoull(value, nullptr, 10);
+        else if (arg == "--topologies")
+            options->topologies = std::strtoull(value, nullptr, 10);
+        else if (arg == "--animate")
+            options->animate = value;
+        else if (arg == "--frames")
+            options->frames = std::strtoull(value, nullptr, 10);
+        else if (arg == "--width")
+            options->width = std::atoi(value);
+        else if (arg == "--height")
+            options->height = std::atoi(value);
+        else if (arg == "--mode")
+            options->mode = value;
+        else if (arg == "--output")
+            options->output = value;
+        else
+        {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    if (options->animate != "none" && options->animate != "transforms" && options->animate != "points")
+    {
+        std::fprintf(stderr, "--animate takes none, transforms or points\n");
+        return false;
+    }
+    if (!options->prims || !options->frames || options->width <= 0 || options->height <= 0)
+    {
+        std::fprintf(stderr, "--prims, --frames, --width and --height must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+void WriteResults(FILE* out, const Options& options, const char* mode, const std::vector<FrameTimes>& frames)
+{
+    std::fprintf(out, "{\"prims\":%zu,\"triangles\":%zu,\"topologies\":%zu,\"animate\":\"%s\","
+            "\"width\":%d,\"height\":%d,\"mode\":\"%s\",\"frames\":[",
+            options.prims, options.triangles, options.topologies, options.animate.c_str(),
+            options.width, options.height, mode);
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const FrameTimes& f = frames[i];
+        std::fprintf(out, "%s{\"syncMs\":%.3f,\"commitMs\":%.3f,\"executeMs\":%.3f,\"readbackMs\":%.3f,"
+                "\"residentBytes\":%zu}", i ? "," : "", f.sync, f.commit, f.execute, f.readback,
+                f.residentBytes);
+    }
+    std::fprintf(out, "],\"peakResidentBytes\":%zu}\n", PeakResidentBytes());
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, &options))
+        return 1;
+
+    HdRenderSettingsMap settings;
+    if (!options.mode.empty())
+        settings[HdTantoRenderSettingsTokens->renderMode] = TfToken(options.mode);
+    HdTantoDelegate renderDelegate(settings);
+#if PXR_VERSION >= 2005
+    std::unique_ptr<HdRenderIndex> index(HdRenderIndex::New(&renderDelegate, HdDriverVector()));
+#else
+    std::unique_ptr<HdRenderIndex> index(HdRenderIndex::New(&renderDelegate));
+#endif
+    if (!index)
+    {
+        std::fprintf(stderr, "Could not create a render index\n");
+        return 1;
+    }
+    BenchScene scene(index.get(), options);
+
+    // the camera looks down at the middle of the grid of prims, from far
+    // enough to see all of it
+    const double across = scene.GetAcross();
+    const GfVec3d center(0.5 * across, 0.5 * across, 0);
+    GfFrustum frustum;
+    frustum.SetPerspective(45, (double)options.width / options.height, 0.1, 10 * across + 10);
+    frustum.SetPosition(center + GfVec3d(0, -0.6 * across, 1.3 * across + 1));
+    frustum.SetRotation(GfRotation(GfVec3d(1, 0, 0), 25));
+
+    const GfVec3i dimensions(options.width, options.height, 1);
+    HdTantoRenderBuffer color(SdfPath("/colorBuffer"));
+    HdTantoRenderBuffer depth(SdfPath("/depthBuffer"));
+    color.Allocate(dimensions, HdFormatUNorm8Vec4, false);
+    depth.Allocate(dimensions, HdFormatFloat32, false);
+    HdRenderPassAovBindingVector bindings(2);
+    bindings[0].aovName      = HdAovTokens->color;
+    bindings[0].renderBuffer = &color;
+    bindings[1].aovName      = HdAovTokens->depth;
+    bindings[1].renderBuffer = &depth;
+
+    HdRenderPassStateSharedPtr renderPassState = std::make_shared<HdRenderPassState>();
+    renderPassState->SetCameraFramingState(frustum.ComputeViewMatrix(), frustum.ComputeProjectionMatrix(),
+            GfVec4d(0, 0, options.width, options.height), HdRenderPassState::ClipPlanesVector());
+    renderPassState->SetAovBindings(bindings);
+
+    const HdRprimCollection collection(HdTokens->geometry, HdReprSelector(HdReprTokens->refined));
+    HdRenderPassSharedPtr renderPass = renderDelegate.CreateRenderPass(index.get(), collection);
+    const SdfPath taskId("/benchTask");
+    index->InsertTask<BenchTask>(&scene, taskId);
+    std::static_pointer_cast<BenchTask>(index->GetTask(taskId))->SetRenderPass(renderPass, renderPassState);
+    HdTaskSharedPtrVector tasks = {index->GetTask(taskId)};
+    HdTaskContext taskContext;
+
+    const HdDirtyBits animatedBits = options.animate == "transforms" ? HdChangeTracker::DirtyTransform :
+        options.animate == "points" ? HdChangeTracker::DirtyPoints : HdChangeTracker::Clean;
+    std::vector<FrameTimes> frames;
+    for (size_t frame = 0; frame < options.frames; frame++)
+    {
+        // the first frame syncs everything; later ones only what moved
+        if (frame && animatedBits != HdChangeTracker::Clean)
+        {
+            scene.SetTime(0.1 * frame);
+            HdChangeTracker& tracker = index->GetChangeTracker();
+            for (const SdfPath& id : scene.GetIds())
+                tracker.MarkRprimDirty(id, animatedBits);
+        }
+
+        FrameTimes times;
+        const Clock::time_point begin = Clock::now();
+        index->SyncAll(&tasks, &taskContext);
+        const Clock::time_point synced = Clock::now();
+        renderDelegate.CommitResources(&index->GetChangeTracker());
+        const Clock::time_point committed = Clock::now();
+        for (const HdTaskSharedPtr& task : tasks)
+            task->Prepare(&taskContext, index.get());
+        for (const HdTaskSharedPtr& task : tasks)
+            task->Execute(&taskContext);
+        const Clock::time_point executed = Clock::now();
+        // Map does not wait for frames still on the GPU, so wait for them
+        // here to count them
+        for (HdRenderPassAovBinding const& binding : bindings)
+        {
+            HdRenderBuffer* buffer = binding.renderBuffer;
+            while (!buffer->IsConverged())
+                std::this_thread::yield();
+            buffer->Map();
+            buffer->Unmap();
+        }
+        const Clock::time_point readBack = Clock::now();
+
+        times.sync          = Milliseconds(begin, synced);
+        times.commit        = Milliseconds(synced, committed);
+        times.execute       = Milliseconds(committed, executed);
+        times.readback      = Milliseconds(executed, readBack);
+        times.residentBytes = ResidentBytes();
+        frames.push_back(times);
+    }
+
+    // the mode the delegate settled on is the default of its setting
+    std::string modeName;
+    for (const HdRenderSettingDescriptor& descriptor : renderDelegate.GetRenderSettingDescriptors())
+    {
+        if (descriptor.key == HdTantoRenderSettingsTokens->renderMode)
+            modeName = TfStringify(descriptor.defaultValue);
+    }
+
+    FILE* out = options.output == "-" ? stdout : std::fopen(options.output.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "Could not open %s\n", options.output.c_str());
+        return 1;
+    }
+    std::fflush(stdout);
+    WriteResults(out, options, modeName.c_str(), frames);
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
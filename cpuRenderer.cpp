@@ -0,0 +1,377 @@
+#include "cpuRenderer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/work/loops.h>
+#include <pxr/base/work/threadLimits.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Triangles and instances get their boxes, and triangles are set up for
+// rasterizing, in ranges of this many.
+static constexpr size_t _grainSize = 4096;
+// Builds and setup are split into this many tasks per thread, so that
+// threads done with small ones can take on more.
+static constexpr uint32_t _tasksPerThread = 4;
+
+HdTantoCpuRenderer::HdTantoCpuRenderer(ModeID mode)
+    : _mode(mode)
+    , _bvh()
+    , _frame()
+    , _instancesDirty(true)
+    , _viewMatrix(1)
+    , _projMatrix(1)
+    , _aoSamples(0)
+    , _aoDistance(0)
+{
+}
+
+HdTantoCpuRenderer::~HdTantoCpuRenderer()
+{
+    for (_Prim& prim : _prims)
+        r_RtFreeBvh(&prim.bvh);
+    r_RtFreeBvh(&_bvh);
+    r_SrFreeFrame(&_frame);
+}
+
+Tanto_PrimId HdTantoCpuRenderer::AddPrim()
+{
+    Tanto_PrimId primId;
+    if (_freePrims.empty())
+    {
+        primId = _prims.size();
+        _prims.emplace_back();
+    }
+    else
+    {
+        primId = _freePrims.back();
+        _freePrims.pop_back();
+    }
+    _prims[primId].alive = true;
+    _instancesDirty = true;
+    return primId;
+}
+
+void HdTantoCpuRenderer::RemovePrim(Tanto_PrimId primId)
+{
+    if (!TF_VERIFY(primId < _prims.size() && _prims[primId].alive))
+        return;
+    r_RtFreeBvh(&_prims[primId].bvh);
+    _prims[primId] = _Prim();
+    _freePrims.push_back(primId);
+    _instancesDirty = true;
+}
+
+void HdTantoCpuRenderer::SetPrimGeometry(Tanto_PrimId primId, const VtVec3fArray& points,
+        const VtVec3iArray& indices, const VtVec3fArray& normals, const VtVec4fArray& pointColors,
+        const VtVec4fArray& triangleColors)
+{
+    _Prim& prim = _prims[primId];
+    prim.points         = points;
+    prim.indices        = indices;
+    prim.normals        = normals.size() == points.size() ? normals : VtVec3fArray();
+    prim.pointColors    = pointColors.size() == points.size() ? pointColors : VtVec4fArray();
+    prim.triangleColors = triangleColors.size() == indices.size() ? triangleColors : VtVec4fArray();
+    int largest = -1;
+    for (const GfVec3i& triangle : indices)
+        largest = std::max({largest, triangle[0], triangle[1], triangle[2]});
+    prim.pointCount = largest + 1;
+    prim.bvhDirty   = true;
+    _instancesDirty = true;
+}
+
+void HdTantoCpuRenderer::SetPrimPoints(Tanto_PrimId primId, const VtVec3fArray& points,
+        const VtVec3fArray& normals)
+{
+    _Prim& prim = _prims[primId];
+    prim.points   = points;
+    prim.normals  = normals.size() == points.size() ? normals : VtVec3fArray();
+    prim.bvhDirty = true;
+    _instancesDirty = true;
+}
+
+void HdTantoCpuRenderer::SetPrimTransform(Tanto_PrimId primId, const GfMatrix4f& xform)
+{
+    _prims[primId].xform = xform;
+    _instancesDirty = true;
+}
+
+void HdTantoCpuRenderer::SetPrimColor(Tanto_PrimId primId, const GfVec4f& color)
+{
+    _prims[primId].color = color;
+    _instancesDirty = true;
+}
+
+void HdTantoCpuRenderer::SetPrimPickId(Tanto_PrimId primId, int32_t pickId)
+{
+    _prims[primId].pickId = pickId;
+    _instancesDirty = true;
+}
+
+void HdTantoCpuRenderer::SetPrimInstances(Tanto_PrimId primId, const VtMatrix4dArray& xforms,
+        const VtVec3fArray& colors)
+{
+    _Prim& prim = _prims[primId];
+    prim.instanced      = true;
+    prim.instanceXforms = xforms;
+    prim.instanceColors = colors.size() == xforms.size() ? colors : VtVec3fArray();
+    _instancesDirty = true;
+}
+
+void HdTantoCpuRenderer::SetCamera(const GfMatrix4f& viewMatrix, const GfMatrix4f& projMatrix)
+{
+    _viewMatrix = viewMatrix;
+    _projMatrix = projMatrix;
+}
+
+void HdTantoCpuRenderer::SetAmbientOcclusion(uint32_t samples, float distance)
+{
+    _aoSamples  = samples;
+    _aoDistance = distance;
+}
+
+bool HdTantoCpuRenderer::_IsDrawn(const _Prim& prim)
+{
+    return prim.alive && !prim.indices.empty() && prim.points.size() >= prim.pointCount;
+}
+
+void HdTantoCpuRenderer::_BuildPrimBvh(_Prim& prim)
+{
+    const size_t triangleCount = prim.indices.size();
+    const uint32_t* indices   = (const uint32_t*)prim.indices.cdata();
+    const Vec3*     positions = (const Vec3*)prim.points.cdata();
+    std::vector<R_Aabb> boxes(triangleCount);
+    WorkParallelForN(triangleCount, [&](size_t begin, size_t end) {
+        r_RtTriangleBoxes(indices, begin, end - begin, positions, boxes.data());
+    }, _grainSize);
+
+    R_RtBuild build;
+    r_RtBeginBuild(&build, &prim.bvh, boxes.data(), triangleCount, WorkGetConcurrencyLimit() * _tasksPerThread);
+    WorkParallelForN(build.taskCount, [&](size_t begin, size_t end) {
+        for (size_t task = begin; task < end; task++)
+            r_RtBuildTask(&build, task);
+    }, 1);
+    r_RtEndBuild(&build);
+    prim.bvhDirty = false;
+}
+
+// Prims are built side by side, and the tasks of large ones spread further.
+void HdTantoCpuRenderer::_BuildPrims()
+{
+    std::vector<_Prim*> dirty;
+    for (_Prim& prim : _prims)
+    {
+        if (_IsDrawn(prim) && prim.bvhDirty)
+            dirty.push_back(&prim);
+    }
+    WorkParallelForN(dirty.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            _BuildPrimBvh(*dirty[i]);
+    }, 1);
+}
+
+void HdTantoCpuRenderer::_UpdateMeshes()
+{
+    _meshes.resize(_prims.size());
+    for (size_t i = 0; i < _prims.size(); i++)
+    {
+        const _Prim& prim = _prims[i];
+        R_RtMesh& mesh = _meshes[i];
+        mesh.positions      = (const Vec3*)prim.points.cdata();
+        mesh.indices        = (const uint32_t*)prim.indices.cdata();
+        mesh.normals        = prim.normals.empty() ? nullptr : (const Vec3*)prim.normals.cdata();
+        mesh.pointColors    = prim.pointColors.empty() ? nullptr : (const Vec4*)prim.pointColors.cdata();
+        mesh.triangleColors = prim.triangleColors.empty() ? nullptr : (const Vec4*)prim.triangleColors.cdata();
+        mesh.bvh            = &prim.bvh;
+    }
+}
+
+// The box of an instance holds the corners of the root box of its prim.
+static R_Aabb _TransformBox(const R_RtNode& root, const Mat4& toWorld)
+{
+    const GfMatrix4f xform(toWorld.x);
+    R_Aabb box;
+    for (int a = 0; a < 3; a++)
+    {
+        box.min.x[a] =  FLT_MAX;
+        box.max.x[a] = -FLT_MAX;
+    }
+    for (int corner = 0; corner < 8; corner++)
+    {
+        const GfVec3f p(corner & 1 ? root.max[0] : root.min[0], corner & 2 ? root.max[1] : root.min[1],
+                corner & 4 ? root.max[2] : root.min[2]);
+        const GfVec3f q = xform.Transform(p);
+        for (int a = 0; a < 3; a++)
+        {
+            box.min.x[a] = std::min(box.min.x[a], q[a]);
+            box.max.x[a] = std::max(box.max.x[a], q[a]);
+        }
+    }
+    return box;
+}
+
+static R_RtInstance _MakeInstance(uint32_t mesh, int32_t pickId, const GfMatrix4f& toWorld,
+        const GfVec4f& color)
+{
+    R_RtInstance instance;
+    const GfMatrix4f toObject = toWorld.GetInverse();
+    memcpy(&instance.toWorld,  toWorld.data(),  sizeof(instance.toWorld));
+    memcpy(&instance.toObject, toObject.data(), sizeof(instance.toObject));
+    for (int c = 0; c < 4; c++)
+        instance.color.x[c] = color[c];
+    instance.mesh   = mesh;
+    instance.pickId = pickId;
+    return instance;
+}
+
+void HdTantoCpuRenderer::_GatherInstances()
+{
+    size_t instanceCount = 0;
+    for (const _Prim& prim : _prims)
+    {
+        if (_IsDrawn(prim))
+            instanceCount += prim.instanced ? prim.instanceXforms.size() : 1;
+    }
+    _instances.resize(instanceCount);
+
+    // instanced prims are drawn after their own transform, as the raster
+    // path draws them
+    size_t first = 0;
+    for (size_t i = 0; i < _prims.size(); i++)
+    {
+        const _Prim& prim = _prims[i];
+        if (!_IsDrawn(prim))
+            continue;
+        if (!prim.instanced)
+        {
+            _instances[first++] = _MakeInstance(i, prim.pickId, prim.xform, prim.color);
+            continue;
+        }
+        const GfMatrix4d* xforms = prim.instanceXforms.cdata();
+        const GfVec3f*    colors = prim.instanceColors.empty() ? nullptr : prim.instanceColors.cdata();
+        WorkParallelForN(prim.instanceXforms.size(), [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; j++)
+            {
+                const GfMatrix4f toWorld = prim.xform * GfMatrix4f(xforms[j]);
+                GfVec4f color = prim.color;
+                if (colors)
+                    color = GfCompMult(color, GfVec4f(colors[j][0], colors[j][1], colors[j][2], 1));
+                _instances[first + j] = _MakeInstance(i, prim.pickId, toWorld, color);
+            }
+        }, _grainSize);
+        first += prim.instanceXforms.size();
+    }
+}
+
+void HdTantoCpuRenderer::_BuildInstanceBvh()
+{
+    const size_t instanceCount = _instances.size();
+    _instanceBoxes.resize(instanceCount);
+    WorkParallelForN(instanceCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const R_RtInstance& instance = _instances[i];
+            _instanceBoxes[i] = _TransformBox(_meshes[instance.mesh].bvh->nodes[0], instance.toWorld);
+        }
+    }, _grainSize);
+
+    R_RtBuild build;
+    r_RtBeginBuild(&build, &_bvh, _instanceBoxes.data(), instanceCount,
+            WorkGetConcurrencyLimit() * _tasksPerThread);
+    WorkParallelForN(build.taskCount, [&](size_t begin, size_t end) {
+        for (size_t task = begin; task < end; task++)
+            r_RtBuildTask(&build, task);
+    }, 1);
+    r_RtEndBuild(&build);
+}
+
+void HdTantoCpuRenderer::Render(const R_RtTarget& target)
+{
+    // prims are only traced with their hierarchies
+    if (_mode == MODE_RAY)
+        _BuildPrims();
+    _UpdateMeshes();
+    if (_instancesDirty)
+    {
+        _GatherInstances();
+        if (_mode == MODE_RAY)
+            _BuildInstanceBvh();
+        _instancesDirty = false;
+    }
+
+    const GfMatrix4f toClip = _viewMatrix * _projMatrix;
+    const GfMatrix4f fromClip = toClip.GetInverse();
+    R_RtView view;
+    memcpy(&view.toClip,   toClip.data(),   sizeof(view.toClip));
+    memcpy(&view.fromClip, fromClip.data(), sizeof(view.fromClip));
+    view.aoSamples  = _aoSamples;
+    view.aoDistance = _aoDistance;
+    if (view.aoDistance <= 0 && _bvh.itemCount)
+    {
+        const R_RtNode& root = _bvh.nodes[0];
+        const GfVec3f size(root.max[0] - root.min[0], root.max[1] - root.min[1], root.max[2] - root.min[2]);
+        view.aoDistance = 0.1f * size.GetLength();
+    }
+
+    if (_mode == MODE_RAY)
+        _Trace(target, view);
+    else
+        _Rasterize(target, view);
+}
+
+// Tiles are handed to the threads one at a time, so threads that get the
+// empty parts of the image go on to take more of the rest.
+void HdTantoCpuRenderer::_Trace(const R_RtTarget& target, const R_RtView& view)
+{
+    const R_RtScene scene = {_meshes.data(), _instances.data(), &_bvh};
+    WorkParallelForN(r_RtTileCount(&target), [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++)
+            r_RtTraceTile(&scene, &view, &target, tile);
+    }, 1);
+}
+
+// The triangles of all instances are split into even ranges, each set up
+// into a binner of its own, so the threads bin without sharing anything.
+// Binners are drawn in order, so prims are drawn in the order of their
+// slots as the raster path draws them.
+void HdTantoCpuRenderer::_Rasterize(const R_RtTarget& target, const R_RtView& view)
+{
+    _firstTriangles.resize(_instances.size() + 1);
+    size_t triangleCount = 0;
+    for (size_t i = 0; i < _instances.size(); i++)
+    {
+        _firstTriangles[i] = triangleCount;
+        triangleCount += _prims[_instances[i].mesh].indices.size();
+    }
+    _firstTriangles.back() = triangleCount;
+
+    const size_t rangeCount = std::max<size_t>(1, std::min<size_t>(triangleCount / _grainSize,
+            WorkGetConcurrencyLimit() * _tasksPerThread));
+    r_SrBeginFrame(&_frame, &target, rangeCount);
+    WorkParallelForN(rangeCount, [&](size_t begin, size_t end) {
+        for (size_t range = begin; range < end; range++)
+        {
+            size_t first = triangleCount * range / rangeCount;
+            const size_t last = triangleCount * (range + 1) / rangeCount;
+            size_t i = std::upper_bound(_firstTriangles.begin(), _firstTriangles.end(), first) -
+                _firstTriangles.begin() - 1;
+            while (first < last)
+            {
+                const size_t count = std::min(last, _firstTriangles[i + 1]) - first;
+                const R_RtInstance& instance = _instances[i];
+                r_SrSetup(&_frame, range, &_meshes[instance.mesh], &instance, &view,
+                        first - _firstTriangles[i], count);
+                first += count;
+                i++;
+            }
+        }
+    }, 1);
+    WorkParallelForN(r_SrTileCount(&_frame), [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++)
+            r_SrRasterizeTile(&_frame, &view, &target, tile);
+    }, 1);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,133 @@
+#ifndef TANTO_CPU_RENDERER_H
+#define TANTO_CPU_RENDERER_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/gf/vec4f.h>
+#include <pxr/base/vt/types.h>
+
+#include <vector>
+
+extern "C"
+{
+#include "tantoren/render.h"
+#include "tantoren/common.h"
+#include "tantoren/raytrace.h"
+#include "tantoren/softras.h"
+}
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class HdTantoCpuRenderer
+///
+/// Renders prims on the CPU, by ray tracing them for MODE_RAY or by
+/// rasterizing them with tantoren/softras.h for MODE_SOFTWARE. It keeps
+/// prims of its own, which share their arrays with the meshes. To trace
+/// them it builds the hierarchies of tantoren/raytrace.h over them as they
+/// change: one per prim in its own space and one over the instances of all
+/// prims. Builds and frames are spread over the Work thread pool. Not
+/// thread safe; HdTantoRenderer calls it with its lock held.
+///
+class HdTantoCpuRenderer final {
+public:
+    /// MODE_RAY or MODE_SOFTWARE.
+    explicit HdTantoCpuRenderer(ModeID mode);
+    ~HdTantoCpuRenderer();
+
+    /// Add a prim without geometry, drawn with the default color.
+    Tanto_PrimId AddPrim();
+    void RemovePrim(Tanto_PrimId primId);
+
+    /// Replace the geometry of a prim. Normals, point colors and triangle
+    /// colors are empty unless there is one per point or per triangle.
+    void SetPrimGeometry(Tanto_PrimId primId, const VtVec3fArray& points, const VtVec3iArray& indices,
+            const VtVec3fArray& normals, const VtVec4fArray& pointColors,
+            const VtVec4fArray& triangleColors);
+    /// The point count must match the geometry.
+    void SetPrimPoints(Tanto_PrimId primId, const VtVec3fArray& points, const VtVec3fArray& normals);
+    void SetPrimTransform(Tanto_PrimId primId, const GfMatrix4f& xform);
+    void SetPrimColor(Tanto_PrimId primId, const GfVec4f& color);
+    void SetPrimPickId(Tanto_PrimId primId, int32_t pickId);
+    /// Draw the prim once per transform, after its own. Colors, if not
+    /// empty, hold one color per transform.
+    void SetPrimInstances(Tanto_PrimId primId, const VtMatrix4dArray& xforms,
+            const VtVec3fArray& colors);
+
+    void SetCamera(const GfMatrix4f& viewMatrix, const GfMatrix4f& projMatrix);
+    /// Ambient occlusion rays per pixel, 0 for none, and their length. A
+    /// length of 0 takes a tenth of the size of the scene.
+    void SetAmbientOcclusion(uint32_t samples, float distance);
+
+    /// Render a frame into the aovs of target, waiting for it to finish.
+    void Render(const R_RtTarget& target);
+
+private:
+    struct _Prim {
+        bool            alive = false;
+        VtVec3fArray    points;
+        VtVec3iArray    indices;
+        VtVec3fArray    normals;
+        VtVec4fArray    pointColors;
+        VtVec4fArray    triangleColors;
+        // Points the indices need, one more than the largest.
+        size_t          pointCount = 0;
+        GfVec4f         color = GfVec4f(0.5, 0.5, 0.5, 1);
+        GfMatrix4f      xform = GfMatrix4f(1);
+        // Instanced prims are drawn once per instance transform only.
+        bool            instanced = false;
+        VtMatrix4dArray instanceXforms;
+        VtVec3fArray    instanceColors;
+        int32_t         pickId = -1;
+        // Over the triangles, built again before the next frame when dirty.
+        R_RtBvh         bvh = {};
+        bool            bvhDirty = false;
+    };
+
+    // Prims that have triangles and points for all of them.
+    static bool _IsDrawn(const _Prim& prim);
+
+    // Build the hierarchies of the prims whose geometry changed.
+    void _BuildPrims();
+    static void _BuildPrimBvh(_Prim& prim);
+    // Point the meshes at the arrays of the prims.
+    void _UpdateMeshes();
+    // Gather the instances of every prim.
+    void _GatherInstances();
+    // Build the hierarchy over the instances, from the roots of the
+    // hierarchies of their prims.
+    void _BuildInstanceBvh();
+
+    void _Trace(const R_RtTarget& target, const R_RtView& view);
+    void _Rasterize(const R_RtTarget& target, const R_RtView& view);
+
+    const ModeID _mode;
+
+    // Slots of removed prims are reused by the next ones added.
+    std::vector<_Prim>        _prims;
+    std::vector<Tanto_PrimId> _freePrims;
+
+    // One per prim slot, pointing into _prims. Refreshed every frame as the
+    // slots may have moved.
+    std::vector<R_RtMesh>     _meshes;
+    std::vector<R_RtInstance> _instances;
+    std::vector<R_Aabb>       _instanceBoxes;
+    R_RtBvh                   _bvh;
+    // The first triangle of each instance, as if the triangles of all of
+    // them were laid end to end, and the count of them all at the end.
+    std::vector<size_t>       _firstTriangles;
+    R_SrFrame                 _frame;
+    // Set by every change to a prim, as any of them may move its instances.
+    bool                      _instancesDirty;
+
+    GfMatrix4f _viewMatrix;
+    GfMatrix4f _projMatrix;
+    uint32_t   _aoSamples;
+    float      _aoDistance;
+
+    HdTantoCpuRenderer(const HdTantoCpuRenderer&) = delete;
+    HdTantoCpuRenderer &operator =(const HdTantoCpuRenderer&) = delete;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // TANTO_CPU_RENDERER_H
@@ -0,0 +1,197 @@
+#include "instancer.h"
+
+#include "pxr/imaging/hd/sceneDelegate.h"
+#include "pxr/imaging/hd/renderIndex.h"
+#include "pxr/imaging/hd/changeTracker.h"
+#include "pxr/imaging/hd/tokens.h"
+#include "pxr/base/gf/quaternion.h"
+#include "pxr/base/gf/rotation.h"
+#include "pxr/base/gf/vec4f.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+HdTantoInstancer::HdTantoInstancer(HdSceneDelegate* delegate,
+                                   SdfPath const& id,
+                                   SdfPath const &parentId)
+    : HdInstancer(delegate, id, parentId)
+{
+}
+
+void
+HdTantoInstancer::_SyncPrimvars()
+{
+    HdChangeTracker &changeTracker = 
+        GetDelegate()->GetRenderIndex().GetChangeTracker();
+    SdfPath const& id = GetId();
+
+    // prototypes of the same instancer sync in parallel. check again under
+    // the lock so that only the first of them pulls the primvars.
+    HdDirtyBits dirtyBits = changeTracker.GetInstancerDirtyBits(id);
+    if (!HdChangeTracker::IsAnyPrimvarDirty(dirtyBits, id))
+        return;
+
+    std::lock_guard<std::mutex> lock(_instanceLock);
+
+    dirtyBits = changeTracker.GetInstancerDirtyBits(id);
+    if (!HdChangeTracker::IsAnyPrimvarDirty(dirtyBits, id))
+        return;
+
+    HdPrimvarDescriptorVector primvars = 
+        GetDelegate()->GetPrimvarDescriptors(id, HdInterpolationInstance);
+
+    for (HdPrimvarDescriptor const& pv: primvars) 
+    {
+        if (!HdChangeTracker::IsPrimvarDirty(dirtyBits, id, pv.name))
+            continue;
+        VtValue value = GetDelegate()->Get(id, pv.name);
+        if (value.IsEmpty())
+            _primvarMap.erase(pv.name);
+        else
+            _primvarMap[pv.name].reset(new HdVtBufferSource(pv.name, value));
+    }
+
+    changeTracker.MarkInstancerClean(id);
+}
+
+template <typename T>
+bool
+HdTantoInstancer::_GatherPrimvar(TfToken const& name, VtIntArray const& indices, VtArray<T>* out)
+{
+    auto it = _primvarMap.find(name);
+    if (it == _primvarMap.end())
+        return false;
+    const HdVtBufferSource* source = it->second.get();
+    if (source->GetTupleType() != HdGetValueTupleType(VtValue(T())))
+    {
+        TF_WARN("Instance primvar %s of %s has an unsupported type", 
+                name.GetText(), GetId().GetText());
+        return false;
+    }
+    const T* data = static_cast<const T*>(source->GetData());
+    const size_t count = source->GetNumElements();
+    out->resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        if (size_t(indices[i]) >= count)
+            return false;
+        (*out)[i] = data[indices[i]];
+    }
+    return true;
+}
+
+VtMatrix4dArray
+HdTantoInstancer::ComputeInstanceTransforms(SdfPath const &prototypeId)
+{
+    _SyncPrimvars();
+
+    const GfMatrix4d instancerTransform = 
+        GetDelegate()->GetInstancerTransform(GetId());
+    const VtIntArray instanceIndices = 
+        GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
+
+    VtMatrix4dArray transforms(instanceIndices.size(), instancerTransform);
+
+    // the instance primvars apply in the order translate, rotate, scale,
+    // instanceTransform, each on top of the previous ones
+    VtVec3fArray translates;
+    if (_GatherPrimvar(HdInstancerTokens->translate, instanceIndices, &translates))
+    {
+        for (size_t i = 0; i < transforms.size(); ++i) 
+        {
+            GfMatrix4d translateMat(1);
+            translateMat.SetTranslate(GfVec3d(translates[i]));
+            transforms[i] = translateMat * transforms[i];
+        }
+    }
+
+    VtVec4fArray rotates;
+    if (_GatherPrimvar(HdInstancerTokens->rotate, instanceIndices, &rotates))
+    {
+        for (size_t i = 0; i < transforms.size(); ++i) 
+        {
+            const GfVec4f& q = rotates[i];
+            GfMatrix4d rotateMat(1);
+            rotateMat.SetRotate(GfRotation(GfQuaternion(q[0], GfVec3d(q[1], q[2], q[3]))));
+            transforms[i] = rotateMat * transforms[i];
+        }
+    }
+
+    VtVec3fArray scales;
+    if (_GatherPrimvar(HdInstancerTokens->scale, instanceIndices, &scales))
+    {
+        for (size_t i = 0; i < transforms.size(); ++i) 
+        {
+            GfMatrix4d scaleMat(1);
+            scaleMat.SetScale(GfVec3d(scales[i]));
+            transforms[i] = scaleMat * transforms[i];
+        }
+    }
+
+    VtMatrix4dArray instanceTransforms;
+    if (_GatherPrimvar(HdInstancerTokens->instanceTransform, instanceIndices, &instanceTransforms))
+    {
+        for (size_t i = 0; i < transforms.size(); ++i) 
+            transforms[i] = instanceTransforms[i] * transforms[i];
+    }
+
+    if (GetParentId().IsEmpty())
+        return transforms;
+
+    // every instance of this instancer is repeated for each instance of the
+    // parent instancer it is a prototype of
+    HdInstancer *parentInstancer = 
+        GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
+    if (!TF_VERIFY(parentInstancer))
+        return transforms;
+
+    const VtMatrix4dArray parentTransforms = 
+        static_cast<HdTantoInstancer*>(parentInstancer)->ComputeInstanceTransforms(GetId());
+
+    VtMatrix4dArray flattened(parentTransforms.size() * transforms.size());
+    for (size_t i = 0; i < parentTransforms.size(); ++i)
+        for (size_t j = 0; j < transforms.size(); ++j)
+            flattened[i * transforms.size() + j] = transforms[j] * parentTransforms[i];
+    return flattened;
+}
+
+VtVec3fArray
+HdTantoInstancer::ComputeInstanceColors(SdfPath const &prototypeId)
+{
+    _SyncPrimvars();
+
+    const VtIntArray instanceIndices = 
+        GetDelegate()->GetInstanceIndices(GetId(), prototypeId);
+
+    VtVec3fArray colors;
+    const bool hasColors = 
+        _GatherPrimvar(HdTokens->displayColor, instanceIndices, &colors);
+
+    if (GetParentId().IsEmpty())
+        return hasColors ? colors : VtVec3fArray();
+
+    HdInstancer *parentInstancer = 
+        GetDelegate()->GetRenderIndex().GetInstancer(GetParentId());
+    if (!TF_VERIFY(parentInstancer))
+        return hasColors ? colors : VtVec3fArray();
+
+    const VtVec3fArray parentColors = 
+        static_cast<HdTantoInstancer*>(parentInstancer)->ComputeInstanceColors(GetId());
+    if (parentColors.empty() && !hasColors)
+        return VtVec3fArray();
+
+    // same order as ComputeInstanceTransforms. the parent count comes from
+    // its transforms, since the parent may not author colors.
+    const size_t parentCount = 
+        static_cast<HdTantoInstancer*>(parentInstancer)->ComputeInstanceTransforms(GetId()).size();
+    VtVec3fArray flattened(parentCount * instanceIndices.size());
+    for (size_t i = 0; i < parentCount; ++i)
+        for (size_t j = 0; j < instanceIndices.size(); ++j)
+        {
+            const GfVec3f parent = parentColors.empty() ? GfVec3f(1) : parentColors[i];
+            const GfVec3f own    = hasColors ? colors[j] : GfVec3f(1);
+            flattened[i * instanceIndices.size() + j] = GfCompMult(parent, own);
+        }
+    return flattened;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,56 @@
+#ifndef TANTO_INSTANCER_H
+#define TANTO_INSTANCER_H
+
+#include "pxr/pxr.h"
+#include "pxr/imaging/hd/instancer.h"
+#include "pxr/imaging/hd/vtBufferSource.h"
+#include "pxr/base/tf/hashmap.h"
+#include "pxr/base/tf/token.h"
+#include "pxr/base/vt/array.h"
+#include "pxr/base/gf/matrix4d.h"
+#include "pxr/base/gf/vec3f.h"
+
+#include <memory>
+#include <mutex>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class HdTantoInstancer
+///
+/// Flattens the instance primvars of a point instancer, and of the
+/// instancers it is nested in, into one transform and color per instance of
+/// a prototype. The prototype mesh uploads them as the instances of its
+/// renderer prim, so each prototype is drawn once for all of its instances.
+///
+class HdTantoInstancer final : public HdInstancer {
+public:
+    HdTantoInstancer(HdSceneDelegate* delegate, SdfPath const& id,
+                     SdfPath const &parentInstancerId);
+
+    ~HdTantoInstancer() override = default;
+
+    /// Computes the world transform of every instance of prototypeId,
+    /// including the instancer transform and nested instancers.
+    VtMatrix4dArray ComputeInstanceTransforms(SdfPath const &prototypeId);
+
+    /// Computes the displayColor of every instance of prototypeId, in the
+    /// order of ComputeInstanceTransforms. Empty if no instancer in the chain
+    /// authors one.
+    VtVec3fArray ComputeInstanceColors(SdfPath const &prototypeId);
+
+private:
+    // Pulls the dirty instance primvars. Called by every prototype, so it
+    // only does work for the first one after a change.
+    void _SyncPrimvars();
+
+    // Returns the primvar value of each instance of prototypeId.
+    template <typename T>
+    bool _GatherPrimvar(TfToken const& name, VtIntArray const& indices, VtArray<T>* out);
+
+    std::mutex _instanceLock;
+    TfHashMap<TfToken, std::unique_ptr<HdVtBufferSource>, TfToken::HashFunctor> _primvarMap;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // TANTO_INSTANCER_H
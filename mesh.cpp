@@ -22,9 +22,15 @@
 // language governing permissions and limitations under the Apache License.
 //
 #include "mesh.h"
+#include "instancer.h"
 #include <cstring>
 #include <pxr/imaging/hd/meshUtil.h>
-#include <pxr/imaging/hd/flatNormals.h>
+#include <pxr/base/work/loops.h>
+
+extern "C" 
+{
+#include "tantoren/normals.h"
+}
 
 #include <iostream>
 
@@ -32,7 +38,13 @@ PXR_NAMESPACE_OPEN_SCOPE
 
 HdTantoMesh::HdTantoMesh(HdTantoRenderer& renderer, SdfPath const& id, SdfPath const& instancerId)
     : HdMesh(id, instancerId),
-    _renderer(renderer)
+    _renderer(renderer),
+    _colorInterpolation(HdInterpolationConstant),
+    _opacityInterpolation(HdInterpolationConstant),
+    _colorsVary(false),
+    _primId(0),
+    _hasPrim(false),
+    _pointCount(0)
 {
 }
 
@@ -44,9 +56,12 @@ HdTantoMesh::GetInitialDirtyBitsMask() const
         | HdChangeTracker::InitRepr
         | HdChangeTracker::DirtyPoints
         | HdChangeTracker::DirtyTopology
-        | HdChangeTracker::DirtyTransform
+        | HdChangeTracker::DirtyPrimvar
+        | HdChangeTracker::DirtyNormals
         | HdChangeTracker::DirtyVisibility
-        | HdChangeTracker::DirtyCullStyle;
+        | HdChangeTracker::DirtyCullStyle
+        | HdChangeTracker::DirtyInstancer
+        | HdChangeTracker::DirtyInstanceIndex;
 }
 
 HdDirtyBits
@@ -60,8 +75,6 @@ HdTantoMesh::_InitRepr(TfToken const &reprToken, HdDirtyBits *dirtyBits)
 {
     TF_UNUSED(dirtyBits);
 
-    std::cout << "_InitRepr. ReprToken: " << reprToken << '\n';
-
     // Create an empty repr.
     _ReprVector::iterator it = std::find_if(_reprs.begin(), _reprs.end(),
                                             _ReprComparator(reprToken));
@@ -76,7 +89,6 @@ HdTantoMesh::Sync(HdSceneDelegate *sceneDelegate,
                    HdDirtyBits     *dirtyBits,
                    TfToken const   &reprToken)
 {
-    std::cout << "* (multithreaded) Sync Tanto Mesh id=" << GetId() << std::endl;
     //
     // XXX: A mesh repr can have multiple repr decs; this is done, for example, 
     // when the drawstyle specifies different rasterizing modes between front
@@ -90,6 +102,342 @@ HdTantoMesh::Sync(HdSceneDelegate *sceneDelegate,
     // Pull top-level embree state out of the render param.
     // Create embree geometry objects.
     _PopulateTantoMesh(sceneDelegate, dirtyBits, desc);
+
+    SdfPath const& id = GetId();
+    if (_hasPrim && !GetInstancerId().IsEmpty() &&
+        (HdChangeTracker::IsInstancerDirty(*dirtyBits, id) ||
+         HdChangeTracker::IsInstanceIndexDirty(*dirtyBits, id)))
+        _PopulateInstances(sceneDelegate);
+
+    // Clean all dirty bits.
+    *dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
+}
+
+void
+HdTantoMesh::Finalize(HdRenderParam *renderParam)
+{
+    if (_hasPrim)
+    {
+        _renderer.RemovePrim(_primId);
+        _hasPrim = false;
+    }
+    _renderer.GetTopologyCache().Release(_triangulation);
+    _triangulation.reset();
+}
+
+void HdTantoMesh::_PopulateInstances(HdSceneDelegate *sceneDelegate)
+{
+    HdInstancer *instancer = 
+        sceneDelegate->GetRenderIndex().GetInstancer(GetInstancerId());
+    if (!TF_VERIFY(instancer))
+        return;
+
+    HdTantoInstancer *tantoInstancer = static_cast<HdTantoInstancer*>(instancer);
+    const VtMatrix4dArray transforms = tantoInstancer->ComputeInstanceTransforms(GetId());
+    VtVec3fArray colors = tantoInstancer->ComputeInstanceColors(GetId());
+    if (!colors.empty() && colors.size() != transforms.size())
+    {
+        TF_WARN("Instance colors of %s do not match its instances", GetId().GetText());
+        colors = VtVec3fArray();
+    }
+
+    _renderer.UpdatePrimInstances(_primId, transforms, colors);
+}
+
+void HdTantoMesh::_PullNormals(HdSceneDelegate *sceneDelegate)
+{
+    _authoredNormals = VtVec3fArray();
+    for (const HdInterpolation interpolation : {HdInterpolationVertex, HdInterpolationVarying})
+    {
+        for (const HdPrimvarDescriptor& primvar : GetPrimvarDescriptors(sceneDelegate, interpolation))
+        {
+            if (primvar.name != HdTokens->normals)
+                continue;
+            VtValue value = GetPrimvar(sceneDelegate, HdTokens->normals);
+            if (value.IsHolding<VtVec3fArray>())
+                _authoredNormals = value.UncheckedGet<VtVec3fArray>();
+            return;
+        }
+    }
+}
+
+bool HdTantoMesh::_PullPrimvar(HdSceneDelegate *sceneDelegate, TfToken const &name,
+                              VtValue *value, HdInterpolation *interpolation)
+{
+    for (int i = 0; i < HdInterpolationCount; i++)
+    {
+        for (const HdPrimvarDescriptor& primvar : GetPrimvarDescriptors(sceneDelegate, HdInterpolation(i)))
+        {
+            if (primvar.name != name)
+                continue;
+            *value         = GetPrimvar(sceneDelegate, name);
+            *interpolation = HdInterpolation(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void HdTantoMesh::_PullColors(HdSceneDelegate *sceneDelegate)
+{
+    VtValue value;
+    _color = VtVec3fArray();
+    _colorInterpolation = HdInterpolationConstant;
+    if (_PullPrimvar(sceneDelegate, HdTokens->displayColor, &value, &_colorInterpolation) &&
+        value.IsHolding<VtVec3fArray>())
+        _color = value.UncheckedGet<VtVec3fArray>();
+
+    _opacity = VtFloatArray();
+    _opacityInterpolation = HdInterpolationConstant;
+    if (_PullPrimvar(sceneDelegate, HdTokens->displayOpacity, &value, &_opacityInterpolation) &&
+        value.IsHolding<VtFloatArray>())
+        _opacity = value.UncheckedGet<VtFloatArray>();
+}
+
+static bool _Varies(HdInterpolation interpolation, size_t size)
+{
+    return size && interpolation != HdInterpolationConstant && interpolation != HdInterpolationInstance;
+}
+
+bool HdTantoMesh::_ColorsVary() const
+{
+    return _Varies(_colorInterpolation, _color.size()) || _Varies(_opacityInterpolation, _opacity.size());
+}
+
+HdInterpolation HdTantoMesh::_CheckInterpolation(TfToken const &name, HdInterpolation interpolation,
+                                                 size_t size) const
+{
+    size_t expected;
+    switch (interpolation)
+    {
+        case HdInterpolationUniform:     expected = _topology.GetNumFaces(); break;
+        case HdInterpolationVertex:
+        case HdInterpolationVarying:     expected = _points.size(); break;
+        case HdInterpolationFaceVarying: expected = _topology.GetFaceVertexIndices().size(); break;
+        default:                         return HdInterpolationConstant;
+    }
+    if (size == expected || size == 0)
+        return size ? interpolation : HdInterpolationConstant;
+    TF_WARN("%s of %s has %zu values instead of %zu, only the first is used",
+            name.GetText(), GetId().GetText(), size, expected);
+    return HdInterpolationConstant;
+}
+
+// Index of the value of a primvar at a corner of a face.
+static size_t _ValueIndex(HdInterpolation interpolation, int face, int point, int faceVertex)
+{
+    switch (interpolation)
+    {
+        case HdInterpolationUniform:     return face;
+        case HdInterpolationVertex:
+        case HdInterpolationVarying:     return point;
+        case HdInterpolationFaceVarying: return faceVertex;
+        default:                         return 0;
+    }
+}
+
+// Constant colors go to the material. Colors per face are given per
+// triangle and colors per point as they are; both replace the material
+// color with white. Anything else is evaluated at the corners of the
+// triangles, which welds the points.
+void HdTantoMesh::_ResolveColors(const HdTantoTriangulation& triangulation)
+{
+    HdInterpolation colorInterpolation = 
+        _CheckInterpolation(HdTokens->displayColor, _colorInterpolation, _color.size());
+    HdInterpolation opacityInterpolation = 
+        _CheckInterpolation(HdTokens->displayOpacity, _opacityInterpolation, _opacity.size());
+    const size_t triangleCount = triangulation.indices.size();
+    const bool perFace   = colorInterpolation == HdInterpolationUniform || 
+                           opacityInterpolation == HdInterpolationUniform;
+    const bool perCorner = colorInterpolation == HdInterpolationFaceVarying || 
+                           opacityInterpolation == HdInterpolationFaceVarying;
+    if ((perFace || perCorner) && triangulation.primitiveParams.size() != triangleCount)
+    {
+        TF_WARN("Triangles of %s have no faces, colors are taken as constant", GetId().GetText());
+        colorInterpolation   = HdInterpolationConstant;
+        opacityInterpolation = HdInterpolationConstant;
+    }
+
+    const GfVec3f* colors    = _color.cdata();
+    const float*   opacities = _opacity.cdata();
+    auto valueAt = [&](int face, int point, int faceVertex) {
+        const GfVec3f color = _color.empty() ? GfVec3f(0.5) : 
+            colors[_ValueIndex(colorInterpolation, face, point, faceVertex)];
+        const float opacity = _opacity.empty() ? 1.0f : 
+            opacities[_ValueIndex(opacityInterpolation, face, point, faceVertex)];
+        return GfVec4f(color[0], color[1], color[2], opacity);
+    };
+    auto isConstant = [](HdInterpolation interpolation) {
+        return interpolation == HdInterpolationConstant;
+    };
+    auto isPerPoint = [](HdInterpolation interpolation) {
+        return interpolation == HdInterpolationVertex || interpolation == HdInterpolationVarying;
+    };
+
+    _colors  = PrimColors();
+    _weld    = _Weld();
+    if (isConstant(colorInterpolation) && isConstant(opacityInterpolation))
+    {
+        _colors.constant = valueAt(0, 0, 0);
+        return;
+    }
+    _colors.constant = GfVec4f(1);
+    constexpr size_t grainSize = 4096;
+    const int* params = triangulation.primitiveParams.cdata();
+
+    if ((isConstant(colorInterpolation) || colorInterpolation == HdInterpolationUniform) &&
+        (isConstant(opacityInterpolation) || opacityInterpolation == HdInterpolationUniform))
+    {
+        _colors.triangles.resize(triangleCount);
+        GfVec4f* dst = _colors.triangles.data();
+        WorkParallelForN(triangleCount, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++)
+                dst[t] = valueAt(HdMeshUtil::DecodeFaceIndexFromCoarseFaceParam(params[t]), 0, 0);
+        }, grainSize);
+        return;
+    }
+
+    if ((isConstant(colorInterpolation) || isPerPoint(colorInterpolation)) &&
+        (isConstant(opacityInterpolation) || isPerPoint(opacityInterpolation)))
+    {
+        _colors.points.resize(_points.size());
+        GfVec4f* dst = _colors.points.data();
+        WorkParallelForN(_points.size(), [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++)
+                dst[p] = valueAt(0, p, 0);
+        }, grainSize);
+        return;
+    }
+
+    // the corners of the triangles are found among the corners of their face
+    if (triangulation.pointCount != _points.size() || 
+        (triangulation.pointTriangleOffsets.empty() && triangleCount))
+    {
+        TF_WARN("Triangles of %s do not match its points, colors are taken as constant", GetId().GetText());
+        _colors.constant = valueAt(0, 0, 0);
+        return;
+    }
+    const VtIntArray& faceVertexCounts = _topology.GetFaceVertexCounts();
+    std::vector<int> faceStarts(faceVertexCounts.size());
+    for (size_t f = 1; f < faceStarts.size(); f++)
+        faceStarts[f] = faceStarts[f - 1] + faceVertexCounts[f - 1];
+    const int* faceVertices = _topology.GetFaceVertexIndices().cdata();
+    const int* counts       = faceVertexCounts.cdata();
+    const int* indices      = (const int*)triangulation.indices.cdata();
+    std::vector<GfVec4f> corners(triangleCount * 3);
+    WorkParallelForN(triangleCount, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+        {
+            const int face  = HdMeshUtil::DecodeFaceIndexFromCoarseFaceParam(params[t]);
+            const int start = faceStarts[face];
+            for (size_t c = t * 3; c < t * 3 + 3; c++)
+            {
+                int faceVertex = start;
+                while (faceVertex < start + counts[face] - 1 && faceVertices[faceVertex] != indices[c])
+                    faceVertex++;
+                corners[c] = valueAt(face, indices[c], faceVertex);
+            }
+        }
+    }, grainSize);
+    _WeldCorners(triangulation, corners);
+}
+
+// Every point keeps a list of its copies, which are few, so a corner only
+// compares its color with the copies of its own point.
+void HdTantoMesh::_WeldCorners(const HdTantoTriangulation& triangulation,
+                               const std::vector<GfVec4f>& corners)
+{
+    constexpr uint32_t none = ~uint32_t(0);
+    const size_t indexCount = triangulation.indices.size() * 3;
+    const int* src = (const int*)triangulation.indices.cdata();
+    std::vector<uint32_t> firstCopy(_points.size(), none);
+    std::vector<uint32_t> nextCopy;
+    VtVec3iArray indices(triangulation.indices.size());
+    int* dst = (int*)indices.data();
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        const uint32_t point = src[i];
+        uint32_t copy = firstCopy[point];
+        while (copy != none && _colors.points.cdata()[copy] != corners[i])
+            copy = nextCopy[copy];
+        if (copy == none)
+        {
+            copy = _weld.sources.size();
+            _weld.sources.push_back(point);
+            _colors.points.push_back(corners[i]);
+            nextCopy.push_back(firstCopy[point]);
+            firstCopy[point] = copy;
+        }
+        dst[i] = copy;
+    }
+    _CopyWeldedPoints();
+    _weld.indices  = indices;
+    _weld.indexSet = _renderer.AddIndexSet(indices, _weld.sources.size());
+}
+
+void HdTantoMesh::_CopyWeldedPoints()
+{
+    _weld.points.resize(_weld.sources.size());
+    const GfVec3f* src = _points.cdata();
+    GfVec3f*       dst = _weld.points.data();
+    for (size_t i = 0; i < _weld.sources.size(); i++)
+        dst[i] = src[_weld.sources[i]];
+}
+
+const VtVec3fArray& HdTantoMesh::_WeldNormals(const VtVec3fArray& normals)
+{
+    if (normals.size() != _points.size())
+    {
+        _weld.normals = VtVec3fArray();
+        return _weld.normals;
+    }
+    _weld.normals.resize(_weld.sources.size());
+    const GfVec3f* src = normals.cdata();
+    GfVec3f*       dst = _weld.normals.data();
+    for (size_t i = 0; i < _weld.sources.size(); i++)
+        dst[i] = src[_weld.sources[i]];
+    return _weld.normals;
+}
+
+const VtVec3fArray& HdTantoMesh::_GetNormals(const HdTantoTriangulation& triangulation,
+                                             bool smooth, bool geometryDirty)
+{
+    static const VtVec3fArray none;
+    if (!smooth)
+        return none;
+    if (!_authoredNormals.empty() && _authoredNormals.size() == _points.size())
+        return _authoredNormals;
+    if (geometryDirty || _normals.size() != _points.size())
+        _GenerateNormals(triangulation);
+    return _normals;
+}
+
+// Face normals are found over ranges of triangles, then summed for ranges of
+// points. Both passes write disjoint ranges and need no synchronization.
+void HdTantoMesh::_GenerateNormals(const HdTantoTriangulation& triangulation)
+{
+    const size_t pointCount    = _points.size();
+    const size_t triangleCount = triangulation.indices.size();
+    if (triangulation.pointTriangles.empty() || triangulation.pointCount != pointCount)
+    {
+        _normals = VtVec3fArray();
+        return;
+    }
+    _faceNormals.resize(triangleCount);
+    _normals.resize(pointCount);
+
+    const uint32_t* indices   = (const uint32_t*)triangulation.indices.cdata();
+    const Vec3*     positions = (const Vec3*)_points.cdata();
+    Vec3*           faces     = (Vec3*)_faceNormals.data();
+    Vec3*           normals   = (Vec3*)_normals.data();
+    constexpr size_t grainSize = 4096;
+    WorkParallelForN(triangleCount, [&](size_t begin, size_t end) {
+        r_FaceNormals(indices, begin, end - begin, positions, faces);
+    }, grainSize);
+    WorkParallelForN(pointCount, [&](size_t begin, size_t end) {
+        r_VertexNormals(triangulation.pointTriangleOffsets.data(), triangulation.pointTriangles.data(),
+                faces, begin, end - begin, normals);
+    }, grainSize);
 }
 
 void HdTantoMesh::_PopulateTantoMesh(HdSceneDelegate *sceneDelegate,
@@ -104,6 +452,8 @@ void HdTantoMesh::_PopulateTantoMesh(HdSceneDelegate *sceneDelegate,
     bool topologyDirty  = false;
     bool pointsDirty    = false;
     bool transformDirty = false;
+    bool colorDirty     = false;
+    bool normalsDirty   = false;
 
     if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->points)) 
     {
@@ -113,10 +463,17 @@ void HdTantoMesh::_PopulateTantoMesh(HdSceneDelegate *sceneDelegate,
         pointsDirty = true;
     }
 
-    if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->displayColor))
+    if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->normals))
+    {
+        _PullNormals(sceneDelegate);
+        normalsDirty = true;
+    }
+
+    if (HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->displayColor) ||
+        HdChangeTracker::IsPrimvarDirty(*dirtyBits, id, HdTokens->displayOpacity))
     {
-        VtValue value = GetPrimvar(sceneDelegate, HdTokens->displayColor);
-        _color = value.Get<VtVec3fArray>();
+        _PullColors(sceneDelegate);
+        colorDirty = true;
     }
 
     if (HdChangeTracker::IsTopologyDirty(*dirtyBits, id)) 
@@ -137,24 +494,52 @@ void HdTantoMesh::_PopulateTantoMesh(HdSceneDelegate *sceneDelegate,
         _transform = GfMatrix4f(sceneDelegate->GetTransform(id));
         //std::cout << "Transform dirty!!" << '\n';
         transformDirty = true;
-        //_renderer.SetPrimTransform(_transform);
     }
 
-    if (pointsDirty && topologyDirty)
+    // flat shading takes the normals of the triangles in the shader
+    const bool smooth = !desc.flatShadingEnabled;
+    // colors that vary over the mesh are stored with its geometry
+    const bool colorsVary = _ColorsVary();
+    const bool colorGeometryDirty = colorDirty && (colorsVary || _colorsVary);
+
+    if (_hasPrim && !topologyDirty && !colorGeometryDirty)
+    {
+        // the prim already exists on the renderer: only write what changed.
+        if (pointsDirty || normalsDirty)
+        {
+            const VtVec3fArray& normals = _GetNormals(*_triangulation, smooth, pointsDirty);
+            if (_points.size() != _pointCount)
+                TF_WARN("Point count of %s changed without a topology change",
+                        id.GetText());
+            else if (_weld.sources.empty())
+                _renderer.UpdatePrimPoints(_primId, _points, normals, _triangulation.get());
+            else
+            {
+                _CopyWeldedPoints();
+                _renderer.UpdatePrimPoints(_primId, _weld.points, _WeldNormals(normals));
+            }
+        }
+        if (transformDirty)
+            _renderer.UpdatePrimTransform(_primId, _transform);
+        if (colorDirty)
+        {
+            _ResolveColors(*_triangulation);
+            _renderer.UpdatePrimColor(_primId, _colors.constant);
+        }
+        return;
+    }
+
+    const bool topologyBuild = topologyDirty && (pointsDirty || _hasPrim);
+    if (topologyBuild || _hasPrim)
     {
-        // must create a new prim
+        // must (re)build the prim geometry
         //const uint32_t pointCount = _points.size();
         //std::cout << "Points size: " << pointCount << '\n';
         //std::cout << "Points\n" << _points << '\n';
-        HdMeshUtil meshUtil(&_topology, GetId());
-        meshUtil.ComputeTriangleIndices(&_triangulatedIndices, &_trianglePrimitiveParams);
-        VtValue triangulatedPosition;
-        //VtArray<GfVec3f> faceNormals = Hd_FlatNormals::ComputeFlatNormals(&_topology, _points.data());
-        //bool success = meshUtil.ComputeTriangulatedFaceVaryingPrimvar(faceNormals.data(), _points.size(), HdTypeFloatVec3, &triangulatedPosition);
-        //assert(success);
-        //std::cout << "Triangulated Normals : \n" << triangulatedPosition << '\n';
-        //std::cout << "Trangulated Indices, size: " << _triangulatedIndices.size() << "\n" << _triangulatedIndices << "\n";
-        //std::cout << "Trangulated Primitive Params, size: " << _trianglePrimitiveParams.size() << "\n" << _trianglePrimitiveParams << "\n";
+        HdTantoTriangulationSharedPtr triangulation = topologyBuild ?
+            _renderer.GetTopologyCache().Acquire(_topology, id) : _triangulation;
+        //std::cout << "Trangulated Indices, size: " << triangulation->indices.size() << "\n" << triangulation->indices << "\n";
+        //std::cout << "Trangulated Primitive Params, size: " << triangulation->primitiveParams.size() << "\n" << triangulation->primitiveParams << "\n";
         //Tanto_R_Primitive prim = tanto_r_CreatePrimitive(pointCount, _triangulatedIndices.size() * 3, 2);
         //printf("3\n");
         //memcpy(prim.vertexRegion.hostData, _points.data(), prim.vertexCount * sizeof(Tanto_R_Attribute));
@@ -166,12 +551,41 @@ void HdTantoMesh::_PopulateTantoMesh(HdSceneDelegate *sceneDelegate,
         //    *nIter++ = (Vec3){{0.5, 0.5, 0.5}};
         //}
         //printf("5\n");
-        //VtValue normals = GetNormals(sceneDelegate);
-        //std::cout << "Normals size: " << normals.GetArraySize() << '\n';
-        //printf("Normals!\n");
-        //std::cout << GetNormals(sceneDelegate) << '\n';
-        PrimData data(_points, _triangulatedIndices, _transform, &_color[0]);
-        _renderer.AddPrim(data);
+        _ResolveColors(*triangulation);
+        const VtVec3fArray& normals = _GetNormals(*triangulation, smooth, true);
+        // welded points have indices of their own, which levels of detail
+        // and meshlets are not built for
+        const bool welded = !_weld.sources.empty();
+        PrimData data = welded ?
+            PrimData(_weld.points, _weld.indexSet, _transform, &_colors, nullptr, &_WeldNormals(normals),
+                    &_weld.indices) :
+            PrimData(_points, triangulation->indexSet, _transform, &_colors, triangulation.get(), &normals);
+        if (_hasPrim)
+        {
+            _renderer.UpdatePrimGeometry(_primId, data);
+            _renderer.UpdatePrimTransform(_primId, _transform);
+            _renderer.UpdatePrimColor(_primId, _colors.constant);
+        }
+        else
+        {
+            _primId  = _renderer.AddPrim(data);
+            _hasPrim = true;
+            // picking maps primId aov values back through the render index
+            _renderer.SetPrimPickId(_primId, GetPrimId());
+        }
+        // the prim holds its own reference to the index set
+        if (welded)
+        {
+            _renderer.ReleaseIndexSet(_weld.indexSet);
+            _weld.indexSet = R_INDEX_SET_NONE;
+        }
+        if (topologyBuild)
+        {
+            _renderer.GetTopologyCache().Release(_triangulation);
+            _triangulation = triangulation;
+        }
+        _pointCount = _points.size();
+        _colorsVary = colorsVary;
     }
 }
 
@@ -100,6 +100,11 @@ public:
         HdDirtyBits*     dirtyBits,
         TfToken const    &reprToken) override;
 
+    /// Release the renderer prim backing this mesh. Called by the render
+    /// index before the mesh is destroyed.
+    ///   \param renderParam State.
+    void Finalize(HdRenderParam *renderParam) override;
+
 protected:
     // Initialize the given representation of this Rprim.
     // This is called prior to syncing the prim, the first time the repr
@@ -137,11 +142,93 @@ private:
 
     VtVec3fArray   _points;
     HdMeshTopology _topology;
-    VtVec3iArray   _triangulatedIndices;
-    VtIntArray     _trianglePrimitiveParams;
+    // Shared with every mesh of the same topology.
+    HdTantoTriangulationSharedPtr _triangulation;
     GfMatrix4f     _transform;
-    VtVec3fArray   _color;
 
+    // displayColor and displayOpacity as authored, constant if the mesh has
+    // none.
+    VtVec3fArray    _color;
+    HdInterpolation _colorInterpolation;
+    VtFloatArray    _opacity;
+    HdInterpolation _opacityInterpolation;
+    // What the renderer prim was built with, and whether any of it varies
+    // over the mesh.
+    PrimColors      _colors;
+    bool            _colorsVary;
+
+    // Colors per face corner are drawn from welded copies of the points, one
+    // per distinct pair of point and color, with indices of their own.
+    // Empty unless the mesh has such colors. The index set is only held
+    // until the renderer prim is built with it.
+    struct _Weld {
+        std::vector<uint32_t> sources; // the point each copy was made from
+        VtVec3fArray          points;
+        VtVec3fArray          normals;
+        VtVec3iArray          indices;
+        Tanto_IndexSetId      indexSet = R_INDEX_SET_NONE;
+    };
+    _Weld           _weld;
+
+    // Authored normals, kept only if there is one per point.
+    VtVec3fArray   _authoredNormals;
+    // Generated normals and the face normals they are summed from, kept
+    // between updates of the points.
+    VtVec3fArray          _normals;
+    std::vector<GfVec3f>  _faceNormals;
+
+    // Handle of this mesh on the renderer, valid once _hasPrim is set.
+    Tanto_PrimId   _primId;
+    bool           _hasPrim;
+    // Point count the renderer prim was built with.
+    size_t         _pointCount;
+
+    // Upload the instances of this mesh, when it is a prototype of an
+    // instancer.
+    void _PopulateInstances(HdSceneDelegate *sceneDelegate);
+
+    // Pull the normals primvar, keeping it if there is one per point.
+    void _PullNormals(HdSceneDelegate *sceneDelegate);
+
+    // Pull a primvar along with its interpolation.
+    //   \return false if the mesh has no primvar of that name.
+    bool _PullPrimvar(HdSceneDelegate *sceneDelegate, TfToken const &name,
+                      VtValue *value, HdInterpolation *interpolation);
+
+    // Pull displayColor and displayOpacity.
+    void _PullColors(HdSceneDelegate *sceneDelegate);
+
+    // True if displayColor or displayOpacity is authored per face, point or
+    // face corner.
+    bool _ColorsVary() const;
+
+    // The interpolation values of the named primvar can be read with,
+    // constant if there are not as many as it needs.
+    HdInterpolation _CheckInterpolation(TfToken const &name,
+                                        HdInterpolation interpolation,
+                                        size_t size) const;
+
+    // Resolve the authored colors into _colors, welding the points if they
+    // vary per face corner.
+    void _ResolveColors(const HdTantoTriangulation& triangulation);
+
+    // Weld the points by their corner colors, one per index of the
+    // triangulation, and upload the welded indices.
+    void _WeldCorners(const HdTantoTriangulation& triangulation,
+                      const std::vector<GfVec4f>& corners);
+
+    // Copy the points, and normals if there is one per point, to the welded
+    // points made from them.
+    void _CopyWeldedPoints();
+    const VtVec3fArray& _WeldNormals(const VtVec3fArray& normals);
+
+    // Normals to draw with, empty for flat shading. Generated normals are
+    // only computed again when geometryDirty is set.
+    const VtVec3fArray& _GetNormals(const HdTantoTriangulation& triangulation,
+                                    bool smooth, bool geometryDirty);
+
+    // Generate smooth normals from the points, in parallel.
+    void _GenerateNormals(const HdTantoTriangulation& triangulation);
 
     // Populate the embree geometry object based on scene data.
     void _PopulateTantoMesh(HdSceneDelegate *sceneDelegate,
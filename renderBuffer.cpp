@@ -9,13 +9,30 @@ HdTantoRenderBuffer::HdTantoRenderBuffer(SdfPath const& id)
     , _width(0)
     , _height(0)
     , _format(HdFormatInvalid)
-    , _buffer()
+    , _multiSampled(false)
+    , _buffers()
+    , _frame(0)
+    , _aov(R_AOV_COLOR)
+    , _firstReadFrame(0)
+    , _mappedFrame(0)
+    , _hostFrame()
+    , _isHostFrame(false)
     , _isMapped(false)
 {
 }
 
 HdTantoRenderBuffer::~HdTantoRenderBuffer()
 {
+    _StopReadback();
+}
+
+void
+HdTantoRenderBuffer::_StopReadback()
+{
+    if (_firstReadFrame)
+        r_SetAovReadback(_aov, NULL);
+    _firstReadFrame = 0;
+    _mappedFrame = 0;
 }
 
 /*virtual*/
@@ -31,9 +48,18 @@ HdTantoRenderBuffer::_Deallocate()
     _width = 0;
     _height = 0;
     _format = HdFormatInvalid;
+    _multiSampled = false;
     _isMapped = false;
-    if (_buffer.pChain)
-        tanto_v_FreeBufferRegion(&_buffer);
+    // waits for the copies in flight
+    _StopReadback();
+    for (int i = 0; i < R_READBACK_COUNT; i++)
+    {
+        if (_buffers[i].pChain)
+            tanto_v_FreeBufferRegion(&_buffers[i]);
+        _buffers[i] = Tanto_V_BufferRegion{};
+    }
+    std::vector<uint8_t>().swap(_hostFrame);
+    _isHostFrame = false;
 }
 
 /*static*/
@@ -41,17 +67,21 @@ static size_t _GetBufferSize(GfVec2i const &dims, HdFormat format)
 {
     return dims[0] * dims[1] * HdDataSizeOfFormat(format);
 }
+
+size_t
+HdTantoRenderBuffer::_GetSize() const
+{
+    return _GetBufferSize(GfVec2i(_width, _height), _format);
+}
 /*virtual*/
 bool
 HdTantoRenderBuffer::Allocate(GfVec3i const& dimensions,
                                HdFormat format,
                                bool multiSampled)
 {
-    if (_buffer.hostData)
+    if (_format != HdFormatInvalid)
         _Deallocate();
 
-    std::cout << "ALLOCATE CALLED!@!! " << '\n';
-
     if (dimensions[2] != 1) {
         TF_WARN("Render buffer allocated with dims <%d, %d, %d> and"
                 " format %s; depth must be 1!",
@@ -63,9 +93,7 @@ HdTantoRenderBuffer::Allocate(GfVec3i const& dimensions,
     _width = dimensions[0];
     _height = dimensions[1];
     _format = format;
-    const size_t bufferSize = _GetBufferSize(GfVec2i(_width, _height), format);
-    _buffer = tanto_v_RequestBufferRegion(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, TANTO_V_MEMORY_HOST_TRANSFER_TYPE);
-    std::cout << "Setting buffer size to: " << bufferSize << '\n';
+    _multiSampled = multiSampled;
 
     return true;
 }
@@ -75,17 +103,104 @@ HdTantoRenderBuffer::Allocate(GfVec3i const& dimensions,
 void
 HdTantoRenderBuffer::Resolve()
 {
-    // Resolve the image buffer: find the average value per pixel by
-    // dividing the summed value by the number of samples.
-    //
-    // not multiSampled yet
+    // the renderer resolves its multisampled attachments into the images
+    // that are read back, so only resolved values ever reach this buffer
 
     return;
 }
 
-Tanto_V_BufferRegion* HdTantoRenderBuffer::GetBufferRegion()
+/*virtual*/
+void*
+HdTantoRenderBuffer::Map()
+{
+    _isMapped = true;
+    if (_isHostFrame)
+        return _hostFrame.data();
+    if (_firstReadFrame)
+    {
+        // at most R_FRAME_COUNT frames are in flight, so one of the copies
+        // in the ring is complete unless they all predate the first Map
+        for (uint64_t frame = _frame; 
+             frame >= _firstReadFrame && frame + R_READBACK_COUNT > _frame; frame--)
+        {
+            if (r_IsFrameComplete(frame))
+            {
+                _mappedFrame = frame;
+                break;
+            }
+        }
+    }
+    else if (r_IsFrameHeld(_frame))
+    {
+        const Tanto_FrameImage image = r_GetFrameImage(_frame, _aov);
+        if (image.width == _width && image.height == _height &&
+            HdDataSizeOfFormat(_format) == image.texelSize)
+        {
+            for (int i = 0; i < R_READBACK_COUNT; i++)
+            {
+                if (!_buffers[i].pChain)
+                    _buffers[i] = tanto_v_RequestBufferRegion(_GetSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+                            TANTO_V_MEMORY_HOST_TRANSFER_TYPE);
+            }
+            r_ReadbackFrame(_frame, _aov, &_buffers[_frame % R_READBACK_COUNT]);
+            r_SetAovReadback(_aov, _buffers);
+            _firstReadFrame = _frame;
+            _mappedFrame = _frame;
+        }
+        else
+        {
+            TF_WARN("Frame of %ux%u does not fit render buffer of %ux%u %s",
+                    image.width, image.height, _width, _height,
+                    TfEnum::GetName(_format).c_str());
+        }
+    }
+    // zeros until a frame was read back
+    if (!_buffers[0].hostData)
+    {
+        _hostFrame.resize(_GetSize());
+        return _hostFrame.data();
+    }
+    return _buffers[_mappedFrame % R_READBACK_COUNT].hostData;
+}
+
+void
+HdTantoRenderBuffer::SetFrame(uint64_t frame, Tanto_Aov aov)
+{
+    // the copies follow the buffer to its new aov from the next Map
+    if (aov != _aov)
+        _StopReadback();
+    _frame = frame;
+    _aov = aov;
+    _isHostFrame = false;
+}
+
+void*
+HdTantoRenderBuffer::SetHostFrame(Tanto_Aov aov)
+{
+    _StopReadback();
+    _aov = aov;
+    _hostFrame.resize(_GetSize());
+    _isHostFrame = true;
+    return _hostFrame.data();
+}
+
+/*virtual*/
+bool
+HdTantoRenderBuffer::IsConverged() const
+{
+    if (_isHostFrame)
+        return true;
+    return r_IsFrameComplete(_frame);
+}
+
+/*virtual*/
+VtValue
+HdTantoRenderBuffer::GetResource(bool multiSampled) const
 {
-    return &_buffer;
+    if (_isHostFrame || !r_IsFrameHeld(_frame))
+        return VtValue();
+    r_WaitFrame(_frame);
+    return VtValue(HdTantoFrameResource{r_GetFrameImage(_frame, _aov), _frame});
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -31,13 +31,33 @@
 #include "pxr/base/gf/vec4f.h"
 #include "pxr/imaging/hgiVulkan/hgi.h"
 
+#include <vector>
+
 extern "C" 
 {
 #include <tanto/v_memory.h>
+#include "tantoren/render.h"
 }
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+/// The image a frame was rendered into, as returned by
+/// HdTantoRenderBuffer::GetResource. It belongs to the device of the
+/// renderer and holds the frame until R_FRAME_COUNT more frames have been
+/// rendered.
+struct HdTantoFrameResource
+{
+    Tanto_FrameImage image;
+    uint64_t frame;
+
+    bool operator==(const HdTantoFrameResource& other) const {
+        return frame == other.frame && image.image == other.image.image;
+    }
+    bool operator!=(const HdTantoFrameResource& other) const {
+        return !(*this == other);
+    }
+};
+
 class HdTantoRenderBuffer : public HdRenderBuffer
 {
 public:
@@ -72,18 +92,21 @@ public:
     ///   \return The format of the currently allocated buffer.
     virtual HdFormat GetFormat() const override { return _format; }
 
-    /// Accessor for the buffer multisample state.
-    ///   \return Whether the buffer is multisampled or not.
-    virtual bool IsMultiSampled() const override { return false; }
+    /// Accessor for the buffer multisample state. Samples are resolved on
+    /// the GPU, so the buffer itself only ever holds resolved values.
+    ///   \return Whether the buffer was allocated multisampled.
+    virtual bool IsMultiSampled() const override { return _multiSampled; }
 
     /// Map the buffer for reading/writing. The control flow should be Map(),
     /// before any I/O, followed by memory access, followed by Unmap() when
-    /// done.
+    /// done. Frames are not copied to the host until the buffer is first
+    /// mapped, which waits for the last frame to be read back. From then on
+    /// every frame is copied into a ring of R_READBACK_COUNT host buffers,
+    /// and Map returns the newest complete copy without waiting. It stays
+    /// intact until R_FRAME_COUNT more frames have been rendered. Frames
+    /// written by SetHostFrame are returned as they are.
     ///   \return The address of the buffer.
-    virtual void* Map() override {
-        _isMapped = true;
-        return _buffer.hostData;
-    }
+    virtual void* Map() override;
 
     /// Unmap the buffer.
     virtual void Unmap() override {
@@ -97,32 +120,67 @@ public:
     }
 
     /// Is the buffer converged?
-    ///   \return True if the buffer is converged (not currently being
-    ///           rendered to).
-    virtual bool IsConverged() const override {
-        return true;
-    }
+    ///   \return True if the last frame rendered into this buffer has
+    ///           landed.
+    virtual bool IsConverged() const override;
 
-    /// Resolve the sample buffer into final values.
+    /// Resolve the sample buffer into final values. Nothing is left to do:
+    /// frames are resolved on the GPU before they are read back.
     virtual void Resolve() override;
 
-    Tanto_V_BufferRegion* GetBufferRegion(void);
-
+    /// Record the frame that was last submitted to render into this buffer
+    /// and the aov of it the buffer is bound to.
+    void SetFrame(uint64_t frame, Tanto_Aov aov);
+
+    /// Host memory for a frame rendered on the CPU, in MODE_RAY and
+    /// MODE_SOFTWARE, to write the aov into directly. Map returns it until
+    /// the next SetFrame.
+    ///   \return Width times height texels of the format of the buffer.
+    void* SetHostFrame(Tanto_Aov aov);
+
+    /// The image of the last frame rendered into this buffer, for clients
+    /// on the GPU to sample in place. Waits for the frame to land. The
+    /// image is resolved whether or not multiSampled is asked for.
+    ///   \return An HdTantoFrameResource, or an empty value if no frame
+    ///           rendered into this buffer is still held or the frame was
+    ///           rendered on the CPU.
     virtual VtValue GetResource(bool multiSampled) const override;
 
 private:
     // Release any allocated resources.
     virtual void _Deallocate() override;
 
+    // Stop the copies of every frame into _buffers.
+    void _StopReadback();
+
+    // Size of the buffer in bytes.
+    size_t _GetSize() const;
+
     // Buffer width.
     unsigned int _width;
     // Buffer height.
     unsigned int _height;
     // Buffer format.
     HdFormat _format;
-
-    // The resolved output buffer.
-    Tanto_V_BufferRegion _buffer;
+    // Whether the buffer was allocated multisampled.
+    bool _multiSampled;
+
+    // Host copies of the frames, frame n in _buffers[n % R_READBACK_COUNT].
+    // Requested by the first Map of a GPU frame, so buffers that only ever
+    // get CPU frames do not touch the device.
+    Tanto_V_BufferRegion _buffers[R_READBACK_COUNT];
+    // The last frame submitted to render into this buffer.
+    uint64_t _frame;
+    // The aov of the frame this buffer is bound to.
+    Tanto_Aov _aov;
+    // The oldest frame with a copy in _buffers, 0 before the first Map.
+    uint64_t _firstReadFrame;
+    // The frame whose copy Map returned last.
+    uint64_t _mappedFrame;
+    // The frame written on the CPU while _isHostFrame is set, otherwise
+    // zeros for Map to return before the first frame is read back.
+    std::vector<uint8_t> _hostFrame;
+    bool _isHostFrame;
 
     bool _isMapped;
 };
@@ -23,15 +23,19 @@
 //
 #include "renderDelegate.h"
 #include "mesh.h"
+#include "instancer.h"
 #include "renderPass.h"
 #include <pxr/imaging/hd/camera.h>
 #include <pxr/imaging/hd/renderBuffer.h>
+#include <pxr/base/tf/stringUtils.h>
 #include "renderBuffer.h"
 
 #include <iostream>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+TF_DEFINE_PUBLIC_TOKENS(HdTantoRenderSettingsTokens, HDTANTO_RENDER_SETTINGS_TOKENS);
+
 const TfTokenVector HdTantoDelegate::SUPPORTED_RPRIM_TYPES =
 {
     HdPrimTypeTokens->mesh,
@@ -49,6 +53,7 @@ const TfTokenVector HdTantoDelegate::SUPPORTED_BPRIM_TYPES =
 
 HdTantoDelegate::HdTantoDelegate()
     : HdRenderDelegate()
+    , _renderer(_GetRenderMode())
 {
     _Initialize();
 }
@@ -56,6 +61,7 @@ HdTantoDelegate::HdTantoDelegate()
 HdTantoDelegate::HdTantoDelegate(
     HdRenderSettingsMap const& settingsMap)
     : HdRenderDelegate(settingsMap)
+    , _renderer(_GetRenderMode())
 {
     _Initialize();
 }
@@ -65,6 +71,46 @@ HdTantoDelegate::_Initialize()
 {
     std::cout << "Creating Tanto RenderDelegate" << std::endl;
     _resourceRegistry = std::make_shared<HdResourceRegistry>();
+
+    TfToken mode = HdTantoRenderSettingsTokens->raster;
+    if (_renderer.GetMode() == MODE_SOFTWARE)
+        mode = HdTantoRenderSettingsTokens->software;
+    else if (_renderer.GetMode() == MODE_RAY)
+        mode = HdTantoRenderSettingsTokens->ray;
+    _settingDescriptors = {
+        { "Render Mode", HdTantoRenderSettingsTokens->renderMode, VtValue(mode) },
+    };
+}
+
+// Runs before the renderer is created, so the settings map is all there is
+// to read.
+ModeID
+HdTantoDelegate::_GetRenderMode() const
+{
+    const VtValue value = GetRenderSetting(HdTantoRenderSettingsTokens->renderMode);
+    TfToken mode;
+    if (value.IsHolding<TfToken>())
+        mode = value.UncheckedGet<TfToken>();
+    else if (value.IsHolding<std::string>())
+        mode = TfToken(value.UncheckedGet<std::string>());
+
+    if (mode == HdTantoRenderSettingsTokens->raster)
+        return MODE_RASTER;
+    if (mode == HdTantoRenderSettingsTokens->software)
+        return MODE_SOFTWARE;
+    if (mode == HdTantoRenderSettingsTokens->ray)
+        return MODE_RAY;
+    if (!value.IsEmpty())
+        TF_WARN("Unknown %s %s, using the default",
+                HdTantoRenderSettingsTokens->renderMode.GetText(),
+                TfStringify(value).c_str());
+    return HdTantoRenderer::GetDefaultMode();
+}
+
+HdRenderSettingDescriptorList
+HdTantoDelegate::GetRenderSettingDescriptors() const
+{
+    return _settingDescriptors;
 }
 
 HdTantoDelegate::~HdTantoDelegate()
@@ -100,7 +146,8 @@ HdTantoDelegate::GetResourceRegistry() const
 void 
 HdTantoDelegate::CommitResources(HdChangeTracker *tracker)
 {
-    std::cout << "=> CommitResources RenderDelegate" << std::endl;
+    // all rprims are synced by now, so their uploads go out as one batch
+    _renderer.CommitResources();
 }
 
 HdRenderPassSharedPtr 
@@ -202,15 +249,13 @@ HdTantoDelegate::CreateInstancer(
     SdfPath const& id,
     SdfPath const& instancerId)
 {
-    TF_CODING_ERROR("Creating Instancer not supported id=%s instancerId=%s", 
-        id.GetText(), instancerId.GetText());
-    return nullptr;
+    return new HdTantoInstancer(delegate, id, instancerId);
 }
 
 void 
 HdTantoDelegate::DestroyInstancer(HdInstancer *instancer)
 {
-    TF_CODING_ERROR("Destroy instancer not supported");
+    delete instancer;
 }
 
 HdRenderParam *
@@ -226,16 +271,21 @@ HdTantoDelegate::GetDefaultAovDescriptor(TfToken const& name) const
         return HdAovDescriptor(HdFormatUNorm8Vec4, true,
                                VtValue(GfVec4f(0.0f)));
     } 
-    //else if (name == HdAovTokens->normal || name == HdAovTokens->Neye) {
-    //    return HdAovDescriptor(HdFormatFloat32Vec3, false,
-    //                           VtValue(GfVec3f(-1.0f)));
+    // the aovs below are written by the same pass as color, each only while
+    // it is bound
+    else if (name == HdAovTokens->normal) {
+        return HdAovDescriptor(HdFormatFloat16Vec4, false,
+                               VtValue(GfVec4f(0.0f)));
+    }
     else if (name == HdAovTokens->depth) {
         return HdAovDescriptor(HdFormatFloat32, false, VtValue(1.0f));
     } 
+    else if (name == HdAovTokens->primId) {
+        return HdAovDescriptor(HdFormatInt32, false, VtValue(-1));
+    }
     //else if (name == HdAovTokens->cameraDepth) {
     //    return HdAovDescriptor(HdFormatFloat32, false, VtValue(0.0f));
-    //} else if (name == HdAovTokens->primId ||
-    //           name == HdAovTokens->instanceId ||
+    //} else if (name == HdAovTokens->instanceId ||
     //           name == HdAovTokens->elementId) {
     //    return HdAovDescriptor(HdFormatInt32, false, VtValue(-1));
     //} else {
@@ -33,6 +33,18 @@
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+/// Render settings of the delegate. renderMode is raster, software or ray,
+/// for MODE_RASTER, MODE_SOFTWARE and MODE_RAY. It is read when the
+/// delegate is created; without it HdTantoRenderer::GetDefaultMode is
+/// used.
+#define HDTANTO_RENDER_SETTINGS_TOKENS \
+    ((renderMode, "tanto:renderMode")) \
+    (raster)                           \
+    (software)                         \
+    (ray)
+
+TF_DECLARE_PUBLIC_TOKENS(HdTantoRenderSettingsTokens, HDTANTO_RENDER_SETTINGS_TOKENS);
+
 ///
 /// \class HdTantoDelegate
 ///
@@ -99,6 +111,11 @@ public:
     virtual HdAovDescriptor
         GetDefaultAovDescriptor(TfToken const& name) const override;
 
+    /// The render mode, with the mode the delegate was created with as its
+    /// default.
+    HdRenderSettingDescriptorList
+        GetRenderSettingDescriptors() const override;
+
 private:
     static const TfTokenVector SUPPORTED_RPRIM_TYPES;
     static const TfTokenVector SUPPORTED_SPRIM_TYPES;
@@ -106,8 +123,12 @@ private:
 
     HdResourceRegistrySharedPtr _resourceRegistry;
     HdTantoRenderer _renderer;
+    HdRenderSettingDescriptorList _settingDescriptors;
 
     void _Initialize();
+    // The mode asked for by the render settings the delegate was created
+    // with.
+    ModeID _GetRenderMode() const;
 
     // This class does not support copying.
     HdTantoDelegate(const HdTantoDelegate &) = delete;
@@ -58,39 +58,88 @@ HdTantoPass::~HdTantoPass()
 
 static bool initialized = false;
 
+// The renderer aov an aov binding is written from, if there is one.
+static bool
+_GetRendererAov(TfToken const& name, Tanto_Aov* aov)
+{
+    if (name == HdAovTokens->color)
+        *aov = R_AOV_COLOR;
+    else if (name == HdAovTokens->depth)
+        *aov = R_AOV_DEPTH;
+    else if (name == HdAovTokens->primId)
+        *aov = R_AOV_PRIM_ID;
+    else if (name == HdAovTokens->normal)
+        *aov = R_AOV_NORMAL;
+    else
+        return false;
+    return true;
+}
+
+// Points an aov of a frame rendered on the CPU at the host memory of a render
+// buffer, if the buffer has the size of the frame and the format the aov is
+// written in.
+static void
+_SetCpuTarget(HdTantoRenderBuffer* rb, Tanto_Aov aov, R_RtTarget* target)
+{
+    static const HdFormat formats[R_AOV_COUNT] = {
+        HdFormatUNorm8Vec4, HdFormatFloat32, HdFormatInt32, HdFormatFloat16Vec4
+    };
+    if (rb->GetWidth() != target->width || rb->GetHeight() != target->height ||
+        rb->GetFormat() != formats[aov])
+    {
+        TF_WARN("Render buffer of %ux%u %s does not fit the frame rendered on the CPU",
+                rb->GetWidth(), rb->GetHeight(), TfEnum::GetName(rb->GetFormat()).c_str());
+        return;
+    }
+    void* data = rb->SetHostFrame(aov);
+    switch (aov)
+    {
+        case R_AOV_COLOR:   target->color  = (uint32_t*)data; break;
+        case R_AOV_DEPTH:   target->depth  = (float*)data;    break;
+        case R_AOV_PRIM_ID: target->primId = (int32_t*)data;  break;
+        case R_AOV_NORMAL:  target->normal = (uint16_t*)data; break;
+        default: break;
+    }
+}
+
 void
 HdTantoPass::_Execute(
     HdRenderPassStateSharedPtr const& renderPassState,
     TfTokenVector const &renderTags)
 {
     tanto_TimerStart(&timer);
-    std::cout << "=> Execute RenderPass" << std::endl;
 
     GfVec4f vp = renderPassState->GetViewport();
-    std::cout << "Viewport: " << vp << '\n';
 
     HdRenderPassAovBindingVector bindings =
         renderPassState->GetAovBindings();
 
+    // only the bound aovs get images, and only before the frame is set up
+    // for them
+    uint32_t aovMask = 0;
+    for (HdRenderPassAovBinding const& binding : bindings) {
+        Tanto_Aov aov;
+        if (_GetRendererAov(binding.aovName, &aov))
+            aovMask |= R_AOV_BIT(aov);
+    }
+    _renderer.SetAovs(aovMask);
+
     if (_width != vp[2] || _height != vp[3]) {
         _width = vp[2];
         _height = vp[3];
 
-        printf("Viewport size changed.\n");
-
-        HdTantoRenderBuffer* cb = static_cast<HdTantoRenderBuffer*>(bindings[0].renderBuffer);
         if (!initialized)
         {
             _renderer.Initialize(_width, _height);
 
-            _renderer.UpdateRender(cb);
+            _renderer.UpdateRender();
 
             initialized = true;
         }
 
         else
         {
-            _renderer.UpdateViewport(_width, _height, cb);
+            _renderer.UpdateViewport(_width, _height);
         }
     }
 
@@ -102,17 +151,38 @@ HdTantoPass::_Execute(
     //
     // If the renderer AOV bindings are empty, force a bindings update so that
     // we always get a chance to add color/depth on the first time through.
-    std::cout << "Bindings size: " << bindings.size() << '\n';
 
     const GfMatrix4f view = (GfMatrix4f)renderPassState->GetWorldToViewMatrix();
     const GfMatrix4f proj = (GfMatrix4f)renderPassState->GetProjectionMatrix();
 
     _renderer.SetCamera(view, proj);
 
-    HdTantoRenderBuffer* rb = static_cast<HdTantoRenderBuffer*>(bindings[0].renderBuffer);
-    rb->Map();
-    _renderer.Render(NULL);
-    rb->Unmap();
+    // frames rendered on the CPU are written straight into the render buffers
+    if (_renderer.GetMode() != MODE_RASTER) {
+        R_RtTarget target = {};
+        target.width  = _width;
+        target.height = _height;
+        for (HdRenderPassAovBinding const& binding : bindings) {
+            Tanto_Aov aov;
+            HdTantoRenderBuffer* rb = static_cast<HdTantoRenderBuffer*>(binding.renderBuffer);
+            if (rb && _GetRendererAov(binding.aovName, &aov))
+                _SetCpuTarget(rb, aov, &target);
+        }
+        _renderer.RenderOnCpu(target);
+        tanto_TimerStop(&timer);
+        tanto_PrintTime(&timer);
+        return;
+    }
+
+    // the GPU works on this frame while we return to the application; the
+    // render buffer waits for it when it is mapped or its image is asked for.
+    const uint64_t frame = _renderer.Render(NULL);
+    for (HdRenderPassAovBinding const& binding : bindings) {
+        Tanto_Aov aov;
+        HdTantoRenderBuffer* rb = static_cast<HdTantoRenderBuffer*>(binding.renderBuffer);
+        if (rb && _GetRendererAov(binding.aovName, &aov))
+            rb->SetFrame(frame, aov);
+    }
     tanto_TimerStop(&timer);
     tanto_PrintTime(&timer);
     //    //_renderThread->StopRender();
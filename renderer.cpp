@@ -1,12 +1,17 @@
 #include "renderer.h"
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <pxr/base/gf/matrix4f.h>
+#include <pxr/base/arch/hash.h>
+#include <pxr/base/tf/envSetting.h>
 
 extern "C" 
 {
 #include "tantoren/render.h"
 #include "tantoren/common.h"
+#include "tantoren/simplify.h"
 #include <tanto/v_video.h>
 #include <tanto/d_display.h>
 #include <tanto/r_render.h>
@@ -16,41 +21,112 @@ extern "C"
 
 PXR_NAMESPACE_OPEN_SCOPE
 
-HdTantoRenderer::HdTantoRenderer()
+TF_DEFINE_ENV_SETTING(HDTANTO_COMPACT_VERTICES, false,
+        "Store positions and colors quantized and indices in 16 bits where they fit.");
+TF_DEFINE_ENV_SETTING(HDTANTO_OCCLUSION_CULLING, false,
+        "Cull prims hidden behind others on the GPU against a depth pyramid.");
+TF_DEFINE_ENV_SETTING(HDTANTO_MSAA_SAMPLES, 1,
+        "Samples per pixel, 2, 4 or 8 for multisampling. Resolved on the GPU.");
+TF_DEFINE_ENV_SETTING(HDTANTO_RAY_TRACE, false,
+        "Ray trace frames on the CPU instead of rasterizing them on the GPU.");
+TF_DEFINE_ENV_SETTING(HDTANTO_SOFTWARE_RASTER, false,
+        "Rasterize frames on the CPU even when there is a Vulkan device.");
+TF_DEFINE_ENV_SETTING(HDTANTO_RAY_AO_SAMPLES, 8,
+        "Ambient occlusion rays per pixel when ray tracing, 0 for none.");
+TF_DEFINE_ENV_SETTING(HDTANTO_RAY_AO_DISTANCE, "0",
+        "Length of the ambient occlusion rays, 0 for a tenth of the size of the scene.");
+
+ModeID HdTantoRenderer::GetDefaultMode()
+{
+    if (TfGetEnvSetting(HDTANTO_RAY_TRACE))
+        return MODE_RAY;
+    if (TfGetEnvSetting(HDTANTO_SOFTWARE_RASTER))
+        return MODE_SOFTWARE;
+    return MODE_RASTER;
+}
+
+// tanto_v_Init does not return without a device, so look for one first
+static ModeID _FindMode(ModeID mode)
 {
-    tanto_v_config.rayTraceEnabled = true;
+    if (mode == MODE_RASTER && !r_HasVulkanDevice())
+    {
+        TF_WARN("No Vulkan device found, rasterizing on the CPU instead");
+        return MODE_SOFTWARE;
+    }
+    return mode;
+}
+
+HdTantoRenderer::HdTantoRenderer(ModeID mode)
+    : _mode(_FindMode(mode))
+    , _cpuRenderer(_mode)
+    , _topologyCache(*this)
+{
+    if (_mode != MODE_RASTER)
+    {
+        const int samples = std::max(TfGetEnvSetting(HDTANTO_RAY_AO_SAMPLES), 0);
+        _cpuRenderer.SetAmbientOcclusion(samples, std::atof(TfGetEnvSetting(HDTANTO_RAY_AO_DISTANCE).c_str()));
+        return;
+    }
+    // nothing is drawn with ray tracing extensions, and devices without
+    // them, such as lavapipe, could not be used if they were asked for
+    tanto_v_config.rayTraceEnabled = false;
 #ifndef NDEBUG
     tanto_v_config.validationEnabled = true;
 #else
     tanto_v_config.validationEnabled = false;
 #endif
     tanto_v_Init();
+    r_SetCompactVertices(TfGetEnvSetting(HDTANTO_COMPACT_VERTICES));
     r_InitScene();
+    r_SetOcclusionCulling(TfGetEnvSetting(HDTANTO_OCCLUSION_CULLING));
+    const int samples = TfGetEnvSetting(HDTANTO_MSAA_SAMPLES);
+    if (samples > 1 && (int)r_SetSampleCount(samples) != samples)
+        TF_WARN("HDTANTO_MSAA_SAMPLES=%d is not supported, using fewer samples", samples);
 }
 
 HdTantoRenderer::~HdTantoRenderer()
 {
+    if (_mode == MODE_RASTER)
+        r_CleanUp();
 }
 
 void HdTantoRenderer::Initialize(unsigned int width, unsigned int height)
 {
+    if (_mode != MODE_RASTER)
+        return;
     r_SetViewport(width, height);
     r_InitRenderer();
 }
 
-void HdTantoRenderer::UpdateViewport(unsigned int width, unsigned int height,
-        HdTantoRenderBuffer* colorBuffer)
+void HdTantoRenderer::UpdateViewport(unsigned int width, unsigned int height)
 {
-    r_UpdateViewport(width, height, colorBuffer->GetBufferRegion());
+    if (_mode != MODE_RASTER)
+        return;
+    r_UpdateViewport(width, height);
 }
 
-void HdTantoRenderer::UpdateRender(HdTantoRenderBuffer* colorBuffer)
+void HdTantoRenderer::UpdateRender()
 {
-    r_UpdateRenderCommands(colorBuffer->GetBufferRegion());
+    if (_mode != MODE_RASTER)
+        return;
+    r_UpdateRenderCommands();
+}
+
+void HdTantoRenderer::SetAovs(uint32_t aovMask)
+{
+    if (_mode != MODE_RASTER)
+        return;
+    r_SetAovs(aovMask);
 }
 
 void HdTantoRenderer::SetCamera(const GfMatrix4f& viewMatrix, const GfMatrix4f& projMatrix)
 {
+    if (_mode != MODE_RASTER)
+    {
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+        _cpuRenderer.SetCamera(viewMatrix, projMatrix);
+        return;
+    }
     //GfMatrix4f viewT = viewMatrix.GetTranspose();
     //GfMatrix4f projT = viewMatrix.GetTranspose();
     Mat4* view = (Mat4*)(viewMatrix.data());
@@ -74,57 +150,465 @@ void HdTantoRenderer::SetCamera(const GfMatrix4f& viewMatrix, const GfMatrix4f&
     r_UpdateCamera(camera);
 }
 
-//void HdTantoRenderer::SetPrimTransform(const GfMatrix4f& xform)
-//{
-//    Mat4* m = (Mat4*)(xform.data());
-//    r_UpdatePrimTransform(*m);
-//}
-//
-//void HdTantoRenderer::UpdatePrim(Tanto_R_Primitive prim)
-//{
-//    printf("6\n");
-//    r_UpdatePrimitive(prim);
-//}
+static Tanto_R_Material _MakeMaterial(const GfVec4f& color)
+{
+    Tanto_R_Material mat;
+    for (int i = 0; i < 4; i++)
+        mat.color.x[i] = color[i];
+    return mat;
+}
+
+static Tanto_R_Material _MakeMaterial(const PrimData& data)
+{
+    return _MakeMaterial(data.colors ? data.colors->constant : PrimColors().constant);
+}
+
+static const VtVec4fArray& _GetPointColors(const PrimData& data)
+{
+    static const VtVec4fArray none;
+    return data.colors && data.colors->points.size() == data.points.size() ? data.colors->points : none;
+}
+
+static const VtVec4fArray& _GetTriangleColors(const PrimData& data)
+{
+    static const VtVec4fArray none;
+    return data.colors ? data.colors->triangles : none;
+}
+
+static const VtVec3fArray& _GetNormals(const PrimData& data)
+{
+    static const VtVec3fArray none;
+    return data.normals && data.normals->size() == data.points.size() ? *data.normals : none;
+}
+
+static Tanto_PrimGeometry _GetGeometry(const PrimData& data)
+{
+    Tanto_PrimGeometry geo = {};
+    geo.vertexCount = data.points.size();
+    geo.positions   = (const Vec3*)data.points.cdata();
+    geo.indexSet    = data.indexSet;
+    const VtVec3fArray& normals = _GetNormals(data);
+    geo.normals     = normals.empty() ? nullptr : (const Vec3*)normals.cdata();
+    const VtVec4fArray& colors = _GetPointColors(data);
+    geo.colors      = colors.empty() ? nullptr : (const Vec4*)colors.cdata();
+    return geo;
+}
+
+// Identical meshes share one index set (see HdTantoTopologyCache), so the
+// points and the set identify the geometry. Generated normals follow from
+// both; authored ones and point and triangle colors are only compared.
+static uint64_t _HashGeometry(const PrimData& data)
+{
+    return ArchHash64((const char*)data.points.cdata(), 
+            data.points.size() * sizeof(GfVec3f), data.indexSet);
+}
+
+// VtArray compares by identity first, so this is cheap for meshes that were
+// pulled from the same scene data
+bool HdTantoRenderer::_IsSameGeometry(const _SharedGeometry& shared, const PrimData& data)
+{
+    return shared.indexSet == data.indexSet && shared.points == data.points && 
+        shared.normals == _GetNormals(data) && shared.pointColors == _GetPointColors(data) &&
+        shared.triangleColors == _GetTriangleColors(data);
+}
+
+const HdTantoRenderer::_SharedGeometry*
+HdTantoRenderer::_FindGeometry(uint64_t key, const PrimData& data) const
+{
+    auto it = _geometries.find(key);
+    if (it == _geometries.end())
+        return nullptr;
+    return _IsSameGeometry(it->second, data) ? &it->second : nullptr;
+}
 
+void HdTantoRenderer::_RegisterGeometry(Tanto_PrimId primId, uint64_t key, const PrimData& data)
+{
+    _primGeometries[primId] = {key, data.indexSet};
+    auto it = _geometries.find(key);
+    if (it == _geometries.end())
+    {
+        _geometries.emplace(key, _SharedGeometry{data.points, _GetNormals(data), _GetPointColors(data),
+                _GetTriangleColors(data), data.indexSet, {primId}});
+        return;
+    }
+    // prims are only listed under the content they were built from. on a
+    // hash collision the later one is simply not shared.
+    if (_IsSameGeometry(it->second, data))
+        it->second.prims.push_back(primId);
+    else
+        _primGeometries[primId].key = _unshared;
+}
+
+void HdTantoRenderer::_UnregisterGeometry(Tanto_PrimId primId)
+{
+    auto prim = _primGeometries.find(primId);
+    if (prim == _primGeometries.end())
+        return;
+    auto it = _geometries.find(prim->second.key);
+    if (prim->second.key != _unshared && it != _geometries.end())
+    {
+        std::vector<Tanto_PrimId>& prims = it->second.prims;
+        prims.erase(std::find(prims.begin(), prims.end(), primId));
+        if (prims.empty())
+            _geometries.erase(it);
+    }
+    _primGeometries.erase(prim);
+}
+
+void HdTantoRenderer::_SetLods(Tanto_PrimId primId, const _Lods& lods)
+{
+    r_SetPrimLods(primId, lods.indexSets, lods.errors, lods.count);
+    // the prim holds its own references now
+    for (uint32_t i = 0; i < lods.count; i++)
+        r_ReleaseIndexSet(lods.indexSets[i]);
+}
+
+// Meshlets are only built for large meshes and only describe points that
+// cover every index of the triangulation. Prims with triangle colors are
+// drawn whole and have no use for them.
+Tanto_MeshletUpload HdTantoRenderer::_ReserveMeshlets(Tanto_PrimId primId, const PrimData& data)
+{
+    const HdTantoTriangulation* triangulation = data.triangulation;
+    if (!triangulation || triangulation->meshlets.empty() || data.points.size() < triangulation->pointCount ||
+        !_GetTriangleColors(data).empty())
+        return Tanto_MeshletUpload{};
+    return r_ReservePrimMeshlets(primId, triangulation->meshlets.size() - 1);
+}
+
+Tanto_FaceColorUpload HdTantoRenderer::_ReserveFaceColors(Tanto_PrimId primId, const PrimData& data)
+{
+    const VtVec4fArray& colors = _GetTriangleColors(data);
+    if (colors.empty())
+        return Tanto_FaceColorUpload{};
+    return r_ReservePrimFaceColors(primId, colors.size());
+}
+
+static void _WriteFaceColors(Tanto_FaceColorUpload* upload, const PrimData& data)
+{
+    if (!upload->count)
+        return;
+    r_WritePrimFaceColors(upload, (const Vec4*)_GetTriangleColors(data).cdata());
+}
+
+static void _WriteMeshlets(Tanto_MeshletUpload* upload, const PrimData& data)
+{
+    if (!upload->count)
+        return;
+    r_WritePrimMeshlets(upload, (const Tanto_R_Index*)data.triangulation->indices.cdata(), 
+            data.triangulation->meshlets.data(), (const Vec3*)data.points.cdata());
+}
+
+// Simplifying a large mesh takes a while, so it runs in the Sync thread of the
+// mesh like the rest of its upload and only reserving the index sets locks.
+HdTantoRenderer::_Lods HdTantoRenderer::_BuildLods(const PrimData& data)
+{
+    _Lods lods;
+    const HdTantoTriangulation* triangulation = data.triangulation;
+    if (!triangulation || triangulation->indices.size() < _lodMinMeshTriangles || 
+        !_GetTriangleColors(data).empty())
+        return lods;
+
+    R_SimplifiedLevel levels[R_MAX_LODS];
+    lods.count = r_Simplify((const uint32_t*)triangulation->indices.cdata(), triangulation->indices.size() * 3,
+            (const Vec3*)data.points.cdata(), data.points.size(), _lodMinLevelTriangles, R_MAX_LODS, levels);
+    for (uint32_t i = 0; i < lods.count; i++)
+    {
+        lods.indexSets[i] = _AddIndexSet((const Tanto_R_Index*)levels[i].indices, levels[i].indexCount, 
+                data.points.size());
+        lods.errors[i]    = levels[i].error;
+    }
+    r_FreeSimplified(levels, lods.count);
+    return lods;
+}
+
+void HdTantoRenderer::_SetCpuPrimGeometry(Tanto_PrimId primId, const PrimData& data)
+{
+    static const VtVec3iArray none;
+    const VtVec3iArray& indices = data.indices ? *data.indices : 
+        data.triangulation ? data.triangulation->indices : none;
+    _cpuRenderer.SetPrimGeometry(primId, data.points, indices, _GetNormals(data), _GetPointColors(data),
+            _GetTriangleColors(data));
+}
+
+// Sync runs on many threads at once. Only reserving the prim and publishing
+// it take the lock; the geometry is copied into staging memory and its levels
+// of detail and meshlets are built in between. Meshes identical to one already added draw
+// its geometry and levels of detail instead.
 Tanto_PrimId HdTantoRenderer::AddPrim(PrimData data)
 {
+    if (_mode != MODE_RASTER)
+    {
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+        const Tanto_PrimId primId = _cpuRenderer.AddPrim();
+        _SetCpuPrimGeometry(primId, data);
+        _cpuRenderer.SetPrimTransform(primId, data.xform);
+        _cpuRenderer.SetPrimColor(primId, data.colors ? data.colors->constant : PrimColors().constant);
+        return primId;
+    }
+
+    const Tanto_PrimGeometry geo = _GetGeometry(data);
+    const uint64_t key = _HashGeometry(data);
+
+    Tanto_PrimUpload upload;
+    Tanto_MeshletUpload meshletUpload;
+    Tanto_FaceColorUpload faceColorUpload;
+    {
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+        if (const _SharedGeometry* shared = _FindGeometry(key, data))
+        {
+            const Tanto_PrimId primId = r_AddPrimInstance(shared->prims.front(), 
+                    _MakeMaterial(data), *(Mat4*)data.xform.data());
+            _RegisterGeometry(primId, key, data);
+            return primId;
+        }
+        upload = r_ReservePrim(geo.vertexCount, geo.indexSet);
+        meshletUpload = _ReserveMeshlets(upload.id, data);
+        faceColorUpload = _ReserveFaceColors(upload.id, data);
+    }
+
+    r_WritePrimGeometry(&upload, &geo);
+    _WriteMeshlets(&meshletUpload, data);
+    _WriteFaceColors(&faceColorUpload, data);
+    const _Lods lods = _BuildLods(data);
+
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    r_UpdatePrimMaterial(upload.id, _MakeMaterial(data));
+    r_UpdatePrimTransform(upload.id, *(Mat4*)data.xform.data());
+    r_PublishPrim(&upload);
+    if (meshletUpload.count)
+        r_PublishPrimMeshlets(&meshletUpload);
+    if (faceColorUpload.count)
+        r_PublishPrimFaceColors(&faceColorUpload);
+    _SetLods(upload.id, lods);
+    _RegisterGeometry(upload.id, key, data);
+    return upload.id;
+}
+
+void HdTantoRenderer::UpdatePrimGeometry(Tanto_PrimId primId, PrimData data)
+{
+    if (_mode != MODE_RASTER)
+    {
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+        _SetCpuPrimGeometry(primId, data);
+        return;
+    }
+
+    const Tanto_PrimGeometry geo = _GetGeometry(data);
+    const uint64_t key = _HashGeometry(data);
+
+    Tanto_PrimUpload upload;
+    Tanto_MeshletUpload meshletUpload;
+    Tanto_FaceColorUpload faceColorUpload;
+    {
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+        _UnregisterGeometry(primId);
+        if (const _SharedGeometry* shared = _FindGeometry(key, data))
+        {
+            r_SharePrimGeometry(primId, shared->prims.front());
+            _RegisterGeometry(primId, key, data);
+            return;
+        }
+        upload = r_ReservePrimGeometry(primId, geo.vertexCount, geo.indexSet);
+        meshletUpload = _ReserveMeshlets(primId, data);
+        faceColorUpload = _ReserveFaceColors(primId, data);
+    }
+
+    r_WritePrimGeometry(&upload, &geo);
+    _WriteMeshlets(&meshletUpload, data);
+    _WriteFaceColors(&faceColorUpload, data);
+    const _Lods lods = _BuildLods(data);
+
     const std::lock_guard<std::mutex> lock(mutexAddPrim);
 
-    Tanto_R_Primitive prim = tanto_r_CreatePrimitive(data.points.size(), data.indices.size() * 3, 2);
-    //printf("3\n");
-    memcpy(prim.vertexRegion.hostData, data.points.data(), prim.vertexCount * sizeof(Tanto_R_Attribute));
-    //printf("4\n");
-    memcpy(prim.indexRegion.hostData,  data.indices.data(), prim.indexCount * sizeof(Tanto_R_Index));
-    Vec3* nIter = (Vec3*)(prim.vertexRegion.hostData + prim.attrOffsets[1]);
-    for (int i = 0; i < prim.vertexCount; i++) 
+    r_PublishPrim(&upload);
+    if (meshletUpload.count)
+        r_PublishPrimMeshlets(&meshletUpload);
+    if (faceColorUpload.count)
+        r_PublishPrimFaceColors(&faceColorUpload);
+    _SetLods(primId, lods);
+    _RegisterGeometry(primId, key, data);
+}
+
+Tanto_IndexSetId HdTantoRenderer::AddIndexSet(const VtVec3iArray& indices, uint32_t vertexCount)
+{
+    // the CPU modes take their indices from the prims
+    if (_mode != MODE_RASTER)
+        return R_INDEX_SET_NONE;
+    return _AddIndexSet((const Tanto_R_Index*)indices.cdata(), indices.size() * 3, vertexCount);
+}
+
+Tanto_IndexSetId HdTantoRenderer::_AddIndexSet(const Tanto_R_Index* indices, uint32_t indexCount, 
+        uint32_t vertexCount)
+{
+    Tanto_IndexSetUpload upload;
     {
-        *nIter++ = *(Vec3*)data.color->data();
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+        upload = r_ReserveIndexSet(indexCount, vertexCount);
     }
-    
-    Mat4* transform = (Mat4*)data.xform.data();
 
-    Tanto_R_Material mat;
-    std::cout << "Data.Color: " << *data.color << '\n';
-    if (data.color)
+    r_WriteIndexSet(&upload, indices);
+    return upload.id;
+}
+
+void HdTantoRenderer::ReleaseIndexSet(Tanto_IndexSetId indexSet)
+{
+    if (_mode != MODE_RASTER)
+        return;
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    r_ReleaseIndexSet(indexSet);
+}
+
+void HdTantoRenderer::RemovePrim(Tanto_PrimId primId)
+{
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    if (_mode != MODE_RASTER)
     {
-        mat.color.x[0] = (*data.color)[0];
-        mat.color.x[1] = (*data.color)[1];
-        mat.color.x[2] = (*data.color)[2];
+        _cpuRenderer.RemovePrim(primId);
+        return;
     }
-    else
+
+    _UnregisterGeometry(primId);
+    r_RemovePrim(primId);
+}
+
+void HdTantoRenderer::UpdatePrimTransform(Tanto_PrimId primId, const GfMatrix4f& xform)
+{
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    if (_mode != MODE_RASTER)
     {
-        mat.color.x[0] = 0.5;
-        mat.color.x[1] = 0.5;
-        mat.color.x[2] = 0.5;
+        _cpuRenderer.SetPrimTransform(primId, xform);
+        return;
     }
-    mat.color.x[3] = 1;
 
-    return r_AddNewPrim(prim, mat, *transform);
+    r_UpdatePrimTransform(primId, *(Mat4*)xform.data());
 }
 
-void HdTantoRenderer::Render(HdRenderThread *renderThread)
+void HdTantoRenderer::UpdatePrimColor(Tanto_PrimId primId, const GfVec4f& color)
 {
-    r_Render();
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    if (_mode != MODE_RASTER)
+    {
+        _cpuRenderer.SetPrimColor(primId, color);
+        return;
+    }
+
+    r_UpdatePrimMaterial(primId, _MakeMaterial(color));
+}
+
+void HdTantoRenderer::SetPrimPickId(Tanto_PrimId primId, int32_t pickId)
+{
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    if (_mode != MODE_RASTER)
+    {
+        _cpuRenderer.SetPrimPickId(primId, pickId);
+        return;
+    }
+
+    r_SetPrimPickId(primId, pickId);
+}
+
+void HdTantoRenderer::UpdatePrimPoints(Tanto_PrimId primId, const VtVec3fArray& points, 
+        const VtVec3fArray& normals, const HdTantoTriangulation* triangulation)
+{
+    Tanto_IndexSetId indexSet;
+    PrimColors colors;
+    {
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+        if (_mode != MODE_RASTER)
+        {
+            _cpuRenderer.SetPrimPoints(primId, points, normals);
+            return;
+        }
+
+        auto prim = _primGeometries.find(primId);
+        indexSet = prim != _primGeometries.end() ? prim->second.indexSet : R_INDEX_SET_NONE;
+        if (prim != _primGeometries.end() && prim->second.key != _unshared)
+        {
+            auto shared = _geometries.find(prim->second.key);
+            if (shared != _geometries.end())
+            {
+                colors.points    = shared->second.pointColors;
+                colors.triangles = shared->second.triangleColors;
+            }
+        }
+        // the prim no longer matches the content it was registered with
+        _UnregisterGeometry(primId);
+        if (!r_IsPrimGeometryShared(primId))
+        {
+            const bool hasNormals = normals.size() == points.size();
+            r_UpdatePrimPoints(primId, (const Vec3*)points.cdata(), 
+                    hasNormals ? (const Vec3*)normals.cdata() : nullptr, points.size());
+            // prims without meshlets ignore this
+            if (triangulation && !triangulation->meshlets.empty())
+                r_RefitPrimMeshlets(primId, (const Tanto_R_Index*)triangulation->indices.cdata(), 
+                        triangulation->meshlets.data(), (const Vec3*)points.cdata());
+            return;
+        }
+    }
+
+    // other prims draw these vertices, so this one gets a copy of its own.
+    // only the point and triangle colors are part of it, the material stays.
+    // its levels of detail and meshlets are built again for the new points.
+    const GfMatrix4f xform(1);
+    UpdatePrimGeometry(primId, PrimData(points, indexSet, xform, &colors, triangulation, &normals));
+}
+
+void HdTantoRenderer::UpdatePrimInstances(Tanto_PrimId primId, const VtMatrix4dArray& xforms,
+        const VtVec3fArray& colors)
+{
+    Tanto_InstanceUpload upload;
+    {
+        const std::lock_guard<std::mutex> lock(mutexAddPrim);
+        if (_mode != MODE_RASTER)
+        {
+            _cpuRenderer.SetPrimInstances(primId, xforms, colors);
+            return;
+        }
+        upload = r_ReservePrimInstances(primId, xforms.size());
+    }
+
+    // tens of millions of instances are converted here, outside the lock
+    r_WritePrimInstances(&upload, xforms.empty() ? nullptr : xforms.cdata()->data(), 
+            colors.empty() ? nullptr : (const Vec3*)colors.cdata());
+
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    r_PublishPrimInstances(&upload);
+}
+
+void HdTantoRenderer::CommitResources()
+{
+    if (_mode != MODE_RASTER)
+        return;
+
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    r_CommitResources();
+}
+
+uint64_t HdTantoRenderer::Render(HdRenderThread *renderThread)
+{
+    // r_Render flushes any uploads still staged
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    return r_Render();
+}
+
+void HdTantoRenderer::RenderOnCpu(const R_RtTarget& target)
+{
+    if (!TF_VERIFY(_mode != MODE_RASTER))
+        return;
+
+    const std::lock_guard<std::mutex> lock(mutexAddPrim);
+
+    _cpuRenderer.Render(target);
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -3,15 +3,22 @@
 
 #include <pxr/pxr.h>
 #include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/vec4f.h>
 #include <pxr/imaging/hd/renderPass.h>
 #include <pxr/imaging/hd/renderThread.h>
 
 #include "renderBuffer.h"
+#include "cpuRenderer.h"
+#include "topologyCache.h"
+
+#include <unordered_map>
+#include <vector>
 
 extern "C" 
 {
 #include <tanto/r_geo.h>
 #include "tantoren/render.h"
+#include "tantoren/common.h"
 }
 
 PXR_NAMESPACE_OPEN_SCOPE
@@ -27,39 +34,105 @@ PXR_NAMESPACE_OPEN_SCOPE
 ///    origin.
 ///  - Ambient occlusion.
 
+/// displayColor and displayOpacity of a prim, as rgb and opacity, in the
+/// form the renderer stores them. The constant color is the material of the
+/// prim; the others are multiplied into it.
+struct PrimColors {
+    GfVec4f      constant = GfVec4f(0.5, 0.5, 0.5, 1);
+    // One per point, or empty.
+    VtVec4fArray points;
+    // One per triangle of the index set, or empty. Prims with them are
+    // drawn without levels of detail and meshlets.
+    VtVec4fArray triangles;
+};
+
 struct PrimData {
-    PrimData(const VtVec3fArray& _points, const VtVec3iArray& _indices, const GfMatrix4f& _xform, const GfVec3f* _color = nullptr)
-        : points(_points), indices(_indices), xform(_xform), color(_color)
+    PrimData(const VtVec3fArray& _points, Tanto_IndexSetId _indexSet, const GfMatrix4f& _xform, 
+            const PrimColors* _colors = nullptr, const HdTantoTriangulation* _triangulation = nullptr,
+            const VtVec3fArray* _normals = nullptr, const VtVec3iArray* _indices = nullptr)
+        : points(_points), indexSet(_indexSet), xform(_xform), colors(_colors), triangulation(_triangulation),
+        normals(_normals), indices(_indices)
     {}
-    const VtVec3fArray& points;
-    const VtVec3iArray& indices;
-    const GfMatrix4f&   xform;
-    const GfVec3f*      color;
+    const VtVec3fArray&         points;
+    Tanto_IndexSetId            indexSet;
+    const GfMatrix4f&           xform;
+    // Null for the default material.
+    const PrimColors*           colors;
+    // The triangulation indexSet was uploaded from. Levels of detail and
+    // meshlets are built from it for large meshes; without it the prim has
+    // neither.
+    const HdTantoTriangulation* triangulation;
+    // One per point, or null or empty for flat shading.
+    const VtVec3fArray*         normals;
+    // The triangles of indexSet, for the CPU modes. Null to take those of the
+    // triangulation.
+    const VtVec3iArray*         indices;
 };
 
 class HdTantoRenderer final {
 public:
-    /// Renderer constructor.
-    HdTantoRenderer();
+    /// Renderer constructor. MODE_RASTER falls back to MODE_SOFTWARE when
+    /// there is no Vulkan device to render with.
+    explicit HdTantoRenderer(ModeID mode);
 
     /// Renderer destructor.
     ~HdTantoRenderer();
 
+    /// The mode of a renderer created without one asking: MODE_RAY if
+    /// HDTANTO_RAY_TRACE is set, MODE_SOFTWARE if HDTANTO_SOFTWARE_RASTER
+    /// is, and MODE_RASTER otherwise.
+    static ModeID GetDefaultMode();
+
+    /// MODE_RAY if frames are ray traced on the CPU and MODE_SOFTWARE if
+    /// they are rasterized on it. The GPU is never touched then: frames are
+    /// written by RenderOnCpu and the raster calls below do nothing.
+    ModeID GetMode() const { return _mode; }
+
     /// Specify a new viewport size for the sample/color buffer.
     ///   \param width The new viewport width.
     ///   \param height The new viewport height.
-    void UpdateViewport(unsigned int width, unsigned int height,
-        HdTantoRenderBuffer* colorBuffer);
+    void UpdateViewport(unsigned int width, unsigned int height);
 
     /// Set the camera to use for rendering.
     ///   \param viewMatrix The camera's world-to-view matrix.
     ///   \param projMatrix The camera's view-to-NDC projection matrix.
     void SetCamera(const GfMatrix4f& viewMatrix, const GfMatrix4f& projMatrix);
     
-    void UpdateRender(HdTantoRenderBuffer* colorBuffer);
+    void UpdateRender();
+
+    /// Choose the aovs frames write, a mask of R_AOV_BIT. Color is always
+    /// written.
+    void SetAovs(uint32_t aovMask);
 
+    /// Upload a new prim to the renderer.
+    ///   \return The id used to address the prim in later updates.
     Tanto_PrimId AddPrim(PrimData);
 
+    /// Replace the geometry of a prim whose topology changed.
+    void UpdatePrimGeometry(Tanto_PrimId primId, PrimData);
+
+    /// Remove a prim from the scene. Its slot and geometry are recycled once
+    /// the GPU is done with them; primId must not be used afterwards.
+    void RemovePrim(Tanto_PrimId primId);
+
+    /// Incremental updates. Each writes only the state named and never
+    /// reallocates the prim.
+    void UpdatePrimTransform(Tanto_PrimId primId, const GfMatrix4f& xform);
+    /// Only sets the constant color; point and triangle colors are part of
+    /// the geometry.
+    void UpdatePrimColor(Tanto_PrimId primId, const GfVec4f& color);
+    /// The point count must match the one the prim was created with.
+    /// Normals are empty for flat shading. The triangulation is the one the
+    /// prim was created with, if any; its meshlets are refit to the points.
+    void UpdatePrimPoints(Tanto_PrimId primId, const VtVec3fArray& points, 
+            const VtVec3fArray& normals, const HdTantoTriangulation* triangulation = nullptr);
+    /// The id the prim writes to the primId aov, usually its Hydra prim id.
+    void SetPrimPickId(Tanto_PrimId primId, int32_t pickId);
+    /// Draw the prim once per transform. Colors, if not empty, hold one
+    /// color per transform.
+    void UpdatePrimInstances(Tanto_PrimId primId, const VtMatrix4dArray& xforms,
+            const VtVec3fArray& colors);
+
     /// Set the aov bindings to use for rendering.
     ///   \param aovBindings A list of aov bindings.
     void SetAovBindings(HdRenderPassAovBindingVector const &aovBindings);
@@ -70,7 +143,26 @@ public:
         return _aovBindings;
     }
 
-    void Render(HdRenderThread *renderThread);
+    /// Upload triangle indices that prims can share. The returned set is
+    /// owned by the caller until ReleaseIndexSet; prims using it keep it
+    /// alive on their own. The indices must be less than vertexCount, which
+    /// decides whether they fit in 16 bits.
+    Tanto_IndexSetId AddIndexSet(const VtVec3iArray& indices, uint32_t vertexCount);
+    void ReleaseIndexSet(Tanto_IndexSetId indexSet);
+
+    /// Triangulations shared by the meshes of this renderer.
+    HdTantoTopologyCache& GetTopologyCache() { return _topologyCache; }
+
+    /// Submit the geometry uploads queued by the prim calls above.
+    void CommitResources();
+
+    /// Submit a frame without waiting for the GPU.
+    ///   \return The frame number, for HdTantoRenderBuffer::SetFrame.
+    uint64_t Render(HdRenderThread *renderThread);
+
+    /// Render a frame on the CPU into the host memory of target, in
+    /// MODE_RAY or MODE_SOFTWARE. Returns once the frame is written.
+    void RenderOnCpu(const R_RtTarget& target);
 
     /// Clear the bound aov buffers (typically before rendering).
     void Clear();
@@ -78,8 +170,61 @@ public:
     void Initialize(unsigned int width, unsigned int height);
 
 private:
+    // Prims with identical content, keyed by _HashGeometry. New prims
+    // matching one of them draw the geometry of its first prim.
+    struct _SharedGeometry {
+        VtVec3fArray              points;
+        VtVec3fArray              normals;
+        VtVec4fArray              pointColors;
+        VtVec4fArray              triangleColors;
+        Tanto_IndexSetId          indexSet;
+        std::vector<Tanto_PrimId> prims;
+    };
+    struct _PrimGeometry {
+        uint64_t         key;
+        Tanto_IndexSetId indexSet;
+    };
+    // _PrimGeometry::key of prims left out of _geometries by a hash collision
+    static constexpr uint64_t _unshared = ~uint64_t(0);
+
+    // Meshes with fewer triangles than this draw at full resolution only.
+    // Their levels of detail stop before going below the second count.
+    static constexpr size_t   _lodMinMeshTriangles  = 16384;
+    static constexpr uint32_t _lodMinLevelTriangles = 512;
+
+    // Levels of detail of a mesh, finest first. Until _SetLods hands them to
+    // a prim, the renderer owns a reference to each index set.
+    struct _Lods {
+        uint32_t         count = 0;
+        Tanto_IndexSetId indexSets[R_MAX_LODS];
+        float            errors[R_MAX_LODS];
+    };
+
+    static bool _IsSameGeometry(const _SharedGeometry& shared, const PrimData& data);
+
+    // All six must be called with mutexAddPrim held.
+    const _SharedGeometry* _FindGeometry(uint64_t key, const PrimData& data) const;
+    void _RegisterGeometry(Tanto_PrimId primId, uint64_t key, const PrimData& data);
+    void _UnregisterGeometry(Tanto_PrimId primId);
+    void _SetLods(Tanto_PrimId primId, const _Lods& lods);
+    Tanto_MeshletUpload _ReserveMeshlets(Tanto_PrimId primId, const PrimData& data);
+    Tanto_FaceColorUpload _ReserveFaceColors(Tanto_PrimId primId, const PrimData& data);
+
+    // Copy the prim to the CPU renderer. Must be called with mutexAddPrim
+    // held.
+    void _SetCpuPrimGeometry(Tanto_PrimId primId, const PrimData& data);
+
+    // Take the lock themselves.
+    Tanto_IndexSetId _AddIndexSet(const Tanto_R_Index* indices, uint32_t indexCount, uint32_t vertexCount);
+    _Lods _BuildLods(const PrimData& data);
+
     HdRenderPassAovBindingVector _aovBindings;
+    const ModeID _mode;
+    HdTantoCpuRenderer _cpuRenderer;
     std::mutex mutexAddPrim;
+    HdTantoTopologyCache _topologyCache;
+    std::unordered_map<uint64_t, _SharedGeometry>   _geometries;
+    std::unordered_map<Tanto_PrimId, _PrimGeometry> _primGeometries;
 
 };
 
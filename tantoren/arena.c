@@ -0,0 +1,103 @@
+#include "arena.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void insertRange(R_Arena* arena, uint32_t index, R_ArenaRange range)
+{
+    if (arena->freeCount == arena->freeCapacity)
+    {
+        arena->freeCapacity = arena->freeCapacity ? arena->freeCapacity * 2 : 16;
+        arena->freeRanges = realloc(arena->freeRanges, arena->freeCapacity * sizeof(R_ArenaRange));
+        assert(arena->freeRanges);
+    }
+    memmove(&arena->freeRanges[index + 1], &arena->freeRanges[index], 
+            (arena->freeCount - index) * sizeof(R_ArenaRange));
+    arena->freeRanges[index] = range;
+    arena->freeCount++;
+}
+
+static void removeRange(R_Arena* arena, uint32_t index)
+{
+    memmove(&arena->freeRanges[index], &arena->freeRanges[index + 1], 
+            (arena->freeCount - index - 1) * sizeof(R_ArenaRange));
+    arena->freeCount--;
+}
+
+void r_ArenaInit(R_Arena* arena, uint32_t capacity)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->capacity = capacity;
+    if (capacity)
+        insertRange(arena, 0, (R_ArenaRange){0, capacity});
+}
+
+bool r_ArenaAlloc(R_Arena* arena, uint32_t size, uint32_t* offset)
+{
+    assert(size);
+    for (uint32_t i = 0; i < arena->freeCount; i++) 
+    {
+        R_ArenaRange* range = &arena->freeRanges[i];
+        if (range->size < size)
+            continue;
+        *offset = range->offset;
+        range->offset += size;
+        range->size   -= size;
+        if (range->size == 0)
+            removeRange(arena, i);
+        arena->used += size;
+        return true;
+    }
+    return false;
+}
+
+void r_ArenaRelease(R_Arena* arena, uint32_t offset, uint32_t size)
+{
+    assert(offset + size <= arena->capacity);
+    assert(size <= arena->used);
+    arena->used -= size;
+
+    // find the first free range after the released one
+    uint32_t i = 0;
+    while (i < arena->freeCount && arena->freeRanges[i].offset < offset)
+        i++;
+
+    const bool mergePrev = i > 0 && 
+        arena->freeRanges[i - 1].offset + arena->freeRanges[i - 1].size == offset;
+    const bool mergeNext = i < arena->freeCount && 
+        offset + size == arena->freeRanges[i].offset;
+
+    if (mergePrev && mergeNext)
+    {
+        arena->freeRanges[i - 1].size += size + arena->freeRanges[i].size;
+        removeRange(arena, i);
+    }
+    else if (mergePrev)
+        arena->freeRanges[i - 1].size += size;
+    else if (mergeNext)
+    {
+        arena->freeRanges[i].offset = offset;
+        arena->freeRanges[i].size  += size;
+    }
+    else
+        insertRange(arena, i, (R_ArenaRange){offset, size});
+}
+
+void r_ArenaGrow(R_Arena* arena, uint32_t newCapacity)
+{
+    assert(newCapacity >= arena->capacity);
+    const uint32_t oldCapacity = arena->capacity;
+    if (newCapacity == oldCapacity)
+        return;
+    // release the new tail as if it had been allocated, so it merges with a
+    // trailing free range
+    arena->capacity = newCapacity;
+    arena->used    += newCapacity - oldCapacity;
+    r_ArenaRelease(arena, oldCapacity, newCapacity - oldCapacity);
+}
+
+void r_ArenaDestroy(R_Arena* arena)
+{
+    free(arena->freeRanges);
+    memset(arena, 0, sizeof(*arena));
+}
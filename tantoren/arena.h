@@ -0,0 +1,33 @@
+#ifndef VIEWER_R_ARENA_H
+#define VIEWER_R_ARENA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// range allocator used to sub-allocate the shared geometry buffers. it only
+// does the bookkeeping; units are whatever the owner decides (vertices,
+// indices...). free ranges are kept sorted by offset and coalesced.
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} R_ArenaRange;
+
+typedef struct {
+    uint32_t      capacity;
+    uint32_t      used;
+    uint32_t      freeCount;
+    uint32_t      freeCapacity;
+    R_ArenaRange* freeRanges;
+} R_Arena;
+
+void r_ArenaInit(R_Arena* arena, uint32_t capacity);
+// first fit. returns false if no free range is large enough; the owner is
+// expected to grow the arena and try again.
+bool r_ArenaAlloc(R_Arena* arena, uint32_t size, uint32_t* offset);
+void r_ArenaRelease(R_Arena* arena, uint32_t offset, uint32_t size);
+// appends [capacity, newCapacity) to the free space.
+void r_ArenaGrow(R_Arena* arena, uint32_t newCapacity);
+void r_ArenaDestroy(R_Arena* arena);
+
+#endif /* end of include guard: VIEWER_R_ARENA_H */
@@ -0,0 +1,330 @@
+#include "bvh.h"
+#include <assert.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// items per leaf. leaves are tested item by item, so this trades node tests
+// against item tests.
+#define LEAF_SIZE 4
+
+// a median split tree over n items is about log2(n) / 2 nodes deep and every
+// level leaves at most three siblings on the stack
+#define CULL_STACK_SIZE 256
+
+static const R_Aabb emptyBox = {
+    .min = {{ FLT_MAX,  FLT_MAX,  FLT_MAX}},
+    .max = {{-FLT_MAX, -FLT_MAX, -FLT_MAX}}
+};
+
+static void growBox(R_Aabb* box, const R_Aabb* other)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (other->min.x[i] < box->min.x[i]) box->min.x[i] = other->min.x[i];
+        if (other->max.x[i] > box->max.x[i]) box->max.x[i] = other->max.x[i];
+    }
+}
+
+static R_Aabb getLane(const R_BvhNode* node, const int lane)
+{
+    return (R_Aabb){
+        .min = {{node->minX[lane], node->minY[lane], node->minZ[lane]}},
+        .max = {{node->maxX[lane], node->maxY[lane], node->maxZ[lane]}}
+    };
+}
+
+static void setLane(R_BvhNode* node, const int lane, const R_Aabb* box)
+{
+    node->minX[lane] = box->min.x[0];
+    node->minY[lane] = box->min.x[1];
+    node->minZ[lane] = box->min.x[2];
+    node->maxX[lane] = box->max.x[0];
+    node->maxY[lane] = box->max.x[1];
+    node->maxZ[lane] = box->max.x[2];
+}
+
+static R_Aabb itemBounds(const R_Bvh* bvh, const R_Aabb* boxes, const uint32_t first, const uint32_t count)
+{
+    R_Aabb box = emptyBox;
+    for (uint32_t i = first; i < first + count; i++)
+        growBox(&box, &boxes[bvh->items[i]]);
+    return box;
+}
+
+// twice the centroid, which orders the same
+static float centroid(const R_Aabb* box, const int axis)
+{
+    return box->min.x[axis] + box->max.x[axis];
+}
+
+// quickselect: reorders the items so that the first count / 2 have centroids
+// no greater than the rest along axis
+static void partitionMedian(uint32_t* items, const int32_t count, const R_Aabb* boxes, const int axis)
+{
+    const int32_t k = count / 2;
+    int32_t lo = 0;
+    int32_t hi = count - 1;
+    while (lo < hi)
+    {
+        const float pivot = centroid(&boxes[items[lo + (hi - lo) / 2]], axis);
+        int32_t i = lo;
+        int32_t j = hi;
+        while (i <= j)
+        {
+            while (centroid(&boxes[items[i]], axis) < pivot) i++;
+            while (centroid(&boxes[items[j]], axis) > pivot) j--;
+            if (i <= j)
+            {
+                const uint32_t tmp = items[i];
+                items[i++] = items[j];
+                items[j--] = tmp;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+// splits a range of items in half along the longest axis of their centroids
+// and returns the size of the first half
+static uint32_t splitRange(R_Bvh* bvh, const R_Aabb* boxes, const uint32_t first, const uint32_t count)
+{
+    if (count < 2)
+        return count;
+    float lo[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+    float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            const float c = centroid(&boxes[bvh->items[i]], a);
+            if (c < lo[a]) lo[a] = c;
+            if (c > hi[a]) hi[a] = c;
+        }
+    }
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+        if (hi[a] - lo[a] > hi[axis] - lo[axis])
+            axis = a;
+    partitionMedian(bvh->items + first, count, boxes, axis);
+    return count / 2;
+}
+
+static uint32_t allocNode(R_Bvh* bvh)
+{
+    if (bvh->nodeCount == bvh->nodeCapacity)
+    {
+        bvh->nodeCapacity = bvh->nodeCapacity ? bvh->nodeCapacity * 2 : 64;
+        bvh->nodes = realloc(bvh->nodes, bvh->nodeCapacity * sizeof(R_BvhNode));
+        assert(bvh->nodes);
+    }
+    return bvh->nodeCount++;
+}
+
+static uint32_t buildNode(R_Bvh* bvh, const R_Aabb* boxes, const uint32_t first, const uint32_t count)
+{
+    const uint32_t index = allocNode(bvh);
+
+    // two levels of binary splits give the four children
+    const uint32_t left = splitRange(bvh, boxes, first, count);
+    const uint32_t leftLeft   = splitRange(bvh, boxes, first, left);
+    const uint32_t rightLeft  = splitRange(bvh, boxes, first + left, count - left);
+    const uint32_t firsts[4] = { first, first + leftLeft, first + left, first + left + rightLeft };
+    const uint32_t counts[4] = { leftLeft, left - leftLeft, rightLeft, count - left - rightLeft };
+
+    for (int i = 0; i < 4; i++)
+    {
+        // recursing may move the nodes
+        const uint32_t child = counts[i] > LEAF_SIZE ?
+            buildNode(bvh, boxes, firsts[i], counts[i]) : R_BVH_LEAF;
+        R_BvhNode* node = &bvh->nodes[index];
+        const R_Aabb box = counts[i] ? itemBounds(bvh, boxes, firsts[i], counts[i]) : emptyBox;
+        setLane(node, i, &box);
+        node->node[i]  = child;
+        node->first[i] = firsts[i];
+        node->count[i] = counts[i];
+    }
+    return index;
+}
+
+void r_BvhBuild(R_Bvh* bvh, const R_Aabb* boxes, const uint32_t* ids, uint32_t count)
+{
+    if (count > bvh->itemCapacity)
+    {
+        bvh->itemCapacity = count;
+        bvh->items = realloc(bvh->items, count * sizeof(uint32_t));
+        assert(bvh->items);
+    }
+    memcpy(bvh->items, ids, count * sizeof(uint32_t));
+    bvh->itemCount = count;
+    bvh->nodeCount = 0;
+    if (count)
+        buildNode(bvh, boxes, 0, count);
+}
+
+void r_BvhRefit(R_Bvh* bvh, const R_Aabb* boxes)
+{
+    // children come after their parents, so walking backwards visits every
+    // child before the node that contains it
+    for (int64_t n = (int64_t)bvh->nodeCount - 1; n >= 0; n--)
+    {
+        R_BvhNode* node = &bvh->nodes[n];
+        for (int i = 0; i < 4; i++)
+        {
+            if (node->count[i] == 0)
+                continue;
+            R_Aabb box = emptyBox;
+            if (node->node[i] == R_BVH_LEAF)
+                box = itemBounds(bvh, boxes, node->first[i], node->count[i]);
+            else
+            {
+                const R_BvhNode* child = &bvh->nodes[node->node[i]];
+                for (int j = 0; j < 4; j++)
+                {
+                    if (child->count[j] == 0)
+                        continue;
+                    const R_Aabb childBox = getLane(child, j);
+                    growBox(&box, &childBox);
+                }
+            }
+            setLane(node, i, &box);
+        }
+    }
+}
+
+// tests the four children of a node against the planes. a child is outside
+// if its corner furthest along a plane normal is behind the plane and fully
+// inside if its nearest corner is in front of every plane. returns the
+// outside lanes and the lanes straddling a plane as bit masks.
+static void testNode(const R_BvhNode* node, const Vec4 planes[6], int* outside, int* straddling)
+{
+#ifdef __SSE__
+    const __m128 minX = _mm_loadu_ps(node->minX);
+    const __m128 minY = _mm_loadu_ps(node->minY);
+    const __m128 minZ = _mm_loadu_ps(node->minZ);
+    const __m128 maxX = _mm_loadu_ps(node->maxX);
+    const __m128 maxY = _mm_loadu_ps(node->maxY);
+    const __m128 maxZ = _mm_loadu_ps(node->maxZ);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 out   = zero;
+    __m128 cross = zero;
+    for (int p = 0; p < 6; p++)
+    {
+        const float* plane = planes[p].x;
+        const __m128 nx = _mm_set1_ps(plane[0]);
+        const __m128 ny = _mm_set1_ps(plane[1]);
+        const __m128 nz = _mm_set1_ps(plane[2]);
+        const __m128 d  = _mm_set1_ps(plane[3]);
+        const __m128 farX  = plane[0] >= 0.0f ? maxX : minX;
+        const __m128 farY  = plane[1] >= 0.0f ? maxY : minY;
+        const __m128 farZ  = plane[2] >= 0.0f ? maxZ : minZ;
+        const __m128 nearX = plane[0] >= 0.0f ? minX : maxX;
+        const __m128 nearY = plane[1] >= 0.0f ? minY : maxY;
+        const __m128 nearZ = plane[2] >= 0.0f ? minZ : maxZ;
+        const __m128 farDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, farX), _mm_mul_ps(ny, farY)),
+                _mm_add_ps(_mm_mul_ps(nz, farZ), d));
+        const __m128 nearDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nearX), _mm_mul_ps(ny, nearY)),
+                _mm_add_ps(_mm_mul_ps(nz, nearZ), d));
+        out   = _mm_or_ps(out,   _mm_cmplt_ps(farDist,  zero));
+        cross = _mm_or_ps(cross, _mm_cmplt_ps(nearDist, zero));
+    }
+    *outside    = _mm_movemask_ps(out);
+    *straddling = _mm_movemask_ps(cross) & ~*outside;
+#else
+    *outside    = 0;
+    *straddling = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        const float lo[3] = { node->minX[i], node->minY[i], node->minZ[i] };
+        const float hi[3] = { node->maxX[i], node->maxY[i], node->maxZ[i] };
+        for (int p = 0; p < 6; p++)
+        {
+            const float* plane = planes[p].x;
+            float farDist  = plane[3];
+            float nearDist = plane[3];
+            for (int a = 0; a < 3; a++)
+            {
+                farDist  += plane[a] * (plane[a] >= 0.0f ? hi[a] : lo[a]);
+                nearDist += plane[a] * (plane[a] >= 0.0f ? lo[a] : hi[a]);
+            }
+            if (farDist < 0.0f)
+                *outside |= 1 << i;
+            else if (nearDist < 0.0f)
+                *straddling |= 1 << i;
+        }
+    }
+    *straddling &= ~*outside;
+#endif
+}
+
+static bool boxOutside(const R_Aabb* box, const Vec4 planes[6])
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const float* plane = planes[p].x;
+        float farDist = plane[3];
+        for (int a = 0; a < 3; a++)
+            farDist += plane[a] * (plane[a] >= 0.0f ? box->max.x[a] : box->min.x[a]);
+        if (farDist < 0.0f)
+            return true;
+    }
+    return false;
+}
+
+static void markVisible(uint64_t* visible, const uint32_t id)
+{
+    visible[id / 64] |= 1ull << (id % 64);
+}
+
+void r_BvhCull(const R_Bvh* bvh, const R_Aabb* boxes, const Vec4 planes[6], uint64_t* visible)
+{
+    if (bvh->nodeCount == 0)
+        return;
+    uint32_t stack[CULL_STACK_SIZE];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while (top)
+    {
+        const R_BvhNode* node = &bvh->nodes[stack[--top]];
+        int outside, straddling;
+        testNode(node, planes, &outside, &straddling);
+        for (int i = 0; i < 4; i++)
+        {
+            if (node->count[i] == 0 || (outside & (1 << i)))
+                continue;
+            const uint32_t* items = bvh->items + node->first[i];
+            if (!(straddling & (1 << i)))
+            {
+                // fully inside, so is the whole subtree
+                for (uint32_t j = 0; j < node->count[i]; j++)
+                    markVisible(visible, items[j]);
+            }
+            else if (node->node[i] == R_BVH_LEAF)
+            {
+                for (uint32_t j = 0; j < node->count[i]; j++)
+                    if (!boxOutside(&boxes[items[j]], planes))
+                        markVisible(visible, items[j]);
+            }
+            else
+            {
+                assert(top < CULL_STACK_SIZE);
+                stack[top++] = node->node[i];
+            }
+        }
+    }
+}
+
+void r_BvhFree(R_Bvh* bvh)
+{
+    free(bvh->nodes);
+    free(bvh->items);
+    memset(bvh, 0, sizeof(*bvh));
+}
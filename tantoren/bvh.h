@@ -0,0 +1,57 @@
+#ifndef VIEWER_R_BVH_H
+#define VIEWER_R_BVH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <tanto/m_math.h>
+
+// bounding volume hierarchy over axis aligned boxes, used to cull prims
+// against the view frustum. nodes have four children whose boxes are stored
+// as structure of arrays so one node is tested against a plane in a single
+// pass of 4 wide SIMD. it only knows about item ids; the boxes are owned by
+// the caller and indexed by those ids.
+
+typedef struct {
+    Vec3 min;
+    Vec3 max;
+} R_Aabb;
+
+#define R_BVH_LEAF UINT32_MAX
+
+// a child with a node of R_BVH_LEAF is a leaf holding count items from
+// first. every subtree covers a contiguous range of items, so inner children
+// have first and count set as well. unused children have a count of 0.
+typedef struct {
+    float    minX[4];
+    float    minY[4];
+    float    minZ[4];
+    float    maxX[4];
+    float    maxY[4];
+    float    maxZ[4];
+    uint32_t node[4];
+    uint32_t first[4];
+    uint32_t count[4];
+} R_BvhNode;
+
+// nodes are stored parent first, so a child always follows its parent
+typedef struct {
+    uint32_t   nodeCount;
+    uint32_t   nodeCapacity;
+    R_BvhNode* nodes;
+    uint32_t   itemCount;
+    uint32_t   itemCapacity;
+    uint32_t*  items;
+} R_Bvh;
+
+// builds the hierarchy over count ids from scratch with median splits
+void r_BvhBuild(R_Bvh* bvh, const R_Aabb* boxes, const uint32_t* ids, uint32_t count);
+// recomputes the node boxes after the item boxes moved. cheaper than a
+// rebuild but the tree gets looser the further items travel.
+void r_BvhRefit(R_Bvh* bvh, const R_Aabb* boxes);
+// sets the bit of every item whose box is not fully outside one of the
+// planes. planes are (n, d) with n.p + d >= 0 on the inside; they need not
+// be normalized. visible must be cleared by the caller.
+void r_BvhCull(const R_Bvh* bvh, const R_Aabb* boxes, const Vec4 planes[6], uint64_t* visible);
+void r_BvhFree(R_Bvh* bvh);
+
+#endif /* end of include guard: VIEWER_R_BVH_H */
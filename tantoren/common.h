@@ -6,6 +6,7 @@
 typedef enum {
     MODE_RASTER,
     MODE_RAY,
+    MODE_SOFTWARE,
 } ModeID;
 
 typedef struct {
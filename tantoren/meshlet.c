@@ -0,0 +1,237 @@
+#include "meshlet.h"
+#include "normals.h"
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define NONE UINT32_MAX
+
+// triangles of every vertex, stored back to back
+typedef struct {
+    uint32_t* offsets;
+    uint32_t* triangles;
+} Adjacency;
+
+typedef struct {
+    const uint32_t* indices;
+    Adjacency       adjacency;
+    bool*           emitted;
+    uint32_t*       marks;
+    uint32_t        mark;
+    uint32_t        vertices[R_MESHLET_MAX_VERTICES];
+    uint32_t        vertexCount;
+    uint32_t        triangleCount;
+} Builder;
+
+static void initAdjacency(Adjacency* adjacency, const uint32_t* indices, const uint32_t indexCount,
+        const uint32_t vertexCount)
+{
+    adjacency->offsets   = malloc((vertexCount + 1) * sizeof(uint32_t));
+    adjacency->triangles = malloc(indexCount * sizeof(uint32_t));
+    assert(adjacency->offsets && adjacency->triangles);
+    const bool valid = r_VertexTriangles(indices, indexCount, vertexCount, 
+            adjacency->offsets, adjacency->triangles);
+    assert(valid);
+    (void)valid;
+}
+
+// vertices of a triangle not yet in the current meshlet
+static uint32_t newVertexCount(const Builder* builder, const uint32_t triangle)
+{
+    const uint32_t* tri = &builder->indices[triangle * 3];
+    uint32_t count = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        if (builder->marks[tri[k]] != builder->mark)
+            count++;
+    }
+    // repeated vertices of degenerate triangles only count once
+    if (tri[0] == tri[1] || tri[0] == tri[2]) count -= builder->marks[tri[0]] != builder->mark;
+    if (tri[1] == tri[2]) count -= builder->marks[tri[1]] != builder->mark;
+    return count;
+}
+
+// the unused triangle around the given vertices that adds the fewest
+// vertices to the meshlet
+static uint32_t bestNeighbour(const Builder* builder, const uint32_t* vertices, const uint32_t count)
+{
+    uint32_t best = NONE;
+    uint32_t bestCost = 4;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint32_t v = vertices[i];
+        for (uint32_t j = builder->adjacency.offsets[v]; j < builder->adjacency.offsets[v + 1]; j++)
+        {
+            const uint32_t t = builder->adjacency.triangles[j];
+            if (builder->emitted[t])
+                continue;
+            const uint32_t cost = newVertexCount(builder, t);
+            if (cost < bestCost)
+            {
+                best = t;
+                bestCost = cost;
+                if (cost == 0)
+                    return best;
+            }
+        }
+    }
+    return best;
+}
+
+static void addTriangle(Builder* builder, const uint32_t triangle)
+{
+    const uint32_t* tri = &builder->indices[triangle * 3];
+    for (int k = 0; k < 3; k++)
+    {
+        if (builder->marks[tri[k]] == builder->mark)
+            continue;
+        builder->marks[tri[k]] = builder->mark;
+        builder->vertices[builder->vertexCount++] = tri[k];
+    }
+    builder->triangleCount++;
+    builder->emitted[triangle] = true;
+}
+
+uint32_t r_BuildMeshlets(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t* triangleOrder, uint32_t* meshletTriangles)
+{
+    const uint32_t triangleCount = indexCount / 3;
+    for (uint32_t i = 0; i < triangleCount * 3; i++)
+    {
+        if (indices[i] >= vertexCount)
+            return 0;
+    }
+
+    Builder builder = {
+        .indices = indices,
+        .emitted = calloc(triangleCount, sizeof(bool)),
+        .marks   = calloc(vertexCount, sizeof(uint32_t)),
+        .mark    = 1
+    };
+    assert(builder.emitted && builder.marks);
+    initAdjacency(&builder.adjacency, indices, triangleCount * 3, vertexCount);
+
+    uint32_t meshletCount = 0;
+    uint32_t cursor = 0;
+    uint32_t next = NONE;
+    meshletTriangles[0] = 0;
+    for (uint32_t emitted = 0; emitted < triangleCount; emitted++)
+    {
+        // continue with the first triangle not used yet when the meshlet has
+        // no free neighbours left
+        if (next == NONE)
+        {
+            while (builder.emitted[cursor])
+                cursor++;
+            next = cursor;
+        }
+        if (builder.triangleCount == R_MESHLET_MAX_TRIANGLES ||
+            builder.vertexCount + newVertexCount(&builder, next) > R_MESHLET_MAX_VERTICES)
+        {
+            meshletTriangles[++meshletCount] = emitted;
+            builder.mark++;
+            builder.vertexCount   = 0;
+            builder.triangleCount = 0;
+        }
+        addTriangle(&builder, next);
+        triangleOrder[emitted] = next;
+
+        // grow around the last triangle first, which keeps meshlets round
+        next = bestNeighbour(&builder, &indices[next * 3], 3);
+        if (next == NONE)
+            next = bestNeighbour(&builder, builder.vertices, builder.vertexCount);
+    }
+    if (builder.triangleCount)
+        meshletTriangles[++meshletCount] = triangleCount;
+
+    free(builder.emitted);
+    free(builder.marks);
+    free(builder.adjacency.offsets);
+    free(builder.adjacency.triangles);
+    return meshletCount;
+}
+
+R_MeshletBounds r_MeshletBounds(const uint32_t* indices, uint32_t triangleCount, const Vec3* positions)
+{
+    R_MeshletBounds bounds = { .coneCutoff = 1.0f };
+    if (triangleCount == 0)
+        return bounds;
+
+    // the sphere is centered on the box around the vertices
+    Vec3 lo = positions[indices[0]];
+    Vec3 hi = lo;
+    for (uint32_t i = 1; i < triangleCount * 3; i++)
+    {
+        const Vec3* p = &positions[indices[i]];
+        for (int a = 0; a < 3; a++)
+        {
+            if (p->x[a] < lo.x[a]) lo.x[a] = p->x[a];
+            if (p->x[a] > hi.x[a]) hi.x[a] = p->x[a];
+        }
+    }
+    for (int a = 0; a < 3; a++)
+        bounds.center.x[a] = 0.5f * (lo.x[a] + hi.x[a]);
+    float radiusSq = 0.0f;
+    for (uint32_t i = 0; i < triangleCount * 3; i++)
+    {
+        const Vec3* p = &positions[indices[i]];
+        float distanceSq = 0.0f;
+        for (int a = 0; a < 3; a++)
+            distanceSq += (p->x[a] - bounds.center.x[a]) * (p->x[a] - bounds.center.x[a]);
+        if (distanceSq > radiusSq)
+            radiusSq = distanceSq;
+    }
+    bounds.radius = sqrtf(radiusSq);
+
+    // the axis is the mean of the unit normals. the cone has to reach the
+    // one farthest from it.
+    float normals[R_MESHLET_MAX_TRIANGLES][3];
+    assert(triangleCount <= R_MESHLET_MAX_TRIANGLES);
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    uint32_t normalCount = 0;
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const Vec3* p0 = &positions[indices[t * 3 + 0]];
+        const Vec3* p1 = &positions[indices[t * 3 + 1]];
+        const Vec3* p2 = &positions[indices[t * 3 + 2]];
+        float e1[3], e2[3];
+        for (int a = 0; a < 3; a++)
+        {
+            e1[a] = p1->x[a] - p0->x[a];
+            e2[a] = p2->x[a] - p0->x[a];
+        }
+        float* n = normals[normalCount];
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        // degenerate triangles are never rasterized
+        if (length == 0.0f)
+            continue;
+        for (int a = 0; a < 3; a++)
+        {
+            n[a] /= length;
+            axis[a] += n[a];
+        }
+        normalCount++;
+    }
+    const float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (normalCount == 0 || axisLength == 0.0f)
+        return bounds;
+    for (int a = 0; a < 3; a++)
+        bounds.coneAxis.x[a] = axis[a] / axisLength;
+
+    float minDot = 1.0f;
+    for (uint32_t i = 0; i < normalCount; i++)
+    {
+        const float d = normals[i][0] * bounds.coneAxis.x[0] + normals[i][1] * bounds.coneAxis.x[1] +
+            normals[i][2] * bounds.coneAxis.x[2];
+        if (d < minDot)
+            minDot = d;
+    }
+    // a cone of 90 degrees or more always has a normal facing the eye
+    if (minDot > 0.0f)
+        bounds.coneCutoff = sqrtf(1.0f - minDot * minDot);
+    return bounds;
+}
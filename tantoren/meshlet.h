@@ -0,0 +1,37 @@
+#ifndef VIEWER_R_MESHLET_H
+#define VIEWER_R_MESHLET_H
+
+#include <stdint.h>
+#include <tanto/m_math.h>
+
+// clusters of a few neighbouring triangles that are culled on their own.
+// clustering only looks at the topology, so it is done once per index set;
+// the bounds depend on the positions as well. like the simplifier, both
+// touch nothing but their arguments.
+
+#define R_MESHLET_MAX_VERTICES  64
+#define R_MESHLET_MAX_TRIANGLES 124
+
+// sphere around the triangles of a meshlet and the cone their normals lie
+// in. coneCutoff is the sine of the cone's half angle, or 1 if the normals
+// are too far apart for the meshlet to ever face away as a whole.
+typedef struct {
+    Vec3  center;
+    float radius;
+    Vec3  coneAxis;
+    float coneCutoff;
+} R_MeshletBounds;
+
+// groups the triangles into meshlets of at most R_MESHLET_MAX_VERTICES
+// vertices and R_MESHLET_MAX_TRIANGLES triangles, growing each over
+// neighbouring triangles. triangleOrder receives the triangles in meshlet
+// order, by their index in the input, and meshletTriangles the first
+// triangle of each meshlet in that order followed by the total count. it
+// must have room for one more than the number of triangles. returns the
+// number of meshlets.
+uint32_t r_BuildMeshlets(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t* triangleOrder, uint32_t* meshletTriangles);
+// bounds of triangleCount triangles from indices
+R_MeshletBounds r_MeshletBounds(const uint32_t* indices, uint32_t triangleCount, const Vec3* positions);
+
+#endif /* end of include guard: VIEWER_R_MESHLET_H */
@@ -0,0 +1,81 @@
+#include "normals.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// triangles go through the cross product this many at a time, one per lane
+#define LANE_COUNT 8
+
+typedef float Lanes __attribute__((vector_size(LANE_COUNT * sizeof(float))));
+
+bool r_VertexTriangles(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t* offsets, uint32_t* triangles)
+{
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        if (indices[i] >= vertexCount)
+            return false;
+    }
+    // count, sum the counts up to the ends of the lists and fill them from
+    // the back, which moves each end to the start of its list
+    memset(offsets, 0, (vertexCount + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < indexCount; i++)
+        offsets[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    for (uint32_t i = indexCount; i-- > 0;)
+        triangles[--offsets[indices[i] + 1]] = i / 3;
+    memmove(offsets, offsets + 1, vertexCount * sizeof(uint32_t));
+    offsets[vertexCount] = indexCount;
+    return true;
+}
+
+void r_FaceNormals(const uint32_t* indices, uint32_t firstTriangle, uint32_t triangleCount,
+        const Vec3* positions, Vec3* faceNormals)
+{
+    const uint32_t end = firstTriangle + triangleCount;
+    for (uint32_t base = firstTriangle; base < end; base += LANE_COUNT)
+    {
+        const uint32_t count = end - base < LANE_COUNT ? end - base : LANE_COUNT;
+        // the edges, one component per vector. unused lanes stay zero.
+        Lanes e1[3] = {0};
+        Lanes e2[3] = {0};
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint32_t* tri = &indices[(base + i) * 3];
+            const Vec3* p0 = &positions[tri[0]];
+            const Vec3* p1 = &positions[tri[1]];
+            const Vec3* p2 = &positions[tri[2]];
+            for (int a = 0; a < 3; a++)
+            {
+                e1[a][i] = p1->x[a] - p0->x[a];
+                e2[a][i] = p2->x[a] - p0->x[a];
+            }
+        }
+        const Lanes nx = e1[1] * e2[2] - e1[2] * e2[1];
+        const Lanes ny = e1[2] * e2[0] - e1[0] * e2[2];
+        const Lanes nz = e1[0] * e2[1] - e1[1] * e2[0];
+        for (uint32_t i = 0; i < count; i++)
+            faceNormals[base + i] = (Vec3){{nx[i], ny[i], nz[i]}};
+    }
+}
+
+void r_VertexNormals(const uint32_t* offsets, const uint32_t* triangles, const Vec3* faceNormals,
+        uint32_t firstVertex, uint32_t vertexCount, Vec3* normals)
+{
+    // every vertex gathers from its own triangles, so ranges of vertices
+    // never write to the same place
+    for (uint32_t v = firstVertex; v < firstVertex + vertexCount; v++)
+    {
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++)
+        {
+            const Vec3* n = &faceNormals[triangles[j]];
+            for (int a = 0; a < 3; a++)
+                sum[a] += n->x[a];
+        }
+        const float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+        const float scale  = length > 0.0f ? 1.0f / length : 0.0f;
+        normals[v] = (Vec3){{sum[0] * scale, sum[1] * scale, sum[2] * scale}};
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef VIEWER_R_NORMALS_H
+#define VIEWER_R_NORMALS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <tanto/m_math.h>
+
+// smooth vertex normals of triangle meshes. the triangles around each vertex
+// only depend on the topology, so they are found once per index set. the
+// normals are found again whenever the positions move, in a pass over the
+// triangles and then one over the vertices. both passes work on ranges and
+// touch nothing but their arguments, so the ranges of a pass may run on any
+// number of threads at once.
+
+// the triangles around each vertex, stored back to back: those of vertex v
+// are triangles[offsets[v]] up to triangles[offsets[v + 1]]. offsets must
+// have room for vertexCount + 1 entries and triangles for indexCount.
+// returns false if an index is out of range.
+bool r_VertexTriangles(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount,
+        uint32_t* offsets, uint32_t* triangles);
+// cross products of the edges of triangleCount triangles from firstTriangle
+// on, their face normals scaled by twice their area. faceNormals is indexed
+// by triangle.
+void r_FaceNormals(const uint32_t* indices, uint32_t firstTriangle, uint32_t triangleCount,
+        const Vec3* positions, Vec3* faceNormals);
+// normals of vertexCount vertices from firstVertex on, the normalized sums
+// of the face normals around them. normals is indexed by vertex; vertices
+// without area around them get a zero normal.
+void r_VertexNormals(const uint32_t* offsets, const uint32_t* triangles, const Vec3* faceNormals,
+        uint32_t firstVertex, uint32_t vertexCount, Vec3* normals);
+
+#endif /* end of include guard: VIEWER_R_NORMALS_H */
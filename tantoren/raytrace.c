@@ -0,0 +1,781 @@
+#include "raytrace.h"
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LANE_COUNT R_RT_PACKET_SIZE
+
+typedef float   Lanes __attribute__((vector_size(LANE_COUNT * sizeof(float))));
+typedef int32_t Mask  __attribute__((vector_size(LANE_COUNT * sizeof(int32_t))));
+
+// packets cover this many pixels across and LANE_COUNT / PACKET_WIDTH up
+#define PACKET_WIDTH 4
+
+// splits are placed between this many bins of the item centroids
+#define BIN_COUNT 16
+// leaves get at most this many items unless their items cannot be told apart
+#define LEAF_SIZE 8
+// costs of a node test and of an item test, relative to each other
+#define NODE_COST 1.0f
+#define ITEM_COST 1.0f
+// ranges with fewer items than this are not split into tasks of their own
+#define TASK_MIN_ITEMS 4096
+// deeper ranges become leaves, which bounds the traversal stack
+#define MAX_DEPTH 60
+#define STACK_SIZE (MAX_DEPTH + 4)
+
+// the clear values of the raster path
+#define MISS_DEPTH   1.0f
+#define MISS_PRIM_ID -1
+
+static const Vec4 missColor = {{0.002f, 0.023f, 0.009f, 1.0f}};
+
+static const R_Aabb emptyBox = {
+    .min = {{ FLT_MAX,  FLT_MAX,  FLT_MAX}},
+    .max = {{-FLT_MAX, -FLT_MAX, -FLT_MAX}}
+};
+
+static void growBox(R_Aabb* box, const R_Aabb* other)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (other->min.x[i] < box->min.x[i]) box->min.x[i] = other->min.x[i];
+        if (other->max.x[i] > box->max.x[i]) box->max.x[i] = other->max.x[i];
+    }
+}
+
+// half the surface area, which orders the same
+static float halfArea(const R_Aabb* box)
+{
+    const float dx = box->max.x[0] - box->min.x[0];
+    const float dy = box->max.x[1] - box->min.x[1];
+    const float dz = box->max.x[2] - box->min.x[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+        return 0.0f;
+    return dx * dy + dy * dz + dz * dx;
+}
+
+// twice the centroid, which orders the same
+static float centroid(const R_Aabb* box, const int axis)
+{
+    return box->min.x[axis] + box->max.x[axis];
+}
+
+static R_Aabb itemBounds(const uint32_t* items, const uint32_t count, const R_Aabb* boxes)
+{
+    R_Aabb box = emptyBox;
+    for (uint32_t i = 0; i < count; i++)
+        growBox(&box, &boxes[items[i]]);
+    return box;
+}
+
+static void setNodeBox(R_RtNode* node, const R_Aabb* box)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        node->min[a] = box->min.x[a];
+        node->max[a] = box->max.x[a];
+    }
+}
+
+static int binOf(const float c, const float lo, const float scale)
+{
+    const int bin = (int)((c - lo) * scale);
+    return bin < 0 ? 0 : bin >= BIN_COUNT ? BIN_COUNT - 1 : bin;
+}
+
+// the split with the lowest surface area cost over the bins of all three
+// axes. returns the size of the first part after reordering the items, or
+// 0 if a leaf costs less. items that cannot be told apart by their
+// centroids are split in half once there are too many for a leaf.
+static uint32_t splitSah(uint32_t* items, const uint32_t count, const R_Aabb* boxes, const R_Aabb* bounds)
+{
+    float lo[3] = { FLT_MAX,  FLT_MAX,  FLT_MAX};
+    float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            const float c = centroid(&boxes[items[i]], a);
+            if (c < lo[a]) lo[a] = c;
+            if (c > hi[a]) hi[a] = c;
+        }
+    }
+
+    // costs are left relative to the area of the parent
+    float bestCost = ITEM_COST * count * halfArea(bounds);
+    int   bestAxis = -1;
+    int   bestBin  = 0;
+    for (int a = 0; a < 3; a++)
+    {
+        if (hi[a] <= lo[a])
+            continue;
+        const float scale = BIN_COUNT / (hi[a] - lo[a]);
+        uint32_t binCounts[BIN_COUNT] = {0};
+        R_Aabb   binBoxes[BIN_COUNT];
+        for (int b = 0; b < BIN_COUNT; b++)
+            binBoxes[b] = emptyBox;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const R_Aabb* box = &boxes[items[i]];
+            const int b = binOf(centroid(box, a), lo[a], scale);
+            binCounts[b]++;
+            growBox(&binBoxes[b], box);
+        }
+        // areas and counts right of each plane, then sweep from the left
+        float    rightArea[BIN_COUNT];
+        uint32_t rightCount[BIN_COUNT];
+        R_Aabb   box = emptyBox;
+        uint32_t n = 0;
+        for (int b = BIN_COUNT - 1; b > 0; b--)
+        {
+            growBox(&box, &binBoxes[b]);
+            n += binCounts[b];
+            rightArea[b]  = halfArea(&box);
+            rightCount[b] = n;
+        }
+        box = emptyBox;
+        n = 0;
+        for (int b = 1; b < BIN_COUNT; b++)
+        {
+            growBox(&box, &binBoxes[b - 1]);
+            n += binCounts[b - 1];
+            if (!n || !rightCount[b])
+                continue;
+            const float cost = NODE_COST * halfArea(bounds) +
+                ITEM_COST * (n * halfArea(&box) + rightCount[b] * rightArea[b]);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = a;
+                bestBin  = b;
+            }
+        }
+    }
+
+    if (bestAxis < 0)
+        return count > LEAF_SIZE ? count / 2 : 0;
+
+    const float scale = BIN_COUNT / (hi[bestAxis] - lo[bestAxis]);
+    uint32_t i = 0;
+    uint32_t j = count;
+    while (i < j)
+    {
+        if (binOf(centroid(&boxes[items[i]], bestAxis), lo[bestAxis], scale) < bestBin)
+            i++;
+        else
+        {
+            const uint32_t tmp = items[i];
+            items[i] = items[--j];
+            items[j] = tmp;
+        }
+    }
+    assert(i > 0 && i < count);
+    return i;
+}
+
+// children are taken from the nodes at *next on. a subtree over count items
+// has at most count - 1 inner nodes, so it takes no more than 2 * count.
+static void buildNode(R_RtBvh* bvh, const R_Aabb* boxes, const uint32_t node, const uint32_t first,
+        const uint32_t count, const uint32_t depth, uint32_t* next)
+{
+    R_RtNode* n = &bvh->nodes[node];
+    const R_Aabb bounds = itemBounds(bvh->items + first, count, boxes);
+    setNodeBox(n, &bounds);
+    const uint32_t left = count > 1 && depth < MAX_DEPTH ?
+        splitSah(bvh->items + first, count, boxes, &bounds) : 0;
+    if (!left)
+    {
+        n->first = first;
+        n->count = count;
+        return;
+    }
+    const uint32_t child = *next;
+    *next += 2;
+    n->first = child;
+    n->count = 0;
+    buildNode(bvh, boxes, child,     first,        left,         depth + 1, next);
+    buildNode(bvh, boxes, child + 1, first + left, count - left, depth + 1, next);
+}
+
+void r_RtBeginBuild(R_RtBuild* build, R_RtBvh* bvh, const R_Aabb* boxes, uint32_t count, uint32_t maxTasks)
+{
+    // small builds are not worth splitting, and every task costs two nodes
+    // at the top whether it is used or not
+    if (maxTasks > count / TASK_MIN_ITEMS + 1)
+        maxTasks = count / TASK_MIN_ITEMS + 1;
+    // the top of the tree comes first, then the subtree of every task at
+    // twice the position of its first item
+    const uint32_t topCount = 2 * maxTasks - 1;
+    bvh->nodeCount = topCount + 2 * count;
+    bvh->nodes     = realloc(bvh->nodes, bvh->nodeCount * sizeof(R_RtNode));
+    bvh->itemCount = count;
+    bvh->items     = realloc(bvh->items, (count ? count : 1) * sizeof(uint32_t));
+    assert(bvh->nodes && bvh->items);
+    for (uint32_t i = 0; i < count; i++)
+        bvh->items[i] = i;
+
+    build->bvh       = bvh;
+    build->boxes     = boxes;
+    build->tasks     = malloc(maxTasks * sizeof(R_RtBuildTask));
+    build->taskCount = 0;
+    assert(build->tasks);
+    if (!count)
+    {
+        bvh->nodes[0] = (R_RtNode){0};
+        setNodeBox(&bvh->nodes[0], &emptyBox);
+        return;
+    }
+
+    // the largest range is split until there are enough tasks. ranges that
+    // are too small or make a leaf stay whole.
+    build->tasks[build->taskCount++] = (R_RtBuildTask){.node = 0, .first = 0, .count = count};
+    uint32_t nextTop   = 1;
+    uint32_t whole     = 0; // the tasks before this one are not split further
+    while (build->taskCount < maxTasks && whole < build->taskCount)
+    {
+        uint32_t largest = whole;
+        for (uint32_t t = whole + 1; t < build->taskCount; t++)
+            if (build->tasks[t].count > build->tasks[largest].count)
+                largest = t;
+        R_RtBuildTask task = build->tasks[largest];
+        uint32_t left = 0;
+        R_Aabb bounds = emptyBox;
+        if (task.count >= TASK_MIN_ITEMS && task.depth < MAX_DEPTH)
+        {
+            bounds = itemBounds(bvh->items + task.first, task.count, boxes);
+            left   = splitSah(bvh->items + task.first, task.count, boxes, &bounds);
+        }
+        if (!left)
+        {
+            build->tasks[largest] = build->tasks[whole];
+            build->tasks[whole++] = task;
+            continue;
+        }
+        R_RtNode* n = &bvh->nodes[task.node];
+        setNodeBox(n, &bounds);
+        n->first = nextTop;
+        n->count = 0;
+        build->tasks[largest] = (R_RtBuildTask){nextTop, task.first, left, task.depth + 1};
+        build->tasks[build->taskCount++] =
+            (R_RtBuildTask){nextTop + 1, task.first + left, task.count - left, task.depth + 1};
+        nextTop += 2;
+    }
+    assert(nextTop <= topCount);
+}
+
+void r_RtBuildTask(const R_RtBuild* build, uint32_t task)
+{
+    assert(task < build->taskCount);
+    const R_RtBuildTask* t = &build->tasks[task];
+    const uint32_t topCount = build->bvh->nodeCount - 2 * build->bvh->itemCount;
+    uint32_t next = topCount + 2 * t->first;
+    buildNode(build->bvh, build->boxes, t->node, t->first, t->count, t->depth, &next);
+    assert(next <= topCount + 2 * (t->first + t->count));
+}
+
+void r_RtEndBuild(R_RtBuild* build)
+{
+    free(build->tasks);
+    build->tasks     = NULL;
+    build->taskCount = 0;
+}
+
+void r_RtFreeBvh(R_RtBvh* bvh)
+{
+    free(bvh->nodes);
+    free(bvh->items);
+    memset(bvh, 0, sizeof(*bvh));
+}
+
+void r_RtTriangleBoxes(const uint32_t* indices, uint32_t firstTriangle, uint32_t triangleCount,
+        const Vec3* positions, R_Aabb* boxes)
+{
+    for (uint32_t t = firstTriangle; t < firstTriangle + triangleCount; t++)
+    {
+        R_Aabb box = emptyBox;
+        for (int c = 0; c < 3; c++)
+        {
+            const Vec3* p = &positions[indices[t * 3 + c]];
+            growBox(&box, &(R_Aabb){*p, *p});
+        }
+        boxes[t] = box;
+    }
+}
+
+// packets
+
+typedef struct {
+    Lanes o[3];
+    Lanes d[3];
+    Lanes inv[3];
+} Rays;
+
+typedef struct {
+    Lanes t;      // the nearest hit so far, or the end of the rays
+    Mask  active; // lanes still traced
+    Mask  instance;
+    Mask  triangle;
+    Lanes u;
+    Lanes v;
+} Hits;
+
+// lanes are wider than the vector registers of the base x86-64 abi, which
+// passes them in memory and warns with -Wpsabi. the helpers on lanes are
+// macros or take pointers, so none is passed or returned by value.
+#define SPLAT(x)            ((Lanes){0} + (x))
+#define BLEND(m, a, b)      ((Lanes)(((m) & (Mask)(a)) | (~(m) & (Mask)(b))))
+#define BLEND_MASK(m, a, b) (((m) & (a)) | (~(m) & (b)))
+#define MIN_LANES(a, b)     BLEND((a) < (b), a, b)
+#define MAX_LANES(a, b)     BLEND((a) > (b), a, b)
+
+static bool anyLane(const Mask* m)
+{
+    for (int i = 0; i < LANE_COUNT; i++)
+        if ((*m)[i])
+            return true;
+    return false;
+}
+
+// directions along an axis get a huge inverse instead of an infinite one,
+// which keeps 0 * inf out of the box tests
+static void setInverse(Rays* rays)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        const Lanes d = BLEND(rays->d[a] == 0.0f, SPLAT(1e-30f), rays->d[a]);
+        rays->inv[a] = 1.0f / d;
+    }
+}
+
+static void hitBox(const R_RtNode* node, const Rays* rays, const Hits* hits, Mask* hit, Lanes* near)
+{
+    Lanes lo = SPLAT(0.0f);
+    Lanes hi = hits->t;
+    for (int a = 0; a < 3; a++)
+    {
+        const Lanes t0 = (node->min[a] - rays->o[a]) * rays->inv[a];
+        const Lanes t1 = (node->max[a] - rays->o[a]) * rays->inv[a];
+        lo = MAX_LANES(lo, MIN_LANES(t0, t1));
+        hi = MIN_LANES(hi, MAX_LANES(t0, t1));
+    }
+    *near = lo;
+    *hit  = (lo <= hi) & hits->active;
+}
+
+// the nearest entry of the lanes that hit
+static float nearestLane(const Lanes* near, const Mask* hit)
+{
+    float nearest = FLT_MAX;
+    for (int i = 0; i < LANE_COUNT; i++)
+        if ((*hit)[i] && (*near)[i] < nearest)
+            nearest = (*near)[i];
+    return nearest;
+}
+
+// moller trumbore, two sided. an any hit query stops the lanes that hit.
+static void hitTriangle(const R_RtMesh* mesh, const uint32_t triangle, const int32_t instance,
+        const Rays* rays, Hits* hits, const bool anyHit)
+{
+    const uint32_t* tri = &mesh->indices[triangle * 3];
+    const float* p0 = mesh->positions[tri[0]].x;
+    const float* p1 = mesh->positions[tri[1]].x;
+    const float* p2 = mesh->positions[tri[2]].x;
+    const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+    const Lanes px = rays->d[1] * e2[2] - rays->d[2] * e2[1];
+    const Lanes py = rays->d[2] * e2[0] - rays->d[0] * e2[2];
+    const Lanes pz = rays->d[0] * e2[1] - rays->d[1] * e2[0];
+    const Lanes det = px * e1[0] + py * e1[1] + pz * e1[2];
+    const Lanes inv = 1.0f / det;
+    const Lanes sx = rays->o[0] - p0[0];
+    const Lanes sy = rays->o[1] - p0[1];
+    const Lanes sz = rays->o[2] - p0[2];
+    const Lanes u = (sx * px + sy * py + sz * pz) * inv;
+    const Lanes qx = sy * e1[2] - sz * e1[1];
+    const Lanes qy = sz * e1[0] - sx * e1[2];
+    const Lanes qz = sx * e1[1] - sy * e1[0];
+    const Lanes v = (rays->d[0] * qx + rays->d[1] * qy + rays->d[2] * qz) * inv;
+    const Lanes t = (e2[0] * qx + e2[1] * qy + e2[2] * qz) * inv;
+
+    // a degenerate triangle has an infinite inverse, which fails every
+    // comparison below through the nans it makes
+    const Mask hit = hits->active & (u >= 0.0f) & (v >= 0.0f) & (u + v <= 1.0f) &
+        (t > 0.0f) & (t < hits->t);
+    if (!anyLane(&hit))
+        return;
+    if (anyHit)
+    {
+        hits->active &= ~hit;
+        return;
+    }
+    hits->t        = BLEND(hit, t, hits->t);
+    hits->u        = BLEND(hit, u, hits->u);
+    hits->v        = BLEND(hit, v, hits->v);
+    hits->instance = BLEND_MASK(hit, (Mask){0} + instance, hits->instance);
+    hits->triangle = BLEND_MASK(hit, (Mask){0} + (int32_t)triangle, hits->triangle);
+}
+
+static void traverse(const R_RtScene* scene, const R_RtMesh* mesh, int32_t instance, const Rays* rays,
+        Hits* hits, bool anyHit);
+
+// the rays in the space of the instance. directions are not normalized
+// again, so distances along them stay those of the world.
+static void traceInstance(const R_RtScene* scene, const uint32_t id, const Rays* rays, Hits* hits,
+        const bool anyHit)
+{
+    const R_RtInstance* instance = &scene->instances[id];
+    const float (*m)[4] = instance->toObject.x;
+    Rays local;
+    for (int c = 0; c < 3; c++)
+    {
+        local.o[c] = rays->o[0] * m[0][c] + rays->o[1] * m[1][c] + rays->o[2] * m[2][c] + m[3][c];
+        local.d[c] = rays->d[0] * m[0][c] + rays->d[1] * m[1][c] + rays->d[2] * m[2][c];
+    }
+    setInverse(&local);
+    traverse(scene, &scene->meshes[instance->mesh], id, &local, hits, anyHit);
+}
+
+// walks the hierarchy of the mesh, or of the instances if mesh is NULL.
+// nearer children go first; the others are tested again when they come off
+// the stack, as the hits may have moved closer since.
+static void traverse(const R_RtScene* scene, const R_RtMesh* mesh, int32_t instance, const Rays* rays,
+        Hits* hits, bool anyHit)
+{
+    const R_RtBvh* bvh = mesh ? mesh->bvh : scene->bvh;
+    // the root box of an empty hierarchy is inside out, which the box test
+    // does not catch
+    if (!bvh->itemCount)
+        return;
+    const R_RtNode* nodes = bvh->nodes;
+    uint32_t stack[STACK_SIZE];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while (top)
+    {
+        const R_RtNode* node = &nodes[stack[--top]];
+        Mask  hit;
+        Lanes near;
+        hitBox(node, rays, hits, &hit, &near);
+        if (!anyLane(&hit))
+            continue;
+        while (!node->count)
+        {
+            const R_RtNode* left  = &nodes[node->first];
+            const R_RtNode* right = left + 1;
+            Mask  hitLeft, hitRight;
+            Lanes nearLeft, nearRight;
+            hitBox(left,  rays, hits, &hitLeft,  &nearLeft);
+            hitBox(right, rays, hits, &hitRight, &nearRight);
+            const bool anyLeft  = anyLane(&hitLeft);
+            const bool anyRight = anyLane(&hitRight);
+            if (anyLeft && anyRight)
+            {
+                const bool leftFirst = nearestLane(&nearLeft, &hitLeft) <= nearestLane(&nearRight, &hitRight);
+                assert(top < STACK_SIZE);
+                stack[top++] = (leftFirst ? right : left) - nodes;
+                node = leftFirst ? left : right;
+            }
+            else if (anyLeft || anyRight)
+                node = anyLeft ? left : right;
+            else
+                break;
+        }
+        if (!node->count)
+            continue;
+        for (uint32_t i = node->first; i < node->first + node->count; i++)
+        {
+            if (mesh)
+                hitTriangle(mesh, bvh->items[i], instance, rays, hits, anyHit);
+            else
+                traceInstance(scene, bvh->items[i], rays, hits, anyHit);
+            if (anyHit && !anyLane(&hits->active))
+                return;
+        }
+    }
+}
+
+// shading
+
+static uint32_t hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static float toUnit(const uint32_t x)
+{
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static float dot3(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void normalize3(float v[3])
+{
+    const float length = sqrtf(dot3(v, v));
+    const float scale  = length > 0.0f ? 1.0f / length : 0.0f;
+    for (int a = 0; a < 3; a++)
+        v[a] *= scale;
+}
+
+static uint32_t toUnorm8(const float x)
+{
+    return x <= 0.0f ? 0 : x >= 1.0f ? 255 : (uint32_t)(x * 255.0f + 0.5f);
+}
+
+static uint32_t packColor(const Vec4* color, const float light)
+{
+    return toUnorm8(color->x[0] * light) | toUnorm8(color->x[1] * light) << 8 |
+        toUnorm8(color->x[2] * light) << 16 | toUnorm8(color->x[3]) << 24;
+}
+
+// rounds to nearest. values too small for a normal half are flushed to
+// zero and nans are not expected.
+static uint16_t toHalf(const float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const uint16_t sign     = (bits >> 16) & 0x8000;
+    const int32_t  exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    const uint32_t mantissa = bits & 0x7fffff;
+    if (exponent <= 0)
+        return sign;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    const uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    return sign | (uint16_t)(half + ((mantissa >> 12) & 1));
+}
+
+// point p times the row vector transform m, divided by w
+static void projectPoint(const Mat4* m, const float p[4], float out[4])
+{
+    for (int c = 0; c < 4; c++)
+        out[c] = p[0] * m->x[0][c] + p[1] * m->x[1][c] + p[2] * m->x[2][c] + p[3] * m->x[3][c];
+}
+
+// a cosine weighted direction around the unit normal n
+static void sampleHemisphere(const float n[3], const float u1, const float u2, float dir[3])
+{
+    const float sign = copysignf(1.0f, n[2]);
+    const float a = -1.0f / (sign + n[2]);
+    const float b = n[0] * n[1] * a;
+    const float t[3] = {1.0f + sign * n[0] * n[0] * a, sign * b, -sign * n[0]};
+    const float s[3] = {b, sign + n[1] * n[1] * a, -n[1]};
+    const float r   = sqrtf(u1);
+    const float phi = 6.2831853f * u2;
+    const float x = r * cosf(phi);
+    const float y = r * sinf(phi);
+    const float z = sqrtf(1.0f - u1);
+    for (int c = 0; c < 3; c++)
+        dir[c] = x * t[c] + y * s[c] + z * n[c];
+}
+
+typedef struct {
+    float position[3];
+    float normal[3];  // unit length, facing the ray
+    Vec4  color;
+} Surface;
+
+static Surface getSurface(const R_RtScene* scene, const Rays* rays, const Hits* hits, const int lane)
+{
+    const R_RtInstance* instance = &scene->instances[hits->instance[lane]];
+    const R_RtMesh*     mesh     = &scene->meshes[instance->mesh];
+    const uint32_t  triangle = hits->triangle[lane];
+    const uint32_t* tri = &mesh->indices[triangle * 3];
+    const float u = hits->u[lane];
+    const float v = hits->v[lane];
+    const float w = 1.0f - u - v;
+
+    Surface s;
+    const float d[3] = {rays->d[0][lane], rays->d[1][lane], rays->d[2][lane]};
+    for (int a = 0; a < 3; a++)
+        s.position[a] = rays->o[a][lane] + hits->t[lane] * d[a];
+
+    float n[3];
+    if (mesh->normals)
+    {
+        for (int a = 0; a < 3; a++)
+            n[a] = w * mesh->normals[tri[0]].x[a] + u * mesh->normals[tri[1]].x[a] +
+                v * mesh->normals[tri[2]].x[a];
+    }
+    else
+    {
+        const float* p0 = mesh->positions[tri[0]].x;
+        const float* p1 = mesh->positions[tri[1]].x;
+        const float* p2 = mesh->positions[tri[2]].x;
+        const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+    // normals go to the world by the transpose of the inverse
+    const float (*m)[4] = instance->toObject.x;
+    for (int a = 0; a < 3; a++)
+        s.normal[a] = n[0] * m[a][0] + n[1] * m[a][1] + n[2] * m[a][2];
+    normalize3(s.normal);
+    if (dot3(s.normal, d) > 0.0f)
+        for (int a = 0; a < 3; a++)
+            s.normal[a] = -s.normal[a];
+
+    s.color = instance->color;
+    if (mesh->pointColors)
+    {
+        for (int c = 0; c < 4; c++)
+            s.color.x[c] *= w * mesh->pointColors[tri[0]].x[c] + u * mesh->pointColors[tri[1]].x[c] +
+                v * mesh->pointColors[tri[2]].x[c];
+    }
+    if (mesh->triangleColors)
+    {
+        for (int c = 0; c < 4; c++)
+            s.color.x[c] *= mesh->triangleColors[triangle].x[c];
+    }
+    return s;
+}
+
+// the fraction of the ambient occlusion rays of each lane that escape, into
+// open. the lanes of a packet are neighbouring pixels, so their rays start
+// close together and go roughly the same way.
+static void ambientOcclusion(const R_RtScene* scene, const R_RtView* view, const Surface* surfaces,
+        const Mask* hit, const uint32_t* pixels, Lanes* open)
+{
+    const float distance = view->aoDistance > 0.0f ? view->aoDistance : FLT_MAX;
+    *open = SPLAT(0.0f);
+    for (uint32_t sample = 0; sample < view->aoSamples; sample++)
+    {
+        Rays rays;
+        for (int lane = 0; lane < LANE_COUNT; lane++)
+        {
+            const Surface* s = &surfaces[lane];
+            float dir[3] = {0.0f, 0.0f, 1.0f};
+            float bias = 0.0f;
+            if ((*hit)[lane])
+            {
+                const uint32_t seed = hash(pixels[lane] * 0x9e3779b9U + sample);
+                sampleHemisphere(s->normal, toUnit(seed), toUnit(hash(seed)), dir);
+                for (int a = 0; a < 3; a++)
+                    bias = fmaxf(bias, fabsf(s->position[a]));
+                bias = 1e-4f * (1.0f + bias);
+            }
+            for (int a = 0; a < 3; a++)
+            {
+                rays.o[a][lane] = s->position[a] + bias * s->normal[a];
+                rays.d[a][lane] = dir[a];
+            }
+        }
+        setInverse(&rays);
+        Hits hits = {.t = SPLAT(distance), .active = *hit};
+        traverse(scene, NULL, -1, &rays, &hits, true);
+        *open += BLEND(hits.active, SPLAT(1.0f), SPLAT(0.0f));
+    }
+    *open = view->aoSamples ? *open / (float)view->aoSamples : SPLAT(1.0f);
+}
+
+uint32_t r_RtTileCount(const R_RtTarget* target)
+{
+    const uint32_t across = (target->width  + R_RT_TILE_SIZE - 1) / R_RT_TILE_SIZE;
+    const uint32_t up     = (target->height + R_RT_TILE_SIZE - 1) / R_RT_TILE_SIZE;
+    return across * up;
+}
+
+// rays go from the near plane to the far plane, so the hits of primary rays
+// are at t between 0 and 1
+static void tracePacket(const R_RtScene* scene, const R_RtView* view, const R_RtTarget* target,
+        const uint32_t x0, const uint32_t y0)
+{
+    Rays rays;
+    Hits hits = {.t = SPLAT(1.0f), .instance = (Mask){0} - 1};
+    uint32_t pixels[LANE_COUNT];
+    for (int lane = 0; lane < LANE_COUNT; lane++)
+    {
+        const uint32_t x = x0 + lane % PACKET_WIDTH;
+        const uint32_t y = y0 + lane / PACKET_WIDTH;
+        const bool inside = x < target->width && y < target->height;
+        pixels[lane] = inside ? y * target->width + x : 0;
+        hits.active[lane] = inside ? -1 : 0;
+        const float ndcX = 2.0f * (x + 0.5f) / target->width  - 1.0f;
+        const float ndcY = 2.0f * (y + 0.5f) / target->height - 1.0f;
+        float near[4], far[4];
+        projectPoint(&view->fromClip, (float[4]){ndcX, ndcY, -1.0f, 1.0f}, near);
+        projectPoint(&view->fromClip, (float[4]){ndcX, ndcY,  1.0f, 1.0f}, far);
+        for (int a = 0; a < 3; a++)
+        {
+            const float o = near[a] / near[3];
+            rays.o[a][lane] = o;
+            rays.d[a][lane] = far[a] / far[3] - o;
+        }
+    }
+    setInverse(&rays);
+    const Mask inside = hits.active;
+    traverse(scene, NULL, -1, &rays, &hits, false);
+
+    const Mask hit = inside & (hits.instance >= 0);
+    Surface surfaces[LANE_COUNT] = {0};
+    for (int lane = 0; lane < LANE_COUNT; lane++)
+        if (hit[lane])
+            surfaces[lane] = getSurface(scene, &rays, &hits, lane);
+    Lanes open = SPLAT(1.0f);
+    if (anyLane(&hit))
+        ambientOcclusion(scene, view, surfaces, &hit, pixels, &open);
+
+    for (int lane = 0; lane < LANE_COUNT; lane++)
+    {
+        if (!inside[lane])
+            continue;
+        const uint32_t pixel = pixels[lane];
+        const Surface* s = &surfaces[lane];
+        if (target->color)
+        {
+            uint32_t color = packColor(&missColor, 1.0f);
+            if (hit[lane])
+            {
+                // lit from the eye, from both sides, as the raster path
+                float d[3] = {rays.d[0][lane], rays.d[1][lane], rays.d[2][lane]};
+                normalize3(d);
+                const float light = (0.2f + 0.8f * fabsf(dot3(s->normal, d))) * open[lane];
+                color = packColor(&s->color, light);
+            }
+            target->color[pixel] = color;
+        }
+        if (target->depth)
+        {
+            float depth = MISS_DEPTH;
+            if (hit[lane])
+            {
+                float clip[4];
+                projectPoint(&view->toClip, (float[4]){s->position[0], s->position[1], s->position[2], 1.0f},
+                        clip);
+                depth = clip[2] / clip[3];
+            }
+            target->depth[pixel] = depth;
+        }
+        if (target->primId)
+            target->primId[pixel] = hit[lane] ? scene->instances[hits.instance[lane]].pickId : MISS_PRIM_ID;
+        if (target->normal)
+        {
+            for (int a = 0; a < 3; a++)
+                target->normal[pixel * 4 + a] = toHalf(hit[lane] ? s->normal[a] : 0.0f);
+            target->normal[pixel * 4 + 3] = toHalf(0.0f);
+        }
+    }
+}
+
+void r_RtTraceTile(const R_RtScene* scene, const R_RtView* view, const R_RtTarget* target, uint32_t tile)
+{
+    const uint32_t across = (target->width + R_RT_TILE_SIZE - 1) / R_RT_TILE_SIZE;
+    const uint32_t x0 = (tile % across) * R_RT_TILE_SIZE;
+    const uint32_t y0 = (tile / across) * R_RT_TILE_SIZE;
+    for (uint32_t y = y0; y < y0 + R_RT_TILE_SIZE && y < target->height; y += LANE_COUNT / PACKET_WIDTH)
+        for (uint32_t x = x0; x < x0 + R_RT_TILE_SIZE && x < target->width; x += PACKET_WIDTH)
+            tracePacket(scene, view, target, x, y);
+}
@@ -0,0 +1,121 @@
+#ifndef VIEWER_R_RAYTRACE_H
+#define VIEWER_R_RAYTRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <tanto/m_math.h>
+#include "bvh.h"
+
+// ray tracing on the cpu, for MODE_RAY. a scene has two levels of binary
+// hierarchies built with the surface area heuristic: one over the triangles
+// of each mesh in its own space and one over the instances of the meshes in
+// world space. rays are traced in packets of R_RT_PACKET_SIZE, one per lane
+// of a SIMD vector, and images in tiles of R_RT_TILE_SIZE squared pixels.
+// builds are split into tasks and images into tiles; both touch nothing but
+// their arguments, so any number of them may run on threads at once.
+
+#define R_RT_PACKET_SIZE 8
+#define R_RT_TILE_SIZE   16
+
+// children of an inner node are stored next to each other from first. a
+// leaf holds count items from first in the items of the hierarchy.
+typedef struct {
+    float    min[3];
+    uint32_t first;
+    float    max[3];
+    uint32_t count; // 0 for inner nodes
+} R_RtNode;
+
+// the nodes are not packed: a build leaves gaps between the parts its tasks
+// wrote. node 0 is the root; an empty hierarchy has an empty root box.
+typedef struct {
+    uint32_t  nodeCount;
+    R_RtNode* nodes;
+    uint32_t  itemCount;
+    uint32_t* items;
+} R_RtBvh;
+
+// a subtree over count items from first, with its root at node
+typedef struct {
+    uint32_t node;
+    uint32_t first;
+    uint32_t count;
+    uint32_t depth;
+} R_RtBuildTask;
+
+typedef struct {
+    R_RtBvh*       bvh;
+    const R_Aabb*  boxes;
+    uint32_t       taskCount;
+    R_RtBuildTask* tasks;
+} R_RtBuild;
+
+// starts a build of bvh over count boxes, indexed by item id. the top of the
+// hierarchy is split right away, until there are up to maxTasks subtrees
+// left to build; small builds get fewer. the boxes must live until
+// r_RtEndBuild.
+void r_RtBeginBuild(R_RtBuild* build, R_RtBvh* bvh, const R_Aabb* boxes, uint32_t count, uint32_t maxTasks);
+// builds one of the subtrees. the tasks of a build write to disjoint nodes.
+void r_RtBuildTask(const R_RtBuild* build, uint32_t task);
+void r_RtEndBuild(R_RtBuild* build);
+void r_RtFreeBvh(R_RtBvh* bvh);
+
+// boxes of triangleCount triangles from firstTriangle on, indexed by
+// triangle
+void r_RtTriangleBoxes(const uint32_t* indices, uint32_t firstTriangle, uint32_t triangleCount,
+        const Vec3* positions, R_Aabb* boxes);
+
+// a triangle mesh in its own space, with its hierarchy over its triangles
+typedef struct {
+    const Vec3*     positions;
+    const uint32_t* indices; // three per triangle
+    // one per position, or NULL. meshes without normals are shaded flat.
+    const Vec3*     normals;
+    // rgb and opacity multiplied into the color of the instance. one per
+    // position or per triangle, or NULL.
+    const Vec4*     pointColors;
+    const Vec4*     triangleColors;
+    const R_RtBvh*  bvh;
+} R_RtMesh;
+
+// transforms take row vectors, as Gf stores them: the rows are the images
+// of the axes and of the origin
+typedef struct {
+    Mat4     toWorld;
+    Mat4     toObject;
+    Vec4     color;
+    uint32_t mesh;
+    int32_t  pickId;
+} R_RtInstance;
+
+typedef struct {
+    const R_RtMesh*     meshes;
+    const R_RtInstance* instances;
+    // over the instances, with their boxes in world space
+    const R_RtBvh*      bvh;
+} R_RtScene;
+
+typedef struct {
+    // world to clip space, the view then the projection, and back
+    Mat4     toClip;
+    Mat4     fromClip;
+    // ambient occlusion rays per pixel, 0 for none, and their length
+    uint32_t aoSamples;
+    float    aoDistance;
+} R_RtView;
+
+// the aovs in the formats the raster path writes them, NULL for those not
+// wanted. rows go up from the bottom of the image.
+typedef struct {
+    uint32_t  width;
+    uint32_t  height;
+    uint32_t* color;  // unorm rgba8
+    float*    depth;  // clip z over w
+    int32_t*  primId; // pick id of the instance hit, -1 for none
+    uint16_t* normal; // world space, rgba half floats
+} R_RtTarget;
+
+uint32_t r_RtTileCount(const R_RtTarget* target);
+void r_RtTraceTile(const R_RtScene* scene, const R_RtView* view, const R_RtTarget* target, uint32_t tile);
+
+#endif /* end of include guard: VIEWER_R_RAYTRACE_H */
@@ -1,8 +1,14 @@
 #include "render.h"
+#include "arena.h"
+#include "bvh.h"
+#include "meshlet.h"
+#include "staging.h"
 #include "tanto/m_math.h"
 #include "tanto/v_image.h"
 #include "tanto/v_memory.h"
 #include <memory.h>
+#include <math.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
@@ -17,12 +23,34 @@
 
 #define SPVDIR "./shaders/spv"
 
-#define MAX_PRIM_COUNT 100
+// initial slot count of the per-prim storage buffers. they double whenever
+// they run out of room, so this only has to be small.
+#define INIT_PRIM_CAPACITY 64
 
-typedef struct {
-    int foo;
-    int bar;
-} PushConstants;
+// initial sizes of the shared geometry buffers, in vertices and indices. they
+// double as well.
+#define INIT_VERTEX_CAPACITY (1 << 16)
+#define INIT_INDEX_CAPACITY  (1 << 18)
+
+// initial size of the instance buffer, in instances. doubles as well.
+#define INIT_INSTANCE_CAPACITY (1 << 12)
+
+// initial size of the meshlet buffer, in meshlets. doubles as well.
+#define INIT_MESHLET_CAPACITY (1 << 12)
+
+// initial size of the face color buffer, in triangles. doubles as well.
+#define INIT_FACE_COLOR_CAPACITY (1 << 16)
+
+// meshlets per workgroup of meshlet.comp
+#define MESHLET_GROUP_SIZE 64
+
+// instance indices from here on address the instance buffer, those below are
+// prim ids of prims drawn once. must match flat.vert.
+#define INSTANCE_ID_BASE (1u << 24)
+
+// prim slots are partitioned into chunks of this many draws, each recorded
+// into its own secondary command buffer.
+#define CHUNK_PRIM_COUNT 4096
 
 typedef struct {
     Mat4 matView;
@@ -31,58 +59,493 @@ typedef struct {
     Mat4 projInv;
 } CameraUBO;
 
-typedef struct {
-    Mat4 xform[MAX_PRIM_COUNT];
-} TransformsUBO;
-
-typedef struct {
-   Tanto_R_Material material[MAX_PRIM_COUNT]; 
-} MaterialsUBO;
+// slices are addressed with dynamic offsets, which must be aligned to
+// minUniformBufferOffsetAlignment. the spec caps that limit at 256.
+_Static_assert(sizeof(CameraUBO) % 256 == 0, "camera slices must stay 256 byte aligned");
 
-static Tanto_V_Image attachmentColor;
+// every frame slot renders into color attachments of its own, one per
+// enabled aov, which hold the frame until the slot is used again. clients
+// sample them in place or read them back on demand. the depth attachment is
+// only needed while drawing and shared by the slots; the depth aov is a copy
+// the fragment shader writes.
+static Tanto_V_Image attachmentAovs[R_FRAME_COUNT][R_AOV_COUNT];
 static Tanto_V_Image attachmentDepth;
+static uint32_t      aovMask = R_AOV_BIT(R_AOV_COLOR);
+
+// with more than one sample the frame is drawn into multisampled aovs,
+// shared by the slots like the depth attachment, and resolved into the
+// images of its slot at the end
+static Tanto_V_Image         attachmentSamples[R_AOV_COUNT];
+static VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
 
 static VkRenderPass  renderpass;
-static VkFramebuffer framebuffer;
+static VkFramebuffer framebuffers[R_FRAME_COUNT];
 static VkPipeline    pipelineMain;
 
-static const VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+// with occlusion culling a frame draws in two passes over the same
+// framebuffer. the first clears and keeps the color attachments for the
+// second, which loads both attachments.
+static VkRenderPass  renderpassOcclusion;
+static VkRenderPass  renderpassLoad;
+static VkPipeline    pipelineCull;
+static VkPipeline    pipelineHiZ;
+static VkPipeline    pipelineMeshlet;
+static VkSampler     depthSampler;
+
+// the aovs are the color attachments of the subpass, at the locations of
+// their fragment shader outputs. disabled ones are left unused.
+static const VkFormat aovFormats[R_AOV_COUNT] = {
+    [R_AOV_COLOR]   = VK_FORMAT_R8G8B8A8_UNORM,
+    [R_AOV_DEPTH]   = VK_FORMAT_R32_SFLOAT,
+    [R_AOV_PRIM_ID] = VK_FORMAT_R32_SINT,
+    [R_AOV_NORMAL]  = VK_FORMAT_R16G16B16A16_SFLOAT
+};
+static const uint32_t aovTexelSizes[R_AOV_COUNT] = {
+    [R_AOV_COLOR]   = 4,
+    [R_AOV_DEPTH]   = 4,
+    [R_AOV_PRIM_ID] = 4,
+    [R_AOV_NORMAL]  = 8
+};
+static const VkClearValue aovClears[R_AOV_COUNT] = {
+    [R_AOV_COLOR]   = {.color.float32 = {0.002f, 0.023f, 0.009f, 1.0f}},
+    [R_AOV_DEPTH]   = {.color.float32 = {1.0f}},
+    [R_AOV_PRIM_ID] = {.color.int32   = {-1}},
+    [R_AOV_NORMAL]  = {.color.float32 = {0.0f}}
+};
+// finished frames are left ready to be sampled
+static const VkImageLayout frameImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 static const VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
 
-static Tanto_V_CommandPool cmdPoolRender;
-static Tanto_V_CommandPool cmdPoolTransfer;
+// geometry buffers live in device local memory. growing them copies the old
+// contents over on the graphics queue with this pool.
+static Tanto_V_CommandPool cmdPoolGrowth;
+// frames are copied to the host with this one, only when they are asked for
+static Tanto_V_CommandPool cmdPoolReadback;
+
+#define NO_RANGE UINT32_MAX
+
+// reference counted range of one of the geometry arenas. narrow index sets
+// pack two 16 bit indices into each element of the index arena; their count
+// is the number of indices.
+typedef struct {
+    uint32_t offset;
+    uint32_t count;
+    uint32_t refCount;
+    bool     narrow;
+} SharedRange;
+
+// shared ranges of one arena, addressed by id. released ids go on the free
+// list like prim slots.
+typedef struct {
+    uint32_t     count;
+    uint32_t     capacity;
+    uint32_t     freeCount;
+    uint32_t*    freeSlots;
+    SharedRange* ranges;
+} RangeTable;
+
+// vertex sets are created with each prim upload and shared by the prims added
+// with r_AddPrimInstance. index sets are Tanto_IndexSetIds. meshlet and face
+// color sets are shared along with the vertices they belong to.
+static RangeTable vertexSets;
+static RangeTable indexSets;
+static RangeTable meshletSets;
+static RangeTable faceColorSets;
+
+_Static_assert(R_INDEX_SET_NONE == NO_RANGE, "index sets are plain range ids");
+
+// the vertex and index set a prim is drawn with and the object space bounds
+// of its vertices. prims without normals are shaded flat, those without
+// vertex colors in their material color. lodSets are coarser index sets over
+// the same vertices, finest first, and lodErrors their object space error.
+// meshletSet splits the index set into meshlets, if the prim has them.
+// faceColorSet colors its triangles one by one; prims with one are always
+// drawn whole.
+typedef struct {
+    uint32_t vertexSet;
+    uint32_t indexSet;
+    uint32_t meshletSet;
+    uint32_t faceColorSet;
+    R_Aabb   bounds;
+    bool     hasNormals;
+    bool     hasColors;
+    uint32_t lodCount;
+    uint32_t lodSets[R_MAX_LODS];
+    float    lodErrors[R_MAX_LODS];
+} PrimGeo;
+
+static const PrimGeo emptyGeo = { 
+    .vertexSet = NO_RANGE, .indexSet = NO_RANGE, .meshletSet = NO_RANGE, .faceColorSet = NO_RANGE 
+};
+
+// layout of an instance in the instance buffer. rows holds the top three rows
+// of the instance transform and color is packed unorm rgba8.
+typedef struct {
+    Vec4     rows[3];
+    uint32_t color;
+    uint32_t primId;
+    uint32_t pad[2];
+} InstanceData;
+
+_Static_assert(sizeof(InstanceData) == 64, "InstanceData must match flat.vert");
+
+// how the shaders read the vertex data of a prim. positions map to object
+// space as pos * scale + offset: compact positions are fractions of the prim
+// bounds, the others are stored as they are. flags tells which of normals
+// and vertex colors the prim has; firstFaceColor is where its colors in the
+// face color buffer start, NO_RANGE if it has none.
+typedef struct {
+    Vec3     offset;
+    uint32_t flags;
+    Vec3     scale;
+    uint32_t firstFaceColor;
+} PrimAttributes;
+
+_Static_assert(sizeof(PrimAttributes) == 32, "PrimAttributes must match flat.vert and flat.frag");
+
+// PrimAttributes flags. must match flat.vert.
+#define ATTRIBUTE_NORMALS 0x1
+#define ATTRIBUTE_COLORS  0x2
+
+// compact position, read as unorm by the vertex shader. w is padding, three
+// component 16 bit formats are rarely supported for vertex input.
+typedef struct {
+    uint16_t x[4];
+} PackedPosition;
+
+// see r_SetCompactVertices. the strides of the vertex buffers follow from it.
+static bool         compactVertices;
+static VkDeviceSize positionSize = sizeof(Vec3);
+static VkDeviceSize colorSize    = sizeof(Vec4);
+
+// layout of a meshlet in the meshlet buffer. the bounds are in the object
+// space of the prim and firstIndex is relative to its index set.
+typedef struct {
+    R_MeshletBounds bounds;
+    uint32_t        firstIndex;
+    uint32_t        indexCount;
+    uint32_t        pad[2];
+} MeshletData;
+
+_Static_assert(sizeof(MeshletData) == 48, "MeshletData must match meshlet.comp");
 
+// range of a prim in the instance buffer. prims that are not instanced draw
+// once with their own transform. for culling, origins bounds the instance
+// translations and maxScale the norm of their linear parts.
+typedef struct {
+    uint32_t offset;
+    uint32_t count;
+    bool     instanced;
+    R_Aabb   origins;
+    float    maxScale;
+} PrimInstances;
+
+// the scene is stored as parallel arrays indexed by prim id. transforms and
+// materials live directly in the buffers the GPU reads. draws holds the draw
+// command of every prim; the visible ones are copied to the draw buffer of a
+// frame slot when it is submitted. removed prims leave a hole that is put on
+// the free list and reused by the next new prim. primCount is the high water
+// mark of used slots.
 static struct {
-    uint16_t          primCount;
-    CameraUBO*        camera;
-    Tanto_R_Primitive primitive[MAX_PRIM_COUNT];
-    Mat4*             transforms;
-    Tanto_R_Material* materials;
+    uint32_t                      primCount;
+    uint32_t                      primCapacity;
+    uint32_t                      liveCount;
+    uint32_t                      freeCount;
+    uint32_t*                     freeSlots;
+    CameraUBO*                    camera;
+    Mat4*                         transforms;
+    Tanto_R_Material*             materials;
+    PrimAttributes*               attributes;
+    int32_t*                      pickIds;
+    VkDrawIndexedIndirectCommand* draws;
+    PrimGeo*                      geos;
+    PrimInstances*                instances;
 } scene;
 
+// all prim vertices and indices are sub-allocated from these
+static struct {
+    R_Arena vertexArena;
+    R_Arena indexArena;
+    R_Arena instanceArena;
+    R_Arena meshletArena;
+    R_Arena faceColorArena;
+} geometry;
+
+// geometry that is no longer referenced by the scene but may still be read by
+// a submitted frame. released once frameCompleted reaches retireFrame.
+typedef struct {
+    R_Arena* arena;
+    uint32_t offset;
+    uint32_t count;
+    uint64_t retireFrame;
+} RetiredRange;
+
+static struct {
+    uint32_t      count;
+    uint32_t      capacity;
+    RetiredRange* entries;
+} retired;
+
+// world space bounds of every prim and the hierarchy over those that draw
+// anything. boundsDirty is set by every change that may move a prim and
+// bvhDirty by every change of its draw, which may add it to or remove it from
+// the hierarchy. version is bumped by those and by camera changes; a frame
+// slot culls again only if it is newer than the one it last culled at.
+static struct {
+    R_Aabb*   worldBounds;
+    uint64_t* visible;
+    uint32_t* ids;
+    R_Bvh     bvh;
+    bool      boundsDirty;
+    bool      bvhDirty;
+    uint64_t  version;
+} culling;
+
+// see r_SetLodThreshold
+static float lodThreshold = 1.0f;
+
+// what picking a level of detail needs to know about the camera of a frame.
+// pixelScale is the number of pixels a unit length covers at distance 1, or
+// anywhere for orthographic cameras, divided by the threshold.
+typedef struct {
+    Vec3  eye;
+    float pixelScale;
+    bool  perspective;
+} LodView;
+
+// world space bounds of a candidate draw as the cull shader reads them.
+// narrow draws go to their own list, they bind a different index type.
+typedef struct {
+    Vec3     min;
+    uint32_t primId;
+    Vec3     max;
+    uint32_t narrow;
+} CullBounds;
+
+_Static_assert(sizeof(CullBounds) == 32, "CullBounds must match cull.comp");
+
+// the candidate bounds start with their count, the meshlet work with its
+// dispatch and the capacity of a draw list
+#define CULL_HEADER_SIZE 16
+
+// must match hiz.glsl
+typedef struct {
+    uint32_t phase;
+    uint32_t drawCapacity;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+} CullPushConstants;
+
+// a buffer with one slice per frame slot, addressed with dynamic offsets
+// like the camera
+typedef struct {
+    Tanto_V_BufferRegion region;
+    VkDeviceSize         sliceSize;
+} SlotBuffer;
+
+// the draws that survive CPU culling, per frame slot. without occlusion
+// culling the GPU draws straight from here.
+static SlotBuffer drawBuffer;
+
+// GPU occlusion culling. the prims that pass the frustum test on the CPU
+// are the candidates; a compute pass tests them against a depth pyramid and
+// writes the draws of the raster passes. tanto creates the device without
+// drawIndirectCount, so every candidate keeps its place in the lists and
+// the commands are recorded for candidateCounts draws, the candidates each
+// slot wrote.
+static struct {
+    bool                 enabled;
+    uint32_t             candidateCounts[R_FRAME_COUNT];
+    uint32_t             recordedCounts[R_FRAME_COUNT];
+    SlotBuffer           bounds;
+    SlotBuffer           output;
+    Tanto_V_BufferRegion visibility;
+    Tanto_V_BufferRegion hiz;
+    uint32_t             levelCount;
+} occlusion;
+
+// a group of up to MESHLET_GROUP_SIZE meshlets of one prim, culled by one
+// workgroup of meshlet.comp. firstDraw is where their draws go in the list
+// of their index width.
+typedef struct {
+    uint32_t primId;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t firstDraw;
+    uint32_t firstIndex;
+    int32_t  vertexOffset;
+    uint32_t narrow;
+    uint32_t pad;
+} MeshletWork;
+
+_Static_assert(sizeof(MeshletWork) == 32, "MeshletWork must match meshlet.comp");
+
+// prims with meshlets that are visible at full detail leave their draw to
+// meshlet.comp, which culls each of their meshlets against the frustum and
+// by its normal cone. work holds the groups a frame slot dispatches, after
+// the VkDispatchIndirectCommand that dispatches them and the capacity of a
+// draw list, and output the draws of the meshlets, in one list per index
+// width. every list has room for a draw per meshlet. drawCounts are the
+// meshlets each slot queued per list.
+static struct {
+    SlotBuffer      work;
+    SlotBuffer      output;
+    uint32_t        drawCounts[R_FRAME_COUNT][2];
+    uint32_t        recordedCounts[R_FRAME_COUNT][2];
+    uint64_t        recordedVersions[R_FRAME_COUNT];
+    VkCommandBuffer cmds[R_FRAME_COUNT];
+} meshlets;
+
+static uint64_t frameSubmitted;
+static uint64_t frameCompleted;
+// frames before this one were rendered into targets that are gone
+static uint64_t firstHeldFrame = 1;
+
+// host copies of aovs, made at the end of every frame while they are set.
+// frame n copies into regions[n % R_READBACK_COUNT]; the regions of older
+// frames stay intact while it is in flight.
+static struct {
+    uint32_t             mask;
+    Tanto_V_BufferRegion regions[R_AOV_COUNT][R_READBACK_COUNT];
+} readbacks;
+
+// frame n uses slot n % R_FRAME_COUNT. a slot is reused only after the fence
+// of the frame that last used it has signaled.
+static struct {
+    Tanto_V_CommandPool cmdPool[R_FRAME_COUNT];
+    Tanto_V_CommandPool readbackPool[R_FRAME_COUNT];
+    VkFence             fence[R_FRAME_COUNT];
+    uint64_t            primaryVersion[R_FRAME_COUNT];
+    uint64_t            cullVersion[R_FRAME_COUNT];
+} frames;
+
+// r_UpdateCamera writes here; r_Render copies it into the slice of the frame
+// it submits, so frames in flight keep their own camera.
+static CameraUBO pendingCamera;
+
 // should not be accessed directly. go through the scene.
 static Tanto_V_BufferRegion cameraBuffer;
 static Tanto_V_BufferRegion transformBuffer;
 static Tanto_V_BufferRegion materialBuffer;
+static Tanto_V_BufferRegion attributeBuffer;
+static Tanto_V_BufferRegion pickIdBuffer;
+static Tanto_V_BufferRegion positionBuffer;
+static Tanto_V_BufferRegion vertColorBuffer;
+static Tanto_V_BufferRegion normalBuffer; // octahedral, read by vertex index
+static Tanto_V_BufferRegion indexBuffer;
+static Tanto_V_BufferRegion instanceBuffer;
+static Tanto_V_BufferRegion meshletBuffer;
+static Tanto_V_BufferRegion faceColorBuffer; // unorm rgba8, read by triangle
+
+// every change that affects recorded commands bumps sceneVersion. a chunk is
+// recorded again only when bindingVersion (buffers, framebuffer, pipeline) is
+// newer than the version it was recorded at or its visible draw count
+// changed. the primary buffer only executes the cached secondaries and is
+// recorded again when one of them is.
+static uint64_t sceneVersion;
+static uint64_t bindingVersion;
+
+static VkCommandPool cmdPoolChunks;
+
+// secondaries bind the camera slice of their frame slot, so every slot has
+// its own set of them.
+static struct {
+    uint32_t         capacity;
+    uint32_t         count[R_FRAME_COUNT];    // chunks referenced by the primary
+    uint32_t         cmdCount[R_FRAME_COUNT]; // secondaries allocated
+    VkCommandBuffer* cmds[R_FRAME_COUNT];
+    uint64_t*        recordedVersions[R_FRAME_COUNT];
+    uint32_t*        drawCounts[R_FRAME_COUNT];     // visible draws, set by culling
+    uint32_t*        recordedCounts[R_FRAME_COUNT];
+    uint32_t*        narrowCounts[R_FRAME_COUNT];   // of them with 16 bit indices
+    uint32_t*        recordedNarrowCounts[R_FRAME_COUNT];
+} chunks;
 
 typedef enum {
     R_PIPE_LAYOUT_MAIN,
+    R_PIPE_LAYOUT_CULL,
+    R_PIPE_LAYOUT_MESHLET,
 } R_PipelineLayoutId;
 
 typedef enum {
     R_DESC_SET_MAIN,
+    R_DESC_SET_CULL,
+    R_DESC_SET_MESHLET,
 } R_DescriptorSetId;
 
+static SlotBuffer requestSlotBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage, const bool hostVisible)
+{
+    // dynamic offsets must be aligned to minStorageBufferOffsetAlignment,
+    // which the spec caps at 256
+    const VkDeviceSize sliceSize = (size + 255) & ~(VkDeviceSize)255;
+    return (SlotBuffer){
+        .region = tanto_v_RequestBufferRegion(R_FRAME_COUNT * sliceSize, usage, 
+                hostVisible ? TANTO_V_MEMORY_HOST_GRAPHICS_TYPE : TANTO_V_MEMORY_DEVICE_TYPE),
+        .sliceSize = sliceSize
+    };
+}
+
+static Tanto_V_BufferRegion getSlot(const SlotBuffer* buffer, const uint32_t frameSlot)
+{
+    Tanto_V_BufferRegion slice = buffer->region;
+    slice.offset += frameSlot * buffer->sliceSize;
+    slice.size    = buffer->sliceSize;
+    if (slice.hostData)
+        slice.hostData = (uint8_t*)slice.hostData + frameSlot * buffer->sliceSize;
+    return slice;
+}
+
+// texels in the depth pyramid of a viewport. see hiz.glsl.
+static uint32_t hizTexelCount(uint32_t width, uint32_t height, uint32_t* levelCount)
+{
+    uint32_t count = 0;
+    *levelCount = 0;
+    do 
+    {
+        width  = (width  + 1) / 2;
+        height = (height + 1) / 2;
+        count += width * height;
+        (*levelCount)++;
+    } while (width > 1 || height > 1);
+    return count;
+}
+
+static void updateHiZDescriptors(void);
+
 // TODO: we should implement a way to specify the offscreen renderpass format at initialization
 static void initAttachments(void)
 {
-    attachmentColor = tanto_v_CreateImage(
-        TANTO_WINDOW_WIDTH, TANTO_WINDOW_HEIGHT,
-        colorFormat,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|
-        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT,
-        VK_SAMPLE_COUNT_1_BIT);
+    for (int i = 0; i < R_FRAME_COUNT; i++)
+    {
+        for (int aov = 0; aov < R_AOV_COUNT; aov++)
+        {
+            if (!(aovMask & R_AOV_BIT(aov)))
+                continue;
+            attachmentAovs[i][aov] = tanto_v_CreateImage(
+                TANTO_WINDOW_WIDTH, TANTO_WINDOW_HEIGHT,
+                aovFormats[aov],
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT|
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT|
+                VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                VK_SAMPLE_COUNT_1_BIT);
+        }
+    }
+
+    for (int aov = 0; aov < R_AOV_COUNT; aov++)
+    {
+        if (sampleCount == VK_SAMPLE_COUNT_1_BIT || !(aovMask & R_AOV_BIT(aov)))
+            continue;
+        attachmentSamples[aov] = tanto_v_CreateImage(
+            TANTO_WINDOW_WIDTH, TANTO_WINDOW_HEIGHT,
+            aovFormats[aov],
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            sampleCount);
+    }
 
     attachmentDepth = tanto_v_CreateImage(
         TANTO_WINDOW_WIDTH, TANTO_WINDOW_HEIGHT,
@@ -90,46 +553,75 @@ static void initAttachments(void)
         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
         VK_IMAGE_USAGE_SAMPLED_BIT,
         VK_IMAGE_ASPECT_DEPTH_BIT,
-        VK_SAMPLE_COUNT_1_BIT);
+        sampleCount);
+
+    // the depth pyramid follows the viewport
+    const uint32_t texelCount = hizTexelCount(TANTO_WINDOW_WIDTH, TANTO_WINDOW_HEIGHT, &occlusion.levelCount);
+    occlusion.hiz = tanto_v_RequestBufferRegion(texelCount * sizeof(float), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, TANTO_V_MEMORY_DEVICE_TYPE);
+
+    if (depthSampler == VK_NULL_HANDLE)
+    {
+        const VkSamplerCreateInfo samplerInfo = {
+            .sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter    = VK_FILTER_NEAREST,
+            .minFilter    = VK_FILTER_NEAREST,
+            .mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        };
+        V_ASSERT( vkCreateSampler(device, &samplerInfo, NULL, &depthSampler) );
+    }
+
+    updateHiZDescriptors();
 }
 
-static void initRenderPass(void)
+// the depth attachment comes first, then the enabled aovs in order. the
+// occlusion passes leave the attachments in the layouts they are used in
+// and transition them with explicit barriers in between.
+static void createRenderPass(const VkAttachmentLoadOp loadOp, const VkImageLayout colorInitialLayout, 
+        const VkImageLayout colorFinalLayout, VkRenderPass* pass)
 {
-    const VkAttachmentDescription attachmentColor = {
-        .flags = 0,
-        .format = colorFormat,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-    };
-
-    const VkAttachmentDescription attachmentDepth = {
+    VkAttachmentDescription attachments[1 + R_AOV_COUNT] = {{
         .flags = 0,
         .format = depthFormat,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .samples = sampleCount,
+        .loadOp = loadOp,
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .initialLayout = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? 
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
         .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-    };
-
-    const VkAttachmentDescription attachments[] = {
-        attachmentColor, attachmentDepth
-    };
+    }};
+    uint32_t attachmentCount = 1;
 
-    VkAttachmentReference colorReference = {
-        .attachment = 0,
-        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-    };
+    VkAttachmentReference colorReferences[R_AOV_COUNT];
+    for (int aov = 0; aov < R_AOV_COUNT; aov++)
+    {
+        colorReferences[aov] = (VkAttachmentReference){
+            .attachment = VK_ATTACHMENT_UNUSED,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        };
+        if (!(aovMask & R_AOV_BIT(aov)))
+            continue;
+        colorReferences[aov].attachment = attachmentCount;
+        attachments[attachmentCount++] = (VkAttachmentDescription){
+            .flags = 0,
+            .format = aovFormats[aov],
+            .samples = sampleCount,
+            .loadOp = loadOp,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = colorInitialLayout,
+            .finalLayout = colorFinalLayout,
+        };
+    }
 
     VkAttachmentReference depthReference = {
-        .attachment = 1,
+        .attachment = 0,
         .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
     };
 
@@ -138,8 +630,8 @@ static void initRenderPass(void)
         .pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS,
         .inputAttachmentCount    = 0,
         .pInputAttachments       = NULL,
-        .colorAttachmentCount    = 1,
-        .pColorAttachments       = &colorReference,
+        .colorAttachmentCount    = R_AOV_COUNT,
+        .pColorAttachments       = colorReferences,
         .pResolveAttachments     = NULL,
         .pDepthStencilAttachment = &depthReference,
         .preserveAttachmentCount = 0,
@@ -147,56 +639,171 @@ static void initRenderPass(void)
     };
 
     Tanto_R_RenderPassInfo rpi = {
-        .attachmentCount = 2,
+        .attachmentCount = attachmentCount,
         .pAttachments = attachments,
         .subpassCount = 1,
         .pSubpasses = &subpass,
     };
 
-    tanto_r_CreateRenderPass(&rpi, &renderpass);
+    tanto_r_CreateRenderPass(&rpi, pass);
+}
+
+// multisampled aovs are left to be resolved from
+static void initRenderPass(void)
+{
+    const VkImageLayout finalLayout = sampleCount == VK_SAMPLE_COUNT_1_BIT ? 
+        frameImageLayout : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, 
+            finalLayout, &renderpass);
+    createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, 
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, &renderpassOcclusion);
+    createRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 
+            finalLayout, &renderpassLoad);
 }
 
 static void initFramebuffer(void)
 {
-    const VkImageView attachments[] = {
-        attachmentColor.view, attachmentDepth.view
-    };
+    for (int i = 0; i < R_FRAME_COUNT; i++)
+    {
+        VkImageView attachments[1 + R_AOV_COUNT] = {attachmentDepth.view};
+        uint32_t attachmentCount = 1;
+        for (int aov = 0; aov < R_AOV_COUNT; aov++)
+        {
+            if (!(aovMask & R_AOV_BIT(aov)))
+                continue;
+            attachments[attachmentCount++] = sampleCount == VK_SAMPLE_COUNT_1_BIT ? 
+                attachmentAovs[i][aov].view : attachmentSamples[aov].view;
+        }
 
-    const VkFramebufferCreateInfo fbi = {
-        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .renderPass = renderpass,
-        .attachmentCount = 2,
-        .pAttachments = attachments,
-        .width = TANTO_WINDOW_WIDTH,
-        .height = TANTO_WINDOW_HEIGHT,
-        .layers = 1,
-    };
+        const VkFramebufferCreateInfo fbi = {
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .renderPass = renderpass,
+            .attachmentCount = attachmentCount,
+            .pAttachments = attachments,
+            .width = TANTO_WINDOW_WIDTH,
+            .height = TANTO_WINDOW_HEIGHT,
+            .layers = 1,
+        };
 
-    V_ASSERT( vkCreateFramebuffer(device, &fbi, NULL, &framebuffer) );
+        V_ASSERT( vkCreateFramebuffer(device, &fbi, NULL, &framebuffers[i]) );
+    }
 }
 
 static void initDescriptorSetsAndPipelineLayouts(void)
 {
     const Tanto_R_DescriptorSet descriptorSets[] = {{
         .id = R_DESC_SET_MAIN,
-        .bindingCount = 3,
+        .bindingCount = 8,
         .bindings = {{
-            // camera
+            // camera, one slice per frame slot
             .descriptorCount = 1,
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
             .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
         },{
             // prim transforms
             .descriptorCount = 1,
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .stageFlags = VK_SHADER_STAGE_VERTEX_BIT
         },{
             // materials
             .descriptorCount = 1,
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
             .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT
+        },{
+            // instances
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT
+        },{
+            // prim attributes
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+        },{
+            // vertex normals
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT
+        },{
+            // face colors
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+        },{
+            // pick ids
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+        }}
+    },{
+        .id = R_DESC_SET_CULL,
+        .bindingCount = 7,
+        .bindings = {{
+            // camera, one slice per frame slot
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // candidate draws, one slice per frame slot
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // candidate bounds, one slice per frame slot
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // culled draws, one slice per frame slot
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // prim visibility
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // depth pyramid
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // depth attachment
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        }}
+    },{
+        .id = R_DESC_SET_MESHLET,
+        .bindingCount = 5,
+        .bindings = {{
+            // camera, one slice per frame slot
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // prim transforms
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // meshlets
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // meshlet work, one slice per frame slot
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },{
+            // meshlet draws, one slice per frame slot
+            .descriptorCount = 1,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
         }}
     }};
 
@@ -206,153 +813,1943 @@ static void initDescriptorSetsAndPipelineLayouts(void)
         .descriptorSetIds = {R_DESC_SET_MAIN},
         .pushConstantCount = 0,
         .pushConstantsRanges = {}
+    },{
+        .id = R_PIPE_LAYOUT_CULL, 
+        .descriptorSetCount = 1, 
+        .descriptorSetIds = {R_DESC_SET_CULL},
+        .pushConstantCount = 1,
+        .pushConstantsRanges = {{
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(CullPushConstants)
+        }}
+    },{
+        .id = R_PIPE_LAYOUT_MESHLET, 
+        .descriptorSetCount = 1, 
+        .descriptorSetIds = {R_DESC_SET_MESHLET},
+        .pushConstantCount = 0,
+        .pushConstantsRanges = {}
     }};
 
     tanto_r_InitDescriptorSets(descriptorSets, TANTO_ARRAY_SIZE(descriptorSets));
     tanto_r_InitPipelineLayouts(pipelayouts, TANTO_ARRAY_SIZE(pipelayouts));
 }
 
+static VkShaderModule loadShaderModule(const char* spvPath)
+{
+    FILE* file = fopen(spvPath, "rb");
+    assert(file);
+    fseek(file, 0, SEEK_END);
+    const long codeSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint32_t* code = malloc(codeSize);
+    assert(code);
+    const size_t read = fread(code, 1, codeSize, file);
+    assert(read == (size_t)codeSize);
+    (void)read;
+    fclose(file);
+
+    const VkShaderModuleCreateInfo moduleInfo = {
+        .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = codeSize,
+        .pCode    = code
+    };
+    VkShaderModule module;
+    V_ASSERT( vkCreateShaderModule(device, &moduleInfo, NULL, &module) );
+    free(code);
+    return module;
+}
+
+static VkPipeline createComputePipeline(const char* spvPath, const VkSpecializationInfo* spec, 
+        const R_PipelineLayoutId layoutId)
+{
+    const VkShaderModule module = loadShaderModule(spvPath);
+    const VkComputePipelineCreateInfo pipeInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = module,
+            .pName  = "main",
+            .pSpecializationInfo = spec
+        },
+        .layout = pipelineLayouts[layoutId]
+    };
+    VkPipeline pipeline;
+    V_ASSERT( vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeInfo, NULL, &pipeline) );
+    vkDestroyShaderModule(device, module, NULL);
+    return pipeline;
+}
+
+// the main pipeline writes one color attachment per aov, which
+// tanto_r_CreatePipeline has no room for. the fragment shader only does the
+// work of the enabled ones.
+static VkPipeline createRasterPipeline(const Tanto_R_VertexDescription* vertexDescription)
+{
+    const VkShaderModule vertModule = loadShaderModule(SPVDIR"/flat-vert.spv");
+    const VkShaderModule fragModule = loadShaderModule(SPVDIR"/flat-frag.spv");
+
+    const VkSpecializationMapEntry aovEntry = {
+        .constantID = 0,
+        .offset     = 0,
+        .size       = sizeof(uint32_t)
+    };
+    const VkSpecializationInfo aovSpec = {
+        .mapEntryCount = 1,
+        .pMapEntries   = &aovEntry,
+        .dataSize      = sizeof(aovMask),
+        .pData         = &aovMask
+    };
+    const VkPipelineShaderStageCreateInfo stages[] = {{
+        .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage  = VK_SHADER_STAGE_VERTEX_BIT,
+        .module = vertModule,
+        .pName  = "main"
+    },{
+        .sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage  = VK_SHADER_STAGE_FRAGMENT_BIT,
+        .module = fragModule,
+        .pName  = "main",
+        .pSpecializationInfo = &aovSpec
+    }};
+
+    const VkPipelineVertexInputStateCreateInfo vertexInput = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount   = vertexDescription->bindingCount,
+        .pVertexBindingDescriptions      = vertexDescription->bindingDescriptions,
+        .vertexAttributeDescriptionCount = vertexDescription->attributeCount,
+        .pVertexAttributeDescriptions    = vertexDescription->attributeDescriptions
+    };
+    const VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+    };
+    const VkViewport viewport = {
+        .width    = TANTO_WINDOW_WIDTH,
+        .height   = TANTO_WINDOW_HEIGHT,
+        .maxDepth = 1.0
+    };
+    const VkRect2D scissor = {{0, 0}, {TANTO_WINDOW_WIDTH, TANTO_WINDOW_HEIGHT}};
+    const VkPipelineViewportStateCreateInfo viewportState = {
+        .sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .pViewports    = &viewport,
+        .scissorCount  = 1,
+        .pScissors     = &scissor
+    };
+    const VkPipelineRasterizationStateCreateInfo rasterization = {
+        .sType       = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode    = VK_CULL_MODE_FRONT_BIT,
+        .frontFace   = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .lineWidth   = 1.0
+    };
+    const VkPipelineMultisampleStateCreateInfo multisample = {
+        .sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = sampleCount
+    };
+    const VkPipelineDepthStencilStateCreateInfo depthStencil = {
+        .sType            = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable  = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp   = VK_COMPARE_OP_LESS_OR_EQUAL
+    };
+    // one per color attachment of the subpass, used or not
+    VkPipelineColorBlendAttachmentState blendAttachments[R_AOV_COUNT];
+    for (int aov = 0; aov < R_AOV_COUNT; aov++)
+    {
+        blendAttachments[aov] = (VkPipelineColorBlendAttachmentState){
+            .blendEnable    = VK_FALSE,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                              VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+        };
+    }
+    const VkPipelineColorBlendStateCreateInfo colorBlend = {
+        .sType           = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .attachmentCount = R_AOV_COUNT,
+        .pAttachments    = blendAttachments
+    };
+
+    const VkGraphicsPipelineCreateInfo pipeInfo = {
+        .sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount          = TANTO_ARRAY_SIZE(stages),
+        .pStages             = stages,
+        .pVertexInputState   = &vertexInput,
+        .pInputAssemblyState = &inputAssembly,
+        .pViewportState      = &viewportState,
+        .pRasterizationState = &rasterization,
+        .pMultisampleState   = &multisample,
+        .pDepthStencilState  = &depthStencil,
+        .pColorBlendState    = &colorBlend,
+        .layout              = pipelineLayouts[R_PIPE_LAYOUT_MAIN],
+        .renderPass          = renderpass,
+        .subpass             = 0
+    };
+    VkPipeline pipeline;
+    V_ASSERT( vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeInfo, NULL, &pipeline) );
+    vkDestroyShaderModule(device, vertModule, NULL);
+    vkDestroyShaderModule(device, fragModule, NULL);
+    return pipeline;
+}
+
 static void initPipelines(void)
 {
-    const Tanto_R_PipelineInfo pipeInfo = {
-        .type     = TANTO_R_PIPELINE_RASTER_TYPE,
-        .layoutId = R_PIPE_LAYOUT_MAIN,
-        .payload.rasterInfo = {
-            .renderPass = renderpass, 
-            .sampleCount = VK_SAMPLE_COUNT_1_BIT,
-            .frontFace   = VK_FRONT_FACE_COUNTER_CLOCKWISE,
-            .cullMode    = VK_CULL_MODE_FRONT_BIT,
-            .polygonMode = VK_POLYGON_MODE_FILL,
-            .vertexDescription = tanto_r_GetVertexDescription3D_2Vec3(),
-            .vertShader = SPVDIR"/flat-vert.spv",
-            .fragShader = SPVDIR"/flat-frag.spv"
-        }
+    // colors carry the opacity along. compact vertices keep the layout and
+    // are only read in other formats.
+    Tanto_R_VertexDescription vertexDescription = tanto_r_GetVertexDescription3D_2Vec3();
+    vertexDescription.bindingDescriptions[1].stride   = colorSize;
+    vertexDescription.attributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    if (compactVertices)
+    {
+        vertexDescription.bindingDescriptions[0].stride   = positionSize;
+        vertexDescription.attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+        vertexDescription.attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    }
+
+    pipelineMain = createRasterPipeline(&vertexDescription);
+
+    // a multisampled depth attachment is read with a shader of its own
+    const uint32_t samples = sampleCount;
+    const VkSpecializationMapEntry samplesEntry = {
+        .constantID = 0,
+        .offset     = 0,
+        .size       = sizeof(uint32_t)
     };
+    const VkSpecializationInfo hizSpec = {
+        .mapEntryCount = 1,
+        .pMapEntries   = &samplesEntry,
+        .dataSize      = sizeof(samples),
+        .pData         = &samples
+    };
+    pipelineHiZ = sampleCount == VK_SAMPLE_COUNT_1_BIT ? 
+        createComputePipeline(SPVDIR"/hiz-comp.spv", NULL, R_PIPE_LAYOUT_CULL) :
+        createComputePipeline(SPVDIR"/hizms-comp.spv", &hizSpec, R_PIPE_LAYOUT_CULL);
 
-    tanto_r_CreatePipeline(&pipeInfo, &pipelineMain);
+    pipelineCull    = createComputePipeline(SPVDIR"/cull-comp.spv", NULL, R_PIPE_LAYOUT_CULL);
+    pipelineMeshlet = createComputePipeline(SPVDIR"/meshlet-comp.spv", NULL, R_PIPE_LAYOUT_MESHLET);
 }
 
 // descriptors that do only need to have update called once and can be updated on initialization
 static void updateStaticDescriptors(void)
 {
-    cameraBuffer = tanto_v_RequestBufferRegion(sizeof(CameraUBO), 
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
-
-    materialBuffer = tanto_v_RequestBufferRegion(sizeof(MaterialsUBO), 
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
-
-    transformBuffer = tanto_v_RequestBufferRegion(sizeof(TransformsUBO), 
+    cameraBuffer = tanto_v_RequestBufferRegion(R_FRAME_COUNT * sizeof(CameraUBO), 
             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
 
     VkDescriptorBufferInfo cameraUbo = {
         .buffer = cameraBuffer.buffer,
         .offset = cameraBuffer.offset,
-        .range  = cameraBuffer.size
+        .range  = sizeof(CameraUBO)
     };
 
-    VkDescriptorBufferInfo transformUbo = {
+    VkWriteDescriptorSet writes[] = {{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_MAIN],
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pBufferInfo = &cameraUbo
+    },{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_CULL],
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pBufferInfo = &cameraUbo
+    },{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_MESHLET],
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pBufferInfo = &cameraUbo
+    }};
+
+    vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
+}
+
+// must be called whenever the per-prim storage buffers are reallocated
+static void updatePrimDescriptors(void)
+{
+    VkDescriptorBufferInfo transformSsbo = {
         .buffer = transformBuffer.buffer,
         .offset = transformBuffer.offset,
         .range  = transformBuffer.size
     };
 
-    VkDescriptorBufferInfo materialUbo = {
+    VkDescriptorBufferInfo materialSsbo = {
         .buffer = materialBuffer.buffer,
         .offset = materialBuffer.offset,
         .range  = materialBuffer.size
     };
 
+    VkDescriptorBufferInfo attributeSsbo = {
+        .buffer = attributeBuffer.buffer,
+        .offset = attributeBuffer.offset,
+        .range  = attributeBuffer.size
+    };
+
+    VkDescriptorBufferInfo pickIdSsbo = {
+        .buffer = pickIdBuffer.buffer,
+        .offset = pickIdBuffer.offset,
+        .range  = pickIdBuffer.size
+    };
+
     VkWriteDescriptorSet writes[] = {{
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstArrayElement = 0,
         .dstSet = descriptorSets[R_DESC_SET_MAIN],
-        .dstBinding = 0,
+        .dstBinding = 1,
         .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .pBufferInfo = &cameraUbo
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &transformSsbo
     },{
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstArrayElement = 0,
         .dstSet = descriptorSets[R_DESC_SET_MAIN],
-        .dstBinding = 1,
+        .dstBinding = 2,
         .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .pBufferInfo = &transformUbo
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &materialSsbo
     },{
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstArrayElement = 0,
         .dstSet = descriptorSets[R_DESC_SET_MAIN],
-        .dstBinding = 2,
+        .dstBinding = 4,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &attributeSsbo
+    },{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_MAIN],
+        .dstBinding = 7,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &pickIdSsbo
+    },{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_MESHLET],
+        .dstBinding = 1,
         .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .pBufferInfo = &materialUbo
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &transformSsbo
     }};
 
     vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
 }
 
-static void updateDynamicDescriptors(void)
+// must be called whenever the candidate, culled draw or visibility buffers
+// are reallocated
+static void updateCullDescriptors(void)
 {
+    const VkDescriptorBufferInfo infos[] = {{
+        .buffer = drawBuffer.region.buffer,
+        .offset = drawBuffer.region.offset,
+        .range  = drawBuffer.sliceSize
+    },{
+        .buffer = occlusion.bounds.region.buffer,
+        .offset = occlusion.bounds.region.offset,
+        .range  = occlusion.bounds.sliceSize
+    },{
+        .buffer = occlusion.output.region.buffer,
+        .offset = occlusion.output.region.offset,
+        .range  = occlusion.output.sliceSize
+    },{
+        .buffer = occlusion.visibility.buffer,
+        .offset = occlusion.visibility.offset,
+        .range  = occlusion.visibility.size
+    }};
+
+    VkWriteDescriptorSet writes[TANTO_ARRAY_SIZE(infos)];
+    for (uint32_t i = 0; i < TANTO_ARRAY_SIZE(infos); i++) 
+    {
+        writes[i] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstArrayElement = 0,
+            .dstSet = descriptorSets[R_DESC_SET_CULL],
+            .dstBinding = 1 + i,
+            .descriptorCount = 1,
+            .descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &infos[i]
+        };
+    }
+
+    vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
 }
 
-static void mainRender(const VkCommandBuffer* cmdBuf, const VkRenderPassBeginInfo* rpassInfo)
+// must be called whenever the attachments are recreated
+static void updateHiZDescriptors(void)
 {
-    vkCmdBindPipeline(*cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineMain);
+    VkDescriptorBufferInfo hizSsbo = {
+        .buffer = occlusion.hiz.buffer,
+        .offset = occlusion.hiz.offset,
+        .range  = occlusion.hiz.size
+    };
 
-    vkCmdBindDescriptorSets(
-        *cmdBuf, 
-        VK_PIPELINE_BIND_POINT_GRAPHICS, 
-        pipelineLayouts[R_PIPE_LAYOUT_MAIN], 
-        0, 1, &descriptorSets[R_DESC_SET_MAIN],
-        0, NULL);
+    VkDescriptorImageInfo depthImage = {
+        .sampler     = depthSampler,
+        .imageView   = attachmentDepth.view,
+        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    };
 
-    vkCmdBeginRenderPass(*cmdBuf, rpassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    VkWriteDescriptorSet writes[] = {{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_CULL],
+        .dstBinding = 5,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &hizSsbo
+    },{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_CULL],
+        .dstBinding = 6,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &depthImage
+    }};
 
-    for (int i = 0; i < scene.primCount; i++) 
-    {
-        Tanto_R_Primitive prim = scene.primitive[i];
+    vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
+}
+
+// must be called whenever the normal buffer is reallocated
+static void updateVertexDescriptors(void)
+{
+    VkDescriptorBufferInfo normalSsbo = {
+        .buffer = normalBuffer.buffer,
+        .offset = normalBuffer.offset,
+        .range  = normalBuffer.size
+    };
+
+    VkWriteDescriptorSet writes[] = {{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_MAIN],
+        .dstBinding = 5,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &normalSsbo
+    }};
+
+    vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
+}
+
+// must be called whenever the face color buffer is reallocated
+static void updateFaceColorDescriptors(void)
+{
+    VkDescriptorBufferInfo faceColorSsbo = {
+        .buffer = faceColorBuffer.buffer,
+        .offset = faceColorBuffer.offset,
+        .range  = faceColorBuffer.size
+    };
+
+    VkWriteDescriptorSet writes[] = {{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_MAIN],
+        .dstBinding = 6,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &faceColorSsbo
+    }};
+
+    vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
+}
+
+// must be called whenever the instance buffer is reallocated
+static void updateInstanceDescriptors(void)
+{
+    VkDescriptorBufferInfo instanceSsbo = {
+        .buffer = instanceBuffer.buffer,
+        .offset = instanceBuffer.offset,
+        .range  = instanceBuffer.size
+    };
+
+    VkWriteDescriptorSet writes[] = {{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstArrayElement = 0,
+        .dstSet = descriptorSets[R_DESC_SET_MAIN],
+        .dstBinding = 3,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &instanceSsbo
+    }};
+
+    vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
+}
+
+// must be called whenever the meshlet, meshlet work or meshlet draw buffers
+// are reallocated
+static void updateMeshletDescriptors(void)
+{
+    const VkDescriptorBufferInfo infos[] = {{
+        .buffer = meshletBuffer.buffer,
+        .offset = meshletBuffer.offset,
+        .range  = meshletBuffer.size
+    },{
+        .buffer = meshlets.work.region.buffer,
+        .offset = meshlets.work.region.offset,
+        .range  = meshlets.work.sliceSize
+    },{
+        .buffer = meshlets.output.region.buffer,
+        .offset = meshlets.output.region.offset,
+        .range  = meshlets.output.sliceSize
+    }};
 
-        const VkBuffer vertBuffers[2] = {
-            prim.vertexRegion.buffer,
-            prim.vertexRegion.buffer
+    VkWriteDescriptorSet writes[TANTO_ARRAY_SIZE(infos)];
+    for (uint32_t i = 0; i < TANTO_ARRAY_SIZE(infos); i++) 
+    {
+        writes[i] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstArrayElement = 0,
+            .dstSet = descriptorSets[R_DESC_SET_MESHLET],
+            .dstBinding = 2 + i,
+            .descriptorCount = 1,
+            .descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .pBufferInfo = &infos[i]
         };
+    }
+
+    vkUpdateDescriptorSets(device, TANTO_ARRAY_SIZE(writes), writes, 0, NULL);
+}
+
+static void invalidateRenderCommands(void)
+{
+    bindingVersion = ++sceneVersion;
+}
+
+// the draw of a prim changed, which may add it to or remove it from the
+// hierarchy
+static void touchDraw(void)
+{
+    culling.bvhDirty    = true;
+    culling.boundsDirty = true;
+    culling.version++;
+}
+
+static void touchBounds(void)
+{
+    culling.boundsDirty = true;
+    culling.version++;
+}
+
+static void growChunks(const uint32_t primCapacity)
+{
+    const uint32_t capacity = (primCapacity + CHUNK_PRIM_COUNT - 1) / CHUNK_PRIM_COUNT;
+    if (capacity <= chunks.capacity)
+        return;
+    for (uint32_t f = 0; f < R_FRAME_COUNT; f++) 
+    {
+        chunks.cmds[f]             = realloc(chunks.cmds[f],             capacity * sizeof(VkCommandBuffer));
+        chunks.recordedVersions[f] = realloc(chunks.recordedVersions[f], capacity * sizeof(uint64_t));
+        chunks.drawCounts[f]       = realloc(chunks.drawCounts[f],       capacity * sizeof(uint32_t));
+        chunks.recordedCounts[f]   = realloc(chunks.recordedCounts[f],   capacity * sizeof(uint32_t));
+        chunks.narrowCounts[f]     = realloc(chunks.narrowCounts[f],     capacity * sizeof(uint32_t));
+        chunks.recordedNarrowCounts[f] = realloc(chunks.recordedNarrowCounts[f], capacity * sizeof(uint32_t));
+        assert(chunks.cmds[f] && chunks.recordedVersions[f] && chunks.drawCounts[f] && chunks.recordedCounts[f]);
+        assert(chunks.narrowCounts[f] && chunks.recordedNarrowCounts[f]);
+        for (uint32_t i = chunks.capacity; i < capacity; i++) 
+        {
+            chunks.recordedVersions[f][i]     = 0;
+            chunks.drawCounts[f][i]           = 0;
+            chunks.recordedCounts[f][i]       = 0;
+            chunks.narrowCounts[f][i]         = 0;
+            chunks.recordedNarrowCounts[f][i] = 0;
+        }
+    }
+    chunks.capacity = capacity;
+}
+
+// grows the per-prim arrays geometrically so that at least minCapacity slots
+// are available. existing slots are carried over.
+static void growPrimStorage(const uint32_t minCapacity)
+{
+    uint32_t capacity = scene.primCapacity ? scene.primCapacity : INIT_PRIM_CAPACITY;
+    while (capacity < minCapacity)
+        capacity *= 2;
+    if (capacity == scene.primCapacity)
+        return;
+
+    Tanto_V_BufferRegion newTransforms = tanto_v_RequestBufferRegion(capacity * sizeof(Mat4), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
+
+    Tanto_V_BufferRegion newMaterials = tanto_v_RequestBufferRegion(capacity * sizeof(Tanto_R_Material), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
+
+    Tanto_V_BufferRegion newAttributes = tanto_v_RequestBufferRegion(capacity * sizeof(PrimAttributes), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
+
+    Tanto_V_BufferRegion newPickIds = tanto_v_RequestBufferRegion(capacity * sizeof(int32_t), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
+
+    if (scene.primCapacity)
+    {
+        memcpy(newTransforms.hostData,   scene.transforms,   scene.primCount * sizeof(Mat4));
+        memcpy(newMaterials.hostData,    scene.materials,    scene.primCount * sizeof(Tanto_R_Material));
+        memcpy(newAttributes.hostData, scene.attributes, scene.primCount * sizeof(PrimAttributes));
+        memcpy(newPickIds.hostData,    scene.pickIds,    scene.primCount * sizeof(int32_t));
+        // the old regions may still be read by a submitted frame
+        vkDeviceWaitIdle(device);
+        tanto_v_FreeBufferRegion(&transformBuffer);
+        tanto_v_FreeBufferRegion(&materialBuffer);
+        tanto_v_FreeBufferRegion(&attributeBuffer);
+        tanto_v_FreeBufferRegion(&pickIdBuffer);
+        tanto_v_FreeBufferRegion(&drawBuffer.region);
+        tanto_v_FreeBufferRegion(&occlusion.bounds.region);
+        tanto_v_FreeBufferRegion(&occlusion.output.region);
+        tanto_v_FreeBufferRegion(&occlusion.visibility);
+        invalidateRenderCommands();
+    }
+
+    // the draws of every slot are written again by the next cull
+    drawBuffer = requestSlotBuffer(capacity * sizeof(VkDrawIndexedIndirectCommand), 
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+    occlusion.bounds = requestSlotBuffer(CULL_HEADER_SIZE + capacity * sizeof(CullBounds), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+    // room for the draws of both passes, in a list per index width each
+    occlusion.output = requestSlotBuffer(4 * capacity * sizeof(VkDrawIndexedIndirectCommand), 
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false);
+    // nothing is known to be visible, so the first frame draws everything in
+    // the second pass
+    occlusion.visibility = tanto_v_RequestBufferRegion(capacity * sizeof(uint32_t), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, TANTO_V_MEMORY_HOST_GRAPHICS_TYPE);
+    memset(occlusion.visibility.hostData, 0, capacity * sizeof(uint32_t));
+    culling.version++;
+
+    transformBuffer   = newTransforms;
+    materialBuffer    = newMaterials;
+    attributeBuffer = newAttributes;
+    pickIdBuffer    = newPickIds;
+
+    scene.geos         = realloc(scene.geos, capacity * sizeof(PrimGeo));
+    scene.freeSlots    = realloc(scene.freeSlots, capacity * sizeof(uint32_t));
+    scene.instances    = realloc(scene.instances, capacity * sizeof(PrimInstances));
+    scene.draws        = realloc(scene.draws, capacity * sizeof(VkDrawIndexedIndirectCommand));
+    assert(scene.geos && scene.freeSlots && scene.instances && scene.draws);
+    // prim ids share the instance index space with the instance buffer
+    assert(capacity <= INSTANCE_ID_BASE);
+    scene.transforms   = (Mat4*)transformBuffer.hostData;
+    scene.materials    = (Tanto_R_Material*)materialBuffer.hostData;
+    scene.attributes = (PrimAttributes*)attributeBuffer.hostData;
+    scene.pickIds    = (int32_t*)pickIdBuffer.hostData;
+    scene.primCapacity = capacity;
+
+    culling.worldBounds = realloc(culling.worldBounds, capacity * sizeof(R_Aabb));
+    culling.visible     = realloc(culling.visible, (capacity + 63) / 64 * sizeof(uint64_t));
+    culling.ids         = realloc(culling.ids, capacity * sizeof(uint32_t));
+    assert(culling.worldBounds && culling.visible && culling.ids);
+
+    growChunks(capacity);
+    updatePrimDescriptors();
+    updateCullDescriptors();
+}
+
+static void copyGeometryBuffer(const Tanto_V_BufferRegion* src, const Tanto_V_BufferRegion* dst)
+{
+    vkResetCommandPool(device, cmdPoolGrowth.handle, 0);
+
+    const VkCommandBufferBeginInfo cbbi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    V_ASSERT( vkBeginCommandBuffer(cmdPoolGrowth.buffer, &cbbi) );
+
+    const VkBufferCopy region = {
+        .srcOffset = src->offset,
+        .dstOffset = dst->offset,
+        .size      = src->size
+    };
+    vkCmdCopyBuffer(cmdPoolGrowth.buffer, src->buffer, dst->buffer, 1, &region);
+
+    V_ASSERT( vkEndCommandBuffer(cmdPoolGrowth.buffer) );
+
+    const VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdPoolGrowth.buffer
+    };
+    V_ASSERT( vkQueueSubmit(graphicsQueues[0], 1, &submitInfo, VK_NULL_HANDLE) );
+    V_ASSERT( vkQueueWaitIdle(graphicsQueues[0]) );
+}
+
+// pending uploads target the old buffers, so they are flushed and handed to
+// the graphics queue before the contents are copied over.
+static void finishUploads(void)
+{
+    r_StagingFlush();
+    r_StagingSubmitAcquires();
+    vkDeviceWaitIdle(device);
+}
+
+static void growVertexStorage(const uint32_t minCapacity)
+{
+    const uint32_t oldCapacity = geometry.vertexArena.capacity;
+    uint32_t capacity = oldCapacity ? oldCapacity : INIT_VERTEX_CAPACITY;
+    while (capacity < minCapacity)
+        capacity *= 2;
+    if (capacity == oldCapacity)
+        return;
+
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | 
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    Tanto_V_BufferRegion newPositions = tanto_v_RequestBufferRegion(capacity * positionSize, 
+            usage, TANTO_V_MEMORY_DEVICE_TYPE);
+
+    Tanto_V_BufferRegion newColors = tanto_v_RequestBufferRegion(capacity * colorSize, 
+            usage, TANTO_V_MEMORY_DEVICE_TYPE);
+
+    Tanto_V_BufferRegion newNormals = tanto_v_RequestBufferRegion(capacity * sizeof(uint32_t), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, TANTO_V_MEMORY_DEVICE_TYPE);
+
+    if (oldCapacity)
+    {
+        finishUploads();
+        copyGeometryBuffer(&positionBuffer,  &newPositions);
+        copyGeometryBuffer(&vertColorBuffer, &newColors);
+        copyGeometryBuffer(&normalBuffer,    &newNormals);
+        tanto_v_FreeBufferRegion(&positionBuffer);
+        tanto_v_FreeBufferRegion(&vertColorBuffer);
+        tanto_v_FreeBufferRegion(&normalBuffer);
+        r_ArenaGrow(&geometry.vertexArena, capacity);
+        invalidateRenderCommands();
+    }
+    else
+        r_ArenaInit(&geometry.vertexArena, capacity);
+
+    positionBuffer  = newPositions;
+    vertColorBuffer = newColors;
+    normalBuffer    = newNormals;
+    updateVertexDescriptors();
+}
+
+static void growIndexStorage(const uint32_t minCapacity)
+{
+    const uint32_t oldCapacity = geometry.indexArena.capacity;
+    uint32_t capacity = oldCapacity ? oldCapacity : INIT_INDEX_CAPACITY;
+    while (capacity < minCapacity)
+        capacity *= 2;
+    if (capacity == oldCapacity)
+        return;
+
+    Tanto_V_BufferRegion newIndices = tanto_v_RequestBufferRegion(capacity * sizeof(Tanto_R_Index), 
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+            TANTO_V_MEMORY_DEVICE_TYPE);
+
+    if (oldCapacity)
+    {
+        finishUploads();
+        copyGeometryBuffer(&indexBuffer, &newIndices);
+        tanto_v_FreeBufferRegion(&indexBuffer);
+        r_ArenaGrow(&geometry.indexArena, capacity);
+        invalidateRenderCommands();
+    }
+    else
+        r_ArenaInit(&geometry.indexArena, capacity);
+
+    indexBuffer = newIndices;
+}
+
+static void growInstanceStorage(const uint32_t minCapacity)
+{
+    const uint32_t oldCapacity = geometry.instanceArena.capacity;
+    uint32_t capacity = oldCapacity ? oldCapacity : INIT_INSTANCE_CAPACITY;
+    while (capacity < minCapacity)
+        capacity *= 2;
+    if (capacity == oldCapacity)
+        return;
+    // gl_InstanceIndex is signed
+    assert((uint64_t)INSTANCE_ID_BASE + capacity <= INT32_MAX);
+
+    Tanto_V_BufferRegion newInstances = tanto_v_RequestBufferRegion(capacity * sizeof(InstanceData), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+            TANTO_V_MEMORY_DEVICE_TYPE);
+
+    if (oldCapacity)
+    {
+        finishUploads();
+        copyGeometryBuffer(&instanceBuffer, &newInstances);
+        tanto_v_FreeBufferRegion(&instanceBuffer);
+        r_ArenaGrow(&geometry.instanceArena, capacity);
+        invalidateRenderCommands();
+    }
+    else
+        r_ArenaInit(&geometry.instanceArena, capacity);
+
+    instanceBuffer = newInstances;
+    updateInstanceDescriptors();
+}
+
+// the work and draw buffers have room for every meshlet there is room for.
+// meshlets shared by several prims may overflow them; those prims draw whole.
+static void growMeshletStorage(const uint32_t minCapacity)
+{
+    const uint32_t oldCapacity = geometry.meshletArena.capacity;
+    uint32_t capacity = oldCapacity ? oldCapacity : INIT_MESHLET_CAPACITY;
+    while (capacity < minCapacity)
+        capacity *= 2;
+    if (capacity == oldCapacity)
+        return;
+
+    Tanto_V_BufferRegion newMeshlets = tanto_v_RequestBufferRegion(capacity * sizeof(MeshletData), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+            TANTO_V_MEMORY_DEVICE_TYPE);
+
+    if (oldCapacity)
+    {
+        finishUploads();
+        copyGeometryBuffer(&meshletBuffer, &newMeshlets);
+        tanto_v_FreeBufferRegion(&meshletBuffer);
+        tanto_v_FreeBufferRegion(&meshlets.work.region);
+        tanto_v_FreeBufferRegion(&meshlets.output.region);
+        r_ArenaGrow(&geometry.meshletArena, capacity);
+        invalidateRenderCommands();
+    }
+    else
+        r_ArenaInit(&geometry.meshletArena, capacity);
+
+    meshletBuffer = newMeshlets;
+    // the work of every slot is written again by the next cull
+    meshlets.work = requestSlotBuffer(CULL_HEADER_SIZE + capacity * sizeof(MeshletWork), 
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+    meshlets.output = requestSlotBuffer(2 * capacity * sizeof(VkDrawIndexedIndirectCommand), 
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false);
+    culling.version++;
+    updateMeshletDescriptors();
+}
+
+static void growFaceColorStorage(const uint32_t minCapacity)
+{
+    const uint32_t oldCapacity = geometry.faceColorArena.capacity;
+    uint32_t capacity = oldCapacity ? oldCapacity : INIT_FACE_COLOR_CAPACITY;
+    while (capacity < minCapacity)
+        capacity *= 2;
+    if (capacity == oldCapacity)
+        return;
+
+    Tanto_V_BufferRegion newFaceColors = tanto_v_RequestBufferRegion(capacity * sizeof(uint32_t), 
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+            TANTO_V_MEMORY_DEVICE_TYPE);
+
+    if (oldCapacity)
+    {
+        finishUploads();
+        copyGeometryBuffer(&faceColorBuffer, &newFaceColors);
+        tanto_v_FreeBufferRegion(&faceColorBuffer);
+        r_ArenaGrow(&geometry.faceColorArena, capacity);
+        invalidateRenderCommands();
+    }
+    else
+        r_ArenaInit(&geometry.faceColorArena, capacity);
+
+    faceColorBuffer = newFaceColors;
+    updateFaceColorDescriptors();
+}
+
+// growing by the requested size always leaves a large enough free tail
+static uint32_t allocVertices(const uint32_t vertexCount)
+{
+    uint32_t vertexOffset;
+    if (!r_ArenaAlloc(&geometry.vertexArena, vertexCount, &vertexOffset))
+    {
+        growVertexStorage(geometry.vertexArena.capacity + vertexCount);
+        const bool grown = r_ArenaAlloc(&geometry.vertexArena, vertexCount, &vertexOffset);
+        assert(grown);
+        (void)grown;
+    }
+    return vertexOffset;
+}
+
+static uint32_t allocInstances(const uint32_t instanceCount)
+{
+    uint32_t offset;
+    if (!r_ArenaAlloc(&geometry.instanceArena, instanceCount, &offset))
+    {
+        growInstanceStorage(geometry.instanceArena.capacity + instanceCount);
+        const bool grown = r_ArenaAlloc(&geometry.instanceArena, instanceCount, &offset);
+        assert(grown);
+        (void)grown;
+    }
+    return offset;
+}
+
+static uint32_t allocIndices(const uint32_t indexCount)
+{
+    uint32_t firstIndex;
+    if (!r_ArenaAlloc(&geometry.indexArena, indexCount, &firstIndex))
+    {
+        growIndexStorage(geometry.indexArena.capacity + indexCount);
+        const bool grown = r_ArenaAlloc(&geometry.indexArena, indexCount, &firstIndex);
+        assert(grown);
+        (void)grown;
+    }
+    return firstIndex;
+}
+
+static uint32_t allocMeshlets(const uint32_t meshletCount)
+{
+    uint32_t offset;
+    if (!r_ArenaAlloc(&geometry.meshletArena, meshletCount, &offset))
+    {
+        growMeshletStorage(geometry.meshletArena.capacity + meshletCount);
+        const bool grown = r_ArenaAlloc(&geometry.meshletArena, meshletCount, &offset);
+        assert(grown);
+        (void)grown;
+    }
+    return offset;
+}
+
+static uint32_t allocFaceColors(const uint32_t triangleCount)
+{
+    uint32_t offset;
+    if (!r_ArenaAlloc(&geometry.faceColorArena, triangleCount, &offset))
+    {
+        growFaceColorStorage(geometry.faceColorArena.capacity + triangleCount);
+        const bool grown = r_ArenaAlloc(&geometry.faceColorArena, triangleCount, &offset);
+        assert(grown);
+        (void)grown;
+    }
+    return offset;
+}
+
+static const SharedRange* getRange(const RangeTable* table, const uint32_t id)
+{
+    if (id == NO_RANGE)
+        return NULL;
+    assert(id < table->count && table->ranges[id].refCount);
+    return &table->ranges[id];
+}
+
+// the new range has a single reference, owned by the caller
+static uint32_t newRange(RangeTable* table, const uint32_t offset, const uint32_t count)
+{
+    uint32_t id;
+    if (table->freeCount)
+        id = table->freeSlots[--table->freeCount];
+    else
+    {
+        if (table->count == table->capacity)
+        {
+            table->capacity  = table->capacity ? table->capacity * 2 : 64;
+            table->ranges    = realloc(table->ranges, table->capacity * sizeof(SharedRange));
+            table->freeSlots = realloc(table->freeSlots, table->capacity * sizeof(uint32_t));
+            assert(table->ranges && table->freeSlots);
+        }
+        id = table->count++;
+    }
+    table->ranges[id] = (SharedRange){
+        .offset   = offset,
+        .count    = count,
+        .refCount = 1,
+        .narrow   = false
+    };
+    return id;
+}
+
+static void retainRange(RangeTable* table, const uint32_t id)
+{
+    if (id == NO_RANGE)
+        return;
+    assert(id < table->count && table->ranges[id].refCount);
+    table->ranges[id].refCount++;
+}
+
+static void retireRange(R_Arena* arena, const uint32_t offset, const uint32_t count);
+
+// the range is given back to its arena once no submitted frame can read it
+static void releaseRange(RangeTable* table, R_Arena* arena, const uint32_t id)
+{
+    if (id == NO_RANGE)
+        return;
+    assert(id < table->count);
+    SharedRange* range = &table->ranges[id];
+    assert(range->refCount);
+    if (--range->refCount)
+        return;
+    retireRange(arena, range->offset, range->narrow ? (range->count + 1) / 2 : range->count);
+    table->freeSlots[table->freeCount++] = id;
+}
+
+// stages the copies of a prim's vertices. the returned pointers are filled by
+// writeVertices, possibly on another thread.
+static Tanto_PrimUpload stageVertices(const Tanto_PrimId primId, const uint32_t vertexCount, 
+        const Tanto_IndexSetId indexSet)
+{
+    // a prim without points has no vertex set and draws nothing
+    const uint32_t vertexOffset = vertexCount ? allocVertices(vertexCount) : 0;
+
+    Tanto_PrimUpload upload = {
+        .id          = primId,
+        .vertexSet   = vertexCount ? newRange(&vertexSets, vertexOffset, vertexCount) : NO_RANGE,
+        .vertexCount = vertexCount,
+        .indexSet    = indexSet
+    };
+    upload.ticket = r_StagingBeginWrite(vertexCount * (positionSize + colorSize + sizeof(uint32_t)), 3);
+    if (vertexCount)
+    {
+        upload.positions = r_StageCopy(&positionBuffer, vertexOffset * positionSize, 
+                vertexCount * positionSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        upload.colors = r_StageCopy(&vertColorBuffer, vertexOffset * colorSize, 
+                vertexCount * colorSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        upload.normals = r_StageCopy(&normalBuffer, vertexOffset * sizeof(uint32_t), 
+                vertexCount * sizeof(uint32_t), VK_ACCESS_SHADER_READ_BIT);
+    }
+    return upload;
+}
+
+static R_Aabb pointBounds(const Vec3* points, const uint32_t count)
+{
+    R_Aabb box = { .min = points[0], .max = points[0] };
+    for (uint32_t i = 1; i < count; i++) 
+    {
+        for (int a = 0; a < 3; a++) 
+        {
+            if (points[i].x[a] < box.min.x[a]) box.min.x[a] = points[i].x[a];
+            if (points[i].x[a] > box.max.x[a]) box.max.x[a] = points[i].x[a];
+        }
+    }
+    return box;
+}
+
+// unorm rgba8, in the order unpackUnorm4x8 reads it
+static uint32_t packColor(const Vec4* color)
+{
+    uint32_t packed = 0;
+    for (int i = 0; i < 4; i++) 
+    {
+        const float c = color->x[i] < 0.0 ? 0.0 : color->x[i] > 1.0 ? 1.0 : color->x[i];
+        packed |= (uint32_t)(c * 255.0 + 0.5) << (8 * i);
+    }
+    return packed;
+}
+
+// positions as fractions of their bounds, rounded to the nearest step
+static void packPositions(PackedPosition* dst, const Vec3* src, const uint32_t count, const R_Aabb* bounds)
+{
+    float factor[3];
+    for (int a = 0; a < 3; a++) 
+    {
+        const float extent = bounds->max.x[a] - bounds->min.x[a];
+        factor[a] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+    }
+    for (uint32_t i = 0; i < count; i++) 
+    {
+        for (int a = 0; a < 3; a++) 
+        {
+            const float q = (src[i].x[a] - bounds->min.x[a]) * factor[a] + 0.5f;
+            dst[i].x[a] = q < 65535.0f ? (uint16_t)q : 65535;
+        }
+        dst[i].x[3] = 0;
+    }
+}
+
+// writes positions in the vertex format, relative to bounds if compact
+static void writePositions(void* dst, const Vec3* src, const uint32_t count, const R_Aabb* bounds)
+{
+    if (compactVertices)
+        packPositions(dst, src, count, bounds);
+    else
+        memcpy(dst, src, count * sizeof(Vec3));
+}
+
+// octahedral encoding of a unit vector, as two snorm16 in the order
+// unpackSnorm2x16 reads them. a zero vector comes out as +z.
+static uint32_t packNormal(const Vec3* n)
+{
+    const float l1 = fabsf(n->x[0]) + fabsf(n->x[1]) + fabsf(n->x[2]);
+    float u = 0.0f;
+    float v = 0.0f;
+    if (l1 > 0.0f)
+    {
+        u = n->x[0] / l1;
+        v = n->x[1] / l1;
+        // the lower half folds over the diagonals
+        if (n->x[2] < 0.0f)
+        {
+            const float foldedU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            const float foldedV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = foldedU;
+            v = foldedV;
+        }
+    }
+    const uint16_t x = (uint16_t)(int16_t)lroundf(u * 32767.0f);
+    const uint16_t y = (uint16_t)(int16_t)lroundf(v * 32767.0f);
+    return (uint32_t)x | (uint32_t)y << 16;
+}
+
+static void writeNormals(uint32_t* dst, const Vec3* src, const uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) 
+        dst[i] = packNormal(&src[i]);
+}
 
-        const VkDeviceSize attrOffsets[2] = {
-            prim.attrOffsets[0] + prim.vertexRegion.offset,
-            prim.attrOffsets[1] + prim.vertexRegion.offset,
+// touches nothing but the upload itself, so it needs no locking
+static void writeVertices(Tanto_PrimUpload* upload, const Tanto_PrimGeometry* src)
+{
+    assert(src->vertexCount == upload->vertexCount);
+    if (upload->vertexCount)
+    {
+        const R_Aabb bounds = pointBounds(src->positions, src->vertexCount);
+        upload->boundsMin = bounds.min;
+        upload->boundsMax = bounds.max;
+        writePositions(upload->positions, src->positions, upload->vertexCount, &bounds);
+        // without normals the staged ones are never read
+        upload->hasNormals = src->normals != NULL;
+        if (src->normals)
+            writeNormals(upload->normals, src->normals, upload->vertexCount);
+        // same for colors. the material color is multiplied in by the shader.
+        upload->hasColors = src->colors != NULL;
+        if (src->colors && compactVertices)
+        {
+            uint32_t* iter = upload->colors;
+            for (uint32_t i = 0; i < upload->vertexCount; i++) 
+                *iter++ = packColor(&src->colors[i]);
+        }
+        else if (src->colors)
+            memcpy(upload->colors, src->colors, upload->vertexCount * sizeof(Vec4));
+    }
+    r_StagingEndWrite(upload->ticket);
+}
+
+// where the indices of a set start, counted in indices of its width
+static uint32_t firstIndexOf(const SharedRange* indices)
+{
+    return indices->narrow ? 2 * indices->offset : indices->offset;
+}
+
+// compact positions are scaled to the bounds they were packed with, which
+// every prim drawing them shares
+static void writeAttributes(const Tanto_PrimId primId)
+{
+    const PrimGeo* geo = &scene.geos[primId];
+    const SharedRange* faceColors = getRange(&faceColorSets, geo->faceColorSet);
+    PrimAttributes* attributes = &scene.attributes[primId];
+    *attributes = (PrimAttributes){
+        .offset         = {{0.0, 0.0, 0.0}},
+        .flags          = (geo->hasNormals ? ATTRIBUTE_NORMALS : 0) | (geo->hasColors ? ATTRIBUTE_COLORS : 0),
+        .scale          = {{1.0, 1.0, 1.0}},
+        .firstFaceColor = faceColors ? faceColors->offset : NO_RANGE
+    };
+    if (!compactVertices)
+        return;
+    const R_Aabb* box = &geo->bounds;
+    for (int a = 0; a < 3; a++) 
+    {
+        attributes->offset.x[a] = box->min.x[a];
+        attributes->scale.x[a]  = box->max.x[a] - box->min.x[a];
+    }
+}
+
+static void writeDraw(const Tanto_PrimId primId)
+{
+    const PrimGeo* geo = &scene.geos[primId];
+    const SharedRange* vertices = getRange(&vertexSets, geo->vertexSet);
+    const SharedRange* indices  = getRange(&indexSets, geo->indexSet);
+    const PrimInstances* instances = &scene.instances[primId];
+    const uint32_t indexCount = vertices && indices ? indices->count : 0;
+    // firstInstance carries the prim id to the shaders, or the instances of
+    // the prim, which carry it themselves
+    scene.draws[primId] = (VkDrawIndexedIndirectCommand){
+        .indexCount    = indexCount,
+        .instanceCount = indexCount == 0 ? 0 : instances->instanced ? instances->count : 1,
+        .firstIndex    = indices ? firstIndexOf(indices) : 0,
+        .vertexOffset  = vertices ? vertices->offset : 0,
+        .firstInstance = instances->instanced ? INSTANCE_ID_BASE + instances->offset : primId
+    };
+    writeAttributes(primId);
+    touchDraw();
+}
+
+static void retireRange(R_Arena* arena, const uint32_t offset, const uint32_t count)
+{
+    if (count == 0)
+        return;
+    if (retired.count == retired.capacity)
+    {
+        retired.capacity = retired.capacity ? retired.capacity * 2 : 64;
+        retired.entries  = realloc(retired.entries, retired.capacity * sizeof(RetiredRange));
+        assert(retired.entries);
+    }
+    // every frame submitted so far may reference the range
+    retired.entries[retired.count++] = (RetiredRange){
+        .arena       = arena,
+        .offset      = offset,
+        .count       = count,
+        .retireFrame = frameSubmitted
+    };
+}
+
+static void retireInstances(PrimInstances* instances)
+{
+    if (instances->instanced)
+        retireRange(&geometry.instanceArena, instances->offset, instances->count);
+    *instances = (PrimInstances){0};
+}
+
+static void releaseLods(PrimGeo* geo)
+{
+    for (uint32_t i = 0; i < geo->lodCount; i++) 
+        releaseRange(&indexSets, &geometry.indexArena, geo->lodSets[i]);
+    geo->lodCount = 0;
+}
+
+static void retireGeometry(PrimGeo* geo)
+{
+    releaseRange(&vertexSets, &geometry.vertexArena, geo->vertexSet);
+    releaseRange(&indexSets,  &geometry.indexArena,  geo->indexSet);
+    releaseRange(&meshletSets, &geometry.meshletArena, geo->meshletSet);
+    releaseRange(&faceColorSets, &geometry.faceColorArena, geo->faceColorSet);
+    releaseLods(geo);
+}
+
+static void releaseRetiredGeometry(void)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < retired.count; i++) 
+    {
+        const RetiredRange* range = &retired.entries[i];
+        if (range->retireFrame <= frameCompleted)
+            r_ArenaRelease(range->arena, range->offset, range->count);
+        else
+            retired.entries[kept++] = *range;
+    }
+    retired.count = kept;
+}
+
+static void updateDynamicDescriptors(void)
+{
+}
+
+// bounds of a box under an affine transform, without transforming all eight
+// corners (Arvo). Mat4 is column major, x[col][row], as the shaders read it.
+static R_Aabb transformBounds(const Mat4* m, const R_Aabb* box)
+{
+    R_Aabb out;
+    for (int r = 0; r < 3; r++) 
+    {
+        out.min.x[r] = out.max.x[r] = m->x[3][r];
+        for (int c = 0; c < 3; c++) 
+        {
+            const float a = m->x[c][r] * box->min.x[c];
+            const float b = m->x[c][r] * box->max.x[c];
+            out.min.x[r] += a < b ? a : b;
+            out.max.x[r] += a < b ? b : a;
+        }
+    }
+    return out;
+}
+
+// |L q| <= |L| |q| for the linear part L of an instance, so every instance
+// of a box lies within maxScale times the box's farthest distance from the
+// origin of its translation
+static R_Aabb instancedBounds(const PrimInstances* instances, const R_Aabb* box)
+{
+    float centerSq = 0.0f;
+    float extentSq = 0.0f;
+    for (int a = 0; a < 3; a++) 
+    {
+        const float center = 0.5f * (box->min.x[a] + box->max.x[a]);
+        const float extent = 0.5f * (box->max.x[a] - box->min.x[a]);
+        centerSq += center * center;
+        extentSq += extent * extent;
+    }
+    const float pad = instances->maxScale * (sqrtf(centerSq) + sqrtf(extentSq));
+    R_Aabb out = instances->origins;
+    for (int a = 0; a < 3; a++) 
+    {
+        out.min.x[a] -= pad;
+        out.max.x[a] += pad;
+    }
+    return out;
+}
+
+// recomputes the world bounds of every prim that draws anything and rebuilds
+// or refits the hierarchy over them
+static void updateBounds(void)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < scene.primCount; i++) 
+    {
+        if (scene.draws[i].instanceCount == 0)
+            continue;
+        R_Aabb box = transformBounds(&scene.transforms[i], &scene.geos[i].bounds);
+        if (scene.instances[i].instanced)
+            box = instancedBounds(&scene.instances[i], &box);
+        culling.worldBounds[i] = box;
+        culling.ids[count++]   = i;
+    }
+    if (culling.bvhDirty)
+        r_BvhBuild(&culling.bvh, culling.worldBounds, culling.ids, count);
+    else
+        r_BvhRefit(&culling.bvh, culling.worldBounds);
+    culling.bvhDirty    = false;
+    culling.boundsDirty = false;
+}
+
+// world space planes of the clip volume, from the rows of proj * view. near
+// is taken at z = -w, which holds for GL style projections as well as
+// Vulkan ones.
+static void frustumPlanes(const CameraUBO* camera, Vec4 planes[6])
+{
+    float m[4][4];
+    for (int c = 0; c < 4; c++) 
+    {
+        for (int r = 0; r < 4; r++) 
+        {
+            m[c][r] = 0.0f;
+            for (int k = 0; k < 4; k++) 
+                m[c][r] += camera->matProj.x[k][r] * camera->matView.x[c][k];
+        }
+    }
+    for (int c = 0; c < 4; c++) 
+    {
+        planes[0].x[c] = m[c][3] + m[c][0];
+        planes[1].x[c] = m[c][3] - m[c][0];
+        planes[2].x[c] = m[c][3] + m[c][1];
+        planes[3].x[c] = m[c][3] - m[c][1];
+        planes[4].x[c] = m[c][3] + m[c][2];
+        planes[5].x[c] = m[c][3] - m[c][2];
+    }
+}
+
+static LodView lodView(const CameraUBO* camera)
+{
+    LodView view = {
+        .eye         = {{camera->viewInv.x[3][0], camera->viewInv.x[3][1], camera->viewInv.x[3][2]}},
+        .perspective = camera->matProj.x[2][3] != 0.0f
+    };
+    if (lodThreshold > 0.0f)
+        view.pixelScale = 0.5f * TANTO_WINDOW_HEIGHT * fabsf(camera->matProj.x[1][1]) / lodThreshold;
+    return view;
+}
+
+// the draw of a prim with the coarsest level of detail that is fine enough
+// at the point of its world bounds nearest to the eye. instances share a
+// level, picked for the nearest of them. narrow is set if the level has 16
+// bit indices.
+static VkDrawIndexedIndirectCommand lodDraw(const Tanto_PrimId primId, const LodView* view, bool* narrow)
+{
+    const PrimGeo* geo = &scene.geos[primId];
+    VkDrawIndexedIndirectCommand draw = scene.draws[primId];
+    const SharedRange* fullSet = getRange(&indexSets, geo->indexSet);
+    *narrow = fullSet && fullSet->narrow;
+    // face colors follow the triangles of the full set
+    if (geo->lodCount == 0 || geo->faceColorSet != NO_RANGE || view->pixelScale == 0.0f)
+        return draw;
+
+    // object space lengths grow by at most the largest column of the linear
+    // part of the transform
+    const Mat4* m = &scene.transforms[primId];
+    float scaleSq = 0.0f;
+    for (int c = 0; c < 3; c++) 
+    {
+        const float columnSq = m->x[c][0] * m->x[c][0] + m->x[c][1] * m->x[c][1] + m->x[c][2] * m->x[c][2];
+        if (columnSq > scaleSq)
+            scaleSq = columnSq;
+    }
+    float scale = sqrtf(scaleSq);
+    if (scene.instances[primId].instanced)
+        scale *= scene.instances[primId].maxScale;
+
+    float distance = 1.0f;
+    if (view->perspective)
+    {
+        const R_Aabb* box = &culling.worldBounds[primId];
+        float distanceSq = 0.0f;
+        for (int a = 0; a < 3; a++) 
+        {
+            const float below = box->min.x[a] - view->eye.x[a];
+            const float above = view->eye.x[a] - box->max.x[a];
+            const float d = below > 0.0f ? below : above > 0.0f ? above : 0.0f;
+            distanceSq += d * d;
+        }
+        distance = sqrtf(distanceSq);
+    }
+
+    // largest object space error that stays within the threshold
+    const float maxError = distance / (scale * view->pixelScale);
+    uint32_t lod = geo->lodCount;
+    while (lod > 0 && !(geo->lodErrors[lod - 1] <= maxError))
+        lod--;
+    if (lod == 0)
+        return draw;
+    const SharedRange* indices = getRange(&indexSets, geo->lodSets[lod - 1]);
+    draw.firstIndex = firstIndexOf(indices);
+    draw.indexCount = indices->count;
+    *narrow = indices->narrow;
+    return draw;
+}
+
+// the meshlet groups a frame slot dispatches, written to its work buffer
+typedef struct {
+    MeshletWork* work;
+    uint32_t     workCount;
+    uint32_t     drawCount[2];
+} MeshletQueue;
+
+static MeshletQueue beginMeshlets(const uint32_t frameSlot)
+{
+    const Tanto_V_BufferRegion work = getSlot(&meshlets.work, frameSlot);
+    return (MeshletQueue){ .work = (MeshletWork*)((uint8_t*)work.hostData + CULL_HEADER_SIZE) };
+}
+
+// queues the meshlets of a prim in place of its draw. they split its own
+// index set, so only prims drawn once and at full detail qualify, and only
+// while the buffers have room. the groups of both index widths share the
+// work buffer. face colors are fetched by primitive index, which starts over
+// with every meshlet draw.
+static bool queueMeshlets(MeshletQueue* queue, const Tanto_PrimId primId, const VkDrawIndexedIndirectCommand* draw, 
+        const bool narrow)
+{
+    const SharedRange* set = getRange(&meshletSets, scene.geos[primId].meshletSet);
+    if (!set || scene.instances[primId].instanced || draw->instanceCount == 0 ||
+        scene.geos[primId].faceColorSet != NO_RANGE ||
+        draw->firstIndex != scene.draws[primId].firstIndex)
+        return false;
+    const uint32_t capacity   = geometry.meshletArena.capacity;
+    const uint32_t groupCount = (set->count + MESHLET_GROUP_SIZE - 1) / MESHLET_GROUP_SIZE;
+    if (queue->drawCount[narrow] + set->count > capacity || queue->workCount + groupCount > capacity)
+        return false;
+    for (uint32_t first = 0; first < set->count; first += MESHLET_GROUP_SIZE)
+    {
+        const uint32_t count = set->count - first < MESHLET_GROUP_SIZE ? set->count - first : MESHLET_GROUP_SIZE;
+        queue->work[queue->workCount++] = (MeshletWork){
+            .primId       = primId,
+            .firstMeshlet = set->offset + first,
+            .meshletCount = count,
+            .firstDraw    = queue->drawCount[narrow],
+            .firstIndex   = draw->firstIndex,
+            .vertexOffset = draw->vertexOffset,
+            .narrow       = narrow
         };
+        queue->drawCount[narrow] += count;
+    }
+    return true;
+}
+
+static void endMeshlets(const uint32_t frameSlot, const MeshletQueue* queue)
+{
+    const Tanto_V_BufferRegion work = getSlot(&meshlets.work, frameSlot);
+    *(VkDispatchIndirectCommand*)work.hostData = (VkDispatchIndirectCommand){ queue->workCount, 1, 1 };
+    ((uint32_t*)work.hostData)[3] = geometry.meshletArena.capacity;
+    meshlets.drawCounts[frameSlot][0] = queue->drawCount[0];
+    meshlets.drawCounts[frameSlot][1] = queue->drawCount[1];
+}
+
+// occlusion culling takes the candidates as one list, along with their
+// bounds. prims drawn as meshlets are not candidates.
+static void writeCandidates(const uint32_t frameSlot, const uint32_t wordCount, const LodView* view, 
+        MeshletQueue* queue)
+{
+    const Tanto_V_BufferRegion draws  = getSlot(&drawBuffer, frameSlot);
+    const Tanto_V_BufferRegion bounds = getSlot(&occlusion.bounds, frameSlot);
+    VkDrawIndexedIndirectCommand* drawIter = (VkDrawIndexedIndirectCommand*)draws.hostData;
+    CullBounds* boundsIter = (CullBounds*)((uint8_t*)bounds.hostData + CULL_HEADER_SIZE);
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < wordCount; w++) 
+    {
+        for (uint64_t bits = culling.visible[w]; bits; bits &= bits - 1)
+        {
+            const uint32_t primId = w * 64 + __builtin_ctzll(bits);
+            bool narrow;
+            drawIter[count] = lodDraw(primId, view, &narrow);
+            if (queueMeshlets(queue, primId, &drawIter[count], narrow))
+                continue;
+            boundsIter[count] = (CullBounds){
+                .min    = culling.worldBounds[primId].min,
+                .primId = primId,
+                .max    = culling.worldBounds[primId].max,
+                .narrow = narrow
+            };
+            count++;
+        }
+    }
+    *(uint32_t*)bounds.hostData = count;
+    occlusion.candidateCounts[frameSlot] = count;
+}
+
+// end of the draws of a chunk in the draw buffer. the last chunk may be
+// cut short by the prim capacity.
+static uint32_t chunkEnd(const uint32_t chunkIndex)
+{
+    const uint32_t end = (chunkIndex + 1) * CHUNK_PRIM_COUNT;
+    return end < scene.primCapacity ? end : scene.primCapacity;
+}
+
+// writes the draws of the prims visible from the camera of a frame slot to
+// its draw buffer, at the level of detail that camera needs, and queues the
+// meshlets of those drawn as meshlets. the draws of a chunk are packed at
+// its start and the narrow ones at its end, so recording the chunk only
+// needs their counts. the slot must not be in flight.
+static void cullScene(const uint32_t frameSlot)
+{
+    if (frames.cullVersion[frameSlot] == culling.version)
+        return;
+    if (culling.boundsDirty)
+        updateBounds();
+
+    Vec4 planes[6];
+    frustumPlanes(&scene.camera[frameSlot], planes);
+    const uint32_t wordCount = (scene.primCount + 63) / 64;
+    memset(culling.visible, 0, wordCount * sizeof(uint64_t));
+    r_BvhCull(&culling.bvh, culling.worldBounds, planes, culling.visible);
+    frames.cullVersion[frameSlot] = culling.version;
+
+    const LodView view = lodView(&scene.camera[frameSlot]);
+    MeshletQueue queue = beginMeshlets(frameSlot);
+    if (occlusion.enabled)
+    {
+        writeCandidates(frameSlot, wordCount, &view, &queue);
+        endMeshlets(frameSlot, &queue);
+        return;
+    }
+
+    VkDrawIndexedIndirectCommand* draws = (VkDrawIndexedIndirectCommand*)getSlot(&drawBuffer, frameSlot).hostData;
+    const uint32_t chunkCount = (scene.primCount + CHUNK_PRIM_COUNT - 1) / CHUNK_PRIM_COUNT;
+    for (uint32_t c = 0; c < chunkCount; c++) 
+    {
+        const uint32_t firstDraw = c * CHUNK_PRIM_COUNT;
+        const uint32_t endDraw   = chunkEnd(c);
+        const uint32_t endWord   = (firstDraw + CHUNK_PRIM_COUNT) / 64 < wordCount ? 
+            (firstDraw + CHUNK_PRIM_COUNT) / 64 : wordCount;
+        uint32_t count = 0;
+        uint32_t narrowCount = 0;
+        for (uint32_t w = firstDraw / 64; w < endWord; w++) 
+        {
+            for (uint64_t bits = culling.visible[w]; bits; bits &= bits - 1)
+            {
+                const uint32_t primId = w * 64 + __builtin_ctzll(bits);
+                bool narrow;
+                const VkDrawIndexedIndirectCommand draw = lodDraw(primId, &view, &narrow);
+                if (queueMeshlets(&queue, primId, &draw, narrow))
+                    continue;
+                // a chunk has a place for every prim in it, so the lists
+                // never meet
+                if (narrow)
+                    draws[endDraw - ++narrowCount] = draw;
+                else
+                    draws[firstDraw + count++] = draw;
+            }
+        }
+        chunks.drawCounts[frameSlot][c]   = count;
+        chunks.narrowCounts[frameSlot][c] = narrowCount;
+    }
+    endMeshlets(frameSlot, &queue);
+}
+
+// one command per draw. tanto creates the device without multiDrawIndirect.
+static void drawIndexedIndirect(const VkCommandBuffer cmdBuf, const Tanto_V_BufferRegion* region, 
+        const uint32_t firstDraw, const uint32_t drawCount)
+{
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize offset = region->offset + firstDraw * stride;
+    for (uint32_t i = 0; i < drawCount; i++) 
+        vkCmdDrawIndexedIndirect(cmdBuf, region->buffer, offset + i * stride, 1, stride);
+}
+
+// narrow and wide index sets share the index buffer. firstIndex of narrow
+// draws counts 16 bit indices from its start.
+static void bindIndices(const VkCommandBuffer cmdBuf, const bool narrow)
+{
+    vkCmdBindIndexBuffer(cmdBuf, indexBuffer.buffer, indexBuffer.offset, 
+            narrow ? VK_INDEX_TYPE_UINT16 : TANTO_VERT_INDEX_TYPE);
+}
+
+// index widths the draws are split by
+static uint32_t indexWidthCount(void)
+{
+    return compactVertices ? 2 : 1;
+}
+
+static void bindMainPipeline(const VkCommandBuffer cmdBuf, const uint32_t frameSlot)
+{
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineMain);
+
+    const uint32_t cameraOffset = frameSlot * sizeof(CameraUBO);
+
+    vkCmdBindDescriptorSets(
+        cmdBuf, 
+        VK_PIPELINE_BIND_POINT_GRAPHICS, 
+        pipelineLayouts[R_PIPE_LAYOUT_MAIN], 
+        0, 1, &descriptorSets[R_DESC_SET_MAIN],
+        1, &cameraOffset);
+
+    const VkBuffer vertBuffers[2] = {
+        positionBuffer.buffer,
+        vertColorBuffer.buffer
+    };
+
+    const VkDeviceSize attrOffsets[2] = {
+        positionBuffer.offset,
+        vertColorBuffer.offset
+    };
 
-        vkCmdBindVertexBuffers(*cmdBuf, 0, 2, vertBuffers, attrOffsets);
+    vkCmdBindVertexBuffers(cmdBuf, 0, 2, vertBuffers, attrOffsets);
 
-        vkCmdBindIndexBuffer(*cmdBuf, prim.indexRegion.buffer, 
-                prim.indexRegion.offset, TANTO_VERT_INDEX_TYPE);
+    bindIndices(cmdBuf, false);
+}
+
+static void recordChunk(const uint32_t frameSlot, const uint32_t chunkIndex)
+{
+    const VkCommandBuffer cmdBuf = chunks.cmds[frameSlot][chunkIndex];
+    const uint32_t firstDraw   = chunkIndex * CHUNK_PRIM_COUNT;
+    const uint32_t drawCount   = chunks.drawCounts[frameSlot][chunkIndex];
+    const uint32_t narrowCount = chunks.narrowCounts[frameSlot][chunkIndex];
+
+    const VkCommandBufferInheritanceInfo inheritance = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = renderpass,
+        .subpass = 0,
+        .framebuffer = framebuffers[frameSlot]
+    };
+
+    const VkCommandBufferBeginInfo cbbi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritance
+    };
+
+    V_ASSERT( vkBeginCommandBuffer(cmdBuf, &cbbi) );
 
-        vkCmdDrawIndexed(*cmdBuf, prim.indexCount, 1, 0, 0, 0);
+    chunks.recordedVersions[frameSlot][chunkIndex] = sceneVersion;
+    chunks.recordedCounts[frameSlot][chunkIndex]   = drawCount;
+    chunks.recordedNarrowCounts[frameSlot][chunkIndex] = narrowCount;
+
+    // everything in the chunk is culled
+    if (drawCount == 0 && narrowCount == 0)
+    {
+        V_ASSERT( vkEndCommandBuffer(cmdBuf) );
+        return;
     }
 
+    bindMainPipeline(cmdBuf, frameSlot);
+
+    // edits inside the chunk are pure data changes. only its visible draw
+    // counts are baked into the commands.
+    const Tanto_V_BufferRegion draws = getSlot(&drawBuffer, frameSlot);
+    if (drawCount)
+        drawIndexedIndirect(cmdBuf, &draws, firstDraw, drawCount);
+    if (narrowCount)
+    {
+        bindIndices(cmdBuf, true);
+        drawIndexedIndirect(cmdBuf, &draws, chunkEnd(chunkIndex) - narrowCount, narrowCount);
+    }
+
+    V_ASSERT( vkEndCommandBuffer(cmdBuf) );
+}
+
+static void mainRender(const uint32_t frameSlot, const VkCommandBuffer* cmdBuf, const VkRenderPassBeginInfo* rpassInfo)
+{
+    vkCmdBeginRenderPass(*cmdBuf, rpassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    if (chunks.count[frameSlot])
+        vkCmdExecuteCommands(*cmdBuf, chunks.count[frameSlot], chunks.cmds[frameSlot]);
+    vkCmdExecuteCommands(*cmdBuf, 1, &meshlets.cmds[frameSlot]);
+
     vkCmdEndRenderPass(*cmdBuf);
 }
 
-static void printMaterials(void)
+static void memoryBarrier(const VkCommandBuffer cmdBuf, 
+        const VkPipelineStageFlags srcStage, const VkAccessFlags srcAccess, 
+        const VkPipelineStageFlags dstStage, const VkAccessFlags dstAccess)
+{
+    const VkMemoryBarrier barrier = {
+        .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess
+    };
+    vkCmdPipelineBarrier(cmdBuf, srcStage, dstStage, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+static void depthBarrier(const VkCommandBuffer cmdBuf, 
+        const VkImageLayout oldLayout, const VkImageLayout newLayout,
+        const VkPipelineStageFlags srcStage, const VkAccessFlags srcAccess, 
+        const VkPipelineStageFlags dstStage, const VkAccessFlags dstAccess)
+{
+    const VkImageMemoryBarrier barrier = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask       = srcAccess,
+        .dstAccessMask       = dstAccess,
+        .oldLayout           = oldLayout,
+        .newLayout           = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = attachmentDepth.handle,
+        .subresourceRange    = {
+            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+            .levelCount = 1,
+            .layerCount = 1
+        }
+    };
+    vkCmdPipelineBarrier(cmdBuf, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+static void colorBarrier(const VkCommandBuffer cmdBuf, const VkImage image,
+        const VkImageLayout oldLayout, const VkImageLayout newLayout,
+        const VkPipelineStageFlags srcStage, const VkAccessFlags srcAccess, 
+        const VkPipelineStageFlags dstStage, const VkAccessFlags dstAccess)
+{
+    const VkImageMemoryBarrier barrier = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask       = srcAccess,
+        .dstAccessMask       = dstAccess,
+        .oldLayout           = oldLayout,
+        .newLayout           = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = image,
+        .subresourceRange    = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = 1,
+            .layerCount = 1
+        }
+    };
+    vkCmdPipelineBarrier(cmdBuf, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+static void pushCullConstants(const VkCommandBuffer cmdBuf, const uint32_t phase)
+{
+    const CullPushConstants pc = {
+        .phase        = phase,
+        .drawCapacity = scene.primCapacity,
+        .width        = TANTO_WINDOW_WIDTH,
+        .height       = TANTO_WINDOW_HEIGHT,
+        .levelCount   = occlusion.levelCount
+    };
+    vkCmdPushConstants(cmdBuf, pipelineLayouts[R_PIPE_LAYOUT_CULL], VK_SHADER_STAGE_COMPUTE_BIT, 
+            0, sizeof(pc), &pc);
+}
+
+// the draws a cull pass wrote, a list per index width. a candidate has a
+// place in both lists, empty in the one of the other width or if it was
+// culled, so every list is as long as the candidates.
+static void drawCulled(const VkCommandBuffer cmdBuf, const uint32_t frameSlot, const uint32_t phase)
+{
+    const Tanto_V_BufferRegion draws = getSlot(&occlusion.output, frameSlot);
+    const uint32_t drawCount = occlusion.recordedCounts[frameSlot];
+    if (drawCount == 0)
+        return;
+    for (uint32_t narrow = 0; narrow < indexWidthCount(); narrow++) 
+    {
+        const uint32_t list = phase * 2 + narrow;
+        bindIndices(cmdBuf, narrow);
+        drawIndexedIndirect(cmdBuf, &draws, list * scene.primCapacity, drawCount);
+    }
+}
+
+// culls the meshlets queued for a frame slot. the dispatch is read from the
+// work buffer, so the commands do not change with it.
+static void cullMeshlets(const VkCommandBuffer cmdBuf, const uint32_t frameSlot)
+{
+    const Tanto_V_BufferRegion work = getSlot(&meshlets.work, frameSlot);
+    const uint32_t dynamicOffsets[] = {
+        frameSlot * sizeof(CameraUBO),
+        frameSlot * meshlets.work.sliceSize,
+        frameSlot * meshlets.output.sliceSize
+    };
+
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineMeshlet);
+    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts[R_PIPE_LAYOUT_MESHLET], 
+            0, 1, &descriptorSets[R_DESC_SET_MESHLET], TANTO_ARRAY_SIZE(dynamicOffsets), dynamicOffsets);
+    vkCmdDispatchIndirect(cmdBuf, work.buffer, work.offset);
+    memoryBarrier(cmdBuf, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+// the draws cullMeshlets wrote. without drawIndirectCount their number is
+// baked in, like the draw counts of the chunks.
+static void drawMeshlets(const VkCommandBuffer cmdBuf, const uint32_t frameSlot)
+{
+    const Tanto_V_BufferRegion draws = getSlot(&meshlets.output, frameSlot);
+    const uint32_t capacity = geometry.meshletArena.capacity;
+    for (uint32_t narrow = 0; narrow < indexWidthCount(); narrow++) 
+    {
+        const uint32_t drawCount = meshlets.drawCounts[frameSlot][narrow];
+        meshlets.recordedCounts[frameSlot][narrow] = drawCount;
+        bindIndices(cmdBuf, narrow);
+        if (drawCount)
+            drawIndexedIndirect(cmdBuf, &draws, narrow * capacity, drawCount);
+    }
+}
+
+static void recordMeshlets(const uint32_t frameSlot)
+{
+    const VkCommandBuffer cmdBuf = meshlets.cmds[frameSlot];
+
+    const VkCommandBufferInheritanceInfo inheritance = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = renderpass,
+        .subpass = 0,
+        .framebuffer = framebuffers[frameSlot]
+    };
+
+    const VkCommandBufferBeginInfo cbbi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritance
+    };
+
+    V_ASSERT( vkBeginCommandBuffer(cmdBuf, &cbbi) );
+    meshlets.recordedVersions[frameSlot] = sceneVersion;
+    bindMainPipeline(cmdBuf, frameSlot);
+    drawMeshlets(cmdBuf, frameSlot);
+    V_ASSERT( vkEndCommandBuffer(cmdBuf) );
+}
+
+// the first pass draws the candidates that were visible in the last frame.
+// its depth is reduced to the pyramid that the second cull pass tests every
+// candidate against, and the second pass draws the visible ones the first
+// one missed. the result does not depend on the last frame being similar,
+// that only decides how much is drawn early.
+static void occlusionRender(const uint32_t frameSlot, const VkCommandBuffer cmdBuf, const VkRenderPassBeginInfo* rpassInfo)
+{
+    const uint32_t dynamicOffsets[] = {
+        frameSlot * sizeof(CameraUBO),
+        frameSlot * drawBuffer.sliceSize,
+        frameSlot * occlusion.bounds.sliceSize,
+        frameSlot * occlusion.output.sliceSize
+    };
+    // the draws are recorded for as many candidates as the dispatches test
+    occlusion.recordedCounts[frameSlot] = occlusion.candidateCounts[frameSlot];
+    const uint32_t groupCount = (occlusion.recordedCounts[frameSlot] + 63) / 64;
+
+    // the compute passes of the last frame may still use the visibility and
+    // the pyramid
+    cullMeshlets(cmdBuf, frameSlot);
+    memoryBarrier(cmdBuf, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineCull);
+    vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts[R_PIPE_LAYOUT_CULL], 
+            0, 1, &descriptorSets[R_DESC_SET_CULL], TANTO_ARRAY_SIZE(dynamicOffsets), dynamicOffsets);
+    pushCullConstants(cmdBuf, 0);
+    vkCmdDispatch(cmdBuf, groupCount, 1, 1);
+    memoryBarrier(cmdBuf, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+    VkRenderPassBeginInfo passInfo = *rpassInfo;
+    passInfo.renderPass = renderpassOcclusion;
+    vkCmdBeginRenderPass(cmdBuf, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+    bindMainPipeline(cmdBuf, frameSlot);
+    drawCulled(cmdBuf, frameSlot, 0);
+    drawMeshlets(cmdBuf, frameSlot);
+    vkCmdEndRenderPass(cmdBuf);
+
+    depthBarrier(cmdBuf, 
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineHiZ);
+    uint32_t width  = TANTO_WINDOW_WIDTH;
+    uint32_t height = TANTO_WINDOW_HEIGHT;
+    for (uint32_t level = 0; level < occlusion.levelCount; level++) 
+    {
+        width  = (width  + 1) / 2;
+        height = (height + 1) / 2;
+        pushCullConstants(cmdBuf, level);
+        vkCmdDispatch(cmdBuf, (width + 7) / 8, (height + 7) / 8, 1);
+        memoryBarrier(cmdBuf, 
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineCull);
+    pushCullConstants(cmdBuf, 1);
+    vkCmdDispatch(cmdBuf, groupCount, 1, 1);
+    memoryBarrier(cmdBuf, 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    depthBarrier(cmdBuf, 
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+    memoryBarrier(cmdBuf, 
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+    passInfo.renderPass = renderpassLoad;
+    vkCmdBeginRenderPass(cmdBuf, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+    bindMainPipeline(cmdBuf, frameSlot);
+    drawCulled(cmdBuf, frameSlot, 1);
+    vkCmdEndRenderPass(cmdBuf);
+}
+
+#if VERBOSE
+static void printMaterials(void)
+{
+    for (uint32_t i = 0; i < scene.primCount; i++) 
+    {
+        printf("Material %d: ", i);   
+        printVec4(&scene.materials[i].color);
+    }
+}
+#endif
+
+bool r_HasVulkanDevice(void)
+{
+    const VkApplicationInfo appInfo = {
+        .sType      = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .apiVersion = VK_API_VERSION_1_2,
+    };
+    const VkInstanceCreateInfo info = {
+        .sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &appInfo,
+    };
+    VkInstance instance;
+    if (vkCreateInstance(&info, NULL, &instance) != VK_SUCCESS)
+        return false;
+    uint32_t deviceCount = 0;
+    const VkResult r = vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
+    vkDestroyInstance(instance, NULL);
+    return r == VK_SUCCESS && deviceCount > 0;
+}
+
+void r_SetCompactVertices(bool enable)
 {
-    for (int i = 0; i < scene.primCount; i++) 
-    {
-        printf("Material %d: ", i);   
-        printVec4(&scene.materials[i].color);
-    }
+    // the vertex format cannot change under existing geometry
+    assert(geometry.vertexArena.capacity == 0);
+    compactVertices = enable;
+    positionSize    = enable ? sizeof(PackedPosition) : sizeof(Vec3);
+    colorSize       = enable ? sizeof(uint32_t) : sizeof(Vec4);
 }
 
 void r_InitScene(void)
 {
     // we just want to initialize the mesh buffers first because the mesh syncs get called before 
     // we know the window size
+    r_StagingInit();
+    cmdPoolGrowth = tanto_v_RequestCommandPool(TANTO_V_QUEUE_GRAPHICS_TYPE);
+    cmdPoolReadback = tanto_v_RequestCommandPool(TANTO_V_QUEUE_GRAPHICS_TYPE);
     initDescriptorSetsAndPipelineLayouts();
     updateStaticDescriptors();
     // bind the scene to the buffer memory
-    scene.camera     = (CameraUBO*)cameraBuffer.hostData;
-    scene.materials  = (Tanto_R_Material*)materialBuffer.hostData;
-    scene.transforms = (Mat4*)transformBuffer.hostData;
+    scene.camera    = (CameraUBO*)cameraBuffer.hostData; // R_FRAME_COUNT slices
     scene.primCount = 0;
+    scene.liveCount = 0;
+    sceneVersion    = 1;
+    scene.freeCount = 0;
+    growPrimStorage(INIT_PRIM_CAPACITY);
+    growVertexStorage(INIT_VERTEX_CAPACITY);
+    growIndexStorage(INIT_INDEX_CAPACITY);
+    growInstanceStorage(INIT_INSTANCE_CAPACITY);
+    growMeshletStorage(INIT_MESHLET_CAPACITY);
+    growFaceColorStorage(INIT_FACE_COLOR_CAPACITY);
+
+    occlusion.enabled = false;
 }
 
 void r_InitRenderer(void)
@@ -364,117 +2761,949 @@ void r_InitRenderer(void)
     initPipelines();
     //updateStaticDescriptors();
 
-    cmdPoolRender = tanto_v_RequestCommandPool(TANTO_V_QUEUE_GRAPHICS_TYPE);
+    const VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = VK_FENCE_CREATE_SIGNALED_BIT
+    };
+
+    for (uint32_t i = 0; i < R_FRAME_COUNT; i++) 
+    {
+        frames.cmdPool[i] = tanto_v_RequestCommandPool(TANTO_V_QUEUE_GRAPHICS_TYPE);
+        frames.readbackPool[i] = tanto_v_RequestCommandPool(TANTO_V_QUEUE_GRAPHICS_TYPE);
+        V_ASSERT( vkCreateFence(device, &fenceInfo, NULL, &frames.fence[i]) );
+    }
+
+    // chunk buffers are re-recorded individually, so the pool must allow
+    // resetting them one at a time
+    const VkCommandPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = graphicsQueueFamilyIndex
+    };
+    V_ASSERT( vkCreateCommandPool(device, &poolInfo, NULL, &cmdPoolChunks) );
+
+    const VkCommandBufferAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = cmdPoolChunks,
+        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = R_FRAME_COUNT
+    };
+    V_ASSERT( vkAllocateCommandBuffers(device, &allocInfo, meshlets.cmds) );
 
     //prim = tanto_r_CreateTriangle();
 }
 
-void r_UpdateRenderCommands(Tanto_V_BufferRegion* colorBuffer)
+// only the resolved aovs leave the GPU. integer aovs take one of the
+// samples, the others are averaged.
+static void resolveSamples(const VkCommandBuffer cmdBuf, const uint32_t frameSlot)
+{
+    for (int aov = 0; aov < R_AOV_COUNT; aov++)
+    {
+        if (!(aovMask & R_AOV_BIT(aov)))
+            continue;
+        const Tanto_V_Image* src = &attachmentSamples[aov];
+        const Tanto_V_Image* dst = &attachmentAovs[frameSlot][aov];
+        colorBarrier(cmdBuf, dst->handle, 
+                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+        const VkImageSubresourceLayers subresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .layerCount = 1
+        };
+        const VkImageResolve region = {
+            .srcSubresource = subresource,
+            .dstSubresource = subresource,
+            .extent         = dst->extent
+        };
+        vkCmdResolveImage(cmdBuf, src->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                dst->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        colorBarrier(cmdBuf, dst->handle, 
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, frameImageLayout,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
+                VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+    }
+}
+
+static void recordPrimary(const uint32_t frameSlot)
 {
-    vkResetCommandPool(device, cmdPoolRender.handle, 0);
+    const Tanto_V_CommandPool* cmdPool = &frames.cmdPool[frameSlot];
 
-    VkCommandBufferBeginInfo cbbi = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    V_ASSERT( vkBeginCommandBuffer(cmdPoolRender.buffer, &cbbi) );
+    vkResetCommandPool(device, cmdPool->handle, 0);
 
-    VkClearValue clearValueColor = {0.002f, 0.023f, 0.009f, 1.0f};
-    VkClearValue clearValueDepth = {1.0, 0};
+    VkCommandBufferBeginInfo cbbi = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    V_ASSERT( vkBeginCommandBuffer(cmdPool->buffer, &cbbi) );
 
-    VkClearValue clears[] = {clearValueColor, clearValueDepth};
+    // in the order of the attachments, see createRenderPass
+    VkClearValue clears[1 + R_AOV_COUNT] = {{.depthStencil = {1.0, 0}}};
+    uint32_t clearCount = 1;
+    for (int aov = 0; aov < R_AOV_COUNT; aov++)
+    {
+        if (aovMask & R_AOV_BIT(aov))
+            clears[clearCount++] = aovClears[aov];
+    }
 
     const VkRenderPassBeginInfo rpassInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .clearValueCount = 2,
+        .clearValueCount = clearCount,
         .pClearValues = clears,
         .renderArea = {{0, 0}, {TANTO_WINDOW_WIDTH, TANTO_WINDOW_HEIGHT}},
         .renderPass =  renderpass,
-        .framebuffer = framebuffer
+        .framebuffer = framebuffers[frameSlot]
     };
 
-    mainRender(&cmdPoolRender.buffer, &rpassInfo);
+    if (occlusion.enabled)
+        occlusionRender(frameSlot, cmdPool->buffer, &rpassInfo);
+    else
+    {
+        cullMeshlets(cmdPool->buffer, frameSlot);
+        mainRender(frameSlot, &cmdPool->buffer, &rpassInfo);
+    }
+    if (sampleCount != VK_SAMPLE_COUNT_1_BIT)
+        resolveSamples(cmdPool->buffer, frameSlot);
+
+    V_ASSERT( vkEndCommandBuffer(cmdPool->buffer) );
+
+    frames.primaryVersion[frameSlot] = sceneVersion;
+}
+
+// records the chunks of a frame slot that changed since they were last
+// recorded and, if any did, the primary buffer that executes them. the slot
+// must not be in flight.
+static void updateRenderCommands(const uint32_t frameSlot)
+{
+    // the counts of the culled and the meshlet draws are baked in
+    const bool meshletsChanged = memcmp(meshlets.recordedCounts[frameSlot], meshlets.drawCounts[frameSlot], 
+            sizeof(meshlets.drawCounts[frameSlot])) != 0;
+    if (occlusion.enabled)
+    {
+        if (frames.primaryVersion[frameSlot] < bindingVersion || meshletsChanged ||
+            occlusion.recordedCounts[frameSlot] != occlusion.candidateCounts[frameSlot])
+            recordPrimary(frameSlot);
+        return;
+    }
+
+    const uint32_t chunkCount = (scene.primCount + CHUNK_PRIM_COUNT - 1) / CHUNK_PRIM_COUNT;
+    bool recordPrimaryBuffer = chunkCount != chunks.count[frameSlot] || 
+        frames.primaryVersion[frameSlot] < bindingVersion;
+
+    if (chunkCount > chunks.cmdCount[frameSlot])
+    {
+        const VkCommandBufferAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = cmdPoolChunks,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = chunkCount - chunks.cmdCount[frameSlot]
+        };
+        V_ASSERT( vkAllocateCommandBuffers(device, &allocInfo, 
+                    chunks.cmds[frameSlot] + chunks.cmdCount[frameSlot]) );
+        chunks.cmdCount[frameSlot] = chunkCount;
+    }
+
+    for (uint32_t i = 0; i < chunkCount; i++) 
+    {
+        if (chunks.recordedVersions[frameSlot][i] < bindingVersion || 
+            chunks.recordedCounts[frameSlot][i] != chunks.drawCounts[frameSlot][i] ||
+            chunks.recordedNarrowCounts[frameSlot][i] != chunks.narrowCounts[frameSlot][i])
+        {
+            recordChunk(frameSlot, i);
+            recordPrimaryBuffer = true;
+        }
+    }
+    chunks.count[frameSlot] = chunkCount;
+
+    if (meshlets.recordedVersions[frameSlot] < bindingVersion || meshletsChanged)
+    {
+        recordMeshlets(frameSlot);
+        recordPrimaryBuffer = true;
+    }
+
+    if (recordPrimaryBuffer)
+    {
+        recordPrimary(frameSlot);
+#if VERBOSE
+        printMaterials();
+#endif
+    }
+}
+
+// advances frameCompleted past every frame whose fence has signaled
+static void pollFrames(void)
+{
+    while (frameCompleted < frameSubmitted)
+    {
+        const VkFence fence = frames.fence[(frameCompleted + 1) % R_FRAME_COUNT];
+        if (vkGetFenceStatus(device, fence) != VK_SUCCESS)
+            break;
+        frameCompleted++;
+    }
+}
 
-    const VkImageSubresourceLayers subRes = {
-        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        .baseArrayLayer = 0,
-        .layerCount = 1, 
-        .mipLevel = 0,
+void r_UpdateRenderCommands(void)
+{
+    // the framebuffers may have changed. every slot picks this up the next
+    // time it is submitted.
+    invalidateRenderCommands();
+}
+
+void r_CommitResources(void)
+{
+    r_StagingFlush();
+}
+
+static bool recordFrameReadbacks(uint64_t frame);
+
+uint64_t r_Render(void)
+{
+    // uploads staged since the last commit go out with this frame
+    r_StagingFlush();
+    r_StagingSubmitAcquires();
+
+    const uint64_t frame = frameSubmitted + 1;
+    const uint32_t slot  = frame % R_FRAME_COUNT;
+
+    // wait for the frame that used this slot before us
+    r_WaitFrame(frame > R_FRAME_COUNT ? frame - R_FRAME_COUNT : 0);
+    V_ASSERT( vkResetFences(device, 1, &frames.fence[slot]) );
+    releaseRetiredGeometry();
+
+    scene.camera[slot] = pendingCamera;
+    cullScene(slot);
+    updateRenderCommands(slot);
+
+    // the copies go in a buffer of their own, so the cached frame commands
+    // do not depend on them
+    const VkCommandBuffer cmdBufs[] = {
+        frames.cmdPool[slot].buffer, frames.readbackPool[slot].buffer
     };
+    const VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = recordFrameReadbacks(frame) ? 2 : 1,
+        .pCommandBuffers = cmdBufs
+    };
+
+    V_ASSERT( vkQueueSubmit(graphicsQueues[0], 1, &submitInfo, frames.fence[slot]) );
+    frameSubmitted = frame;
+    return frame;
+}
+
+bool r_IsFrameComplete(uint64_t frame)
+{
+    pollFrames();
+    return frame <= frameCompleted;
+}
+
+void r_WaitFrame(uint64_t frame)
+{
+    if (frame <= frameCompleted)
+        return;
+    assert(frame <= frameSubmitted);
+    const VkFence fence = frames.fence[frame % R_FRAME_COUNT];
+    V_ASSERT( vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) );
+    frameCompleted = frame;
+}
+
+uint32_t r_GetFrameSlot(uint64_t frame)
+{
+    return frame % R_FRAME_COUNT;
+}
 
-    const VkOffset3D imgOffset = {
-        .x = 0,
-        .y = 0,
-        .z = 0
+// a frame's slot is reused by the frame R_FRAME_COUNT after it
+bool r_IsFrameHeld(uint64_t frame)
+{
+    return frame >= firstHeldFrame && frame <= frameSubmitted && frame + R_FRAME_COUNT > frameSubmitted;
+}
+
+Tanto_FrameImage r_GetFrameImage(uint64_t frame, Tanto_Aov aov)
+{
+    assert(r_IsFrameHeld(frame));
+    assert(aovMask & R_AOV_BIT(aov));
+    const Tanto_V_Image* image = &attachmentAovs[frame % R_FRAME_COUNT][aov];
+    return (Tanto_FrameImage){
+        .image     = image->handle,
+        .view      = image->view,
+        .layout    = frameImageLayout,
+        .format    = aovFormats[aov],
+        .texelSize = aovTexelSizes[aov],
+        .width     = image->extent.width,
+        .height    = image->extent.height
     };
+}
+
+static VkDeviceSize aovImageSize(const Tanto_Aov aov)
+{
+    return (VkDeviceSize)TANTO_WINDOW_WIDTH * TANTO_WINDOW_HEIGHT * aovTexelSizes[aov];
+}
+
+// leaves the image in the layout it was in
+static void recordAovCopy(const VkCommandBuffer cmdBuf, const Tanto_V_Image* image, 
+        const Tanto_V_BufferRegion* dst)
+{
+    // the image was last written by the render pass or a resolve
+    colorBarrier(cmdBuf, image->handle, 
+            frameImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
 
     const VkBufferImageCopy imgCopy = {
-        .imageOffset = imgOffset,
-        .imageExtent = attachmentColor.extent,
-        .imageSubresource = subRes,
-        .bufferOffset = colorBuffer->offset,
+        .bufferOffset      = dst->offset,
+        .bufferRowLength   = 0,
         .bufferImageHeight = 0,
-        .bufferRowLength = 0
+        .imageSubresource  = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .layerCount = 1
+        },
+        .imageOffset       = {0, 0, 0},
+        .imageExtent       = image->extent
+    };
+    vkCmdCopyImageToBuffer(cmdBuf, image->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst->buffer, 1, &imgCopy);
+
+    // the image goes back to where clients sampling it expect it
+    colorBarrier(cmdBuf, image->handle, 
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frameImageLayout,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+// records the copies of the frame into the readback command buffer of its
+// slot. returns false if there are none.
+static bool recordFrameReadbacks(uint64_t frame)
+{
+    const uint32_t slot = frame % R_FRAME_COUNT;
+    if (!(readbacks.mask & aovMask))
+        return false;
+    const VkCommandBuffer cmdBuf = frames.readbackPool[slot].buffer;
+    vkResetCommandPool(device, frames.readbackPool[slot].handle, 0);
+
+    const VkCommandBufferBeginInfo cbbi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
     };
+    V_ASSERT( vkBeginCommandBuffer(cmdBuf, &cbbi) );
+    for (int aov = 0; aov < R_AOV_COUNT; aov++)
+    {
+        if (!(readbacks.mask & aovMask & R_AOV_BIT(aov)))
+            continue;
+        const Tanto_V_BufferRegion* dst = &readbacks.regions[aov][frame % R_READBACK_COUNT];
+        // the regions may not have caught up with a new viewport yet
+        if (dst->size < aovImageSize(aov))
+            continue;
+        recordAovCopy(cmdBuf, &attachmentAovs[slot][aov], dst);
+    }
+    memoryBarrier(cmdBuf, 
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    V_ASSERT( vkEndCommandBuffer(cmdBuf) );
+    return true;
+}
 
-    vkCmdCopyImageToBuffer(cmdPoolRender.buffer, attachmentColor.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, colorBuffer->buffer, 1, &imgCopy);
+void r_ReadbackFrame(uint64_t frame, Tanto_Aov aov, const Tanto_V_BufferRegion* dst)
+{
+    assert(r_IsFrameHeld(frame));
+    assert(aovMask & R_AOV_BIT(aov));
+    assert(dst->size >= aovImageSize(aov));
+    r_WaitFrame(frame);
 
-    V_ASSERT( vkEndCommandBuffer(cmdPoolRender.buffer) );
+    const VkCommandBuffer cmdBuf = cmdPoolReadback.buffer;
+    vkResetCommandPool(device, cmdPoolReadback.handle, 0);
 
-    printMaterials();
+    const VkCommandBufferBeginInfo cbbi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    V_ASSERT( vkBeginCommandBuffer(cmdBuf, &cbbi) );
+    recordAovCopy(cmdBuf, &attachmentAovs[frame % R_FRAME_COUNT][aov], dst);
+    memoryBarrier(cmdBuf, 
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    V_ASSERT( vkEndCommandBuffer(cmdBuf) );
+
+    const VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdBuf
+    };
+    V_ASSERT( vkQueueSubmit(graphicsQueues[0], 1, &submitInfo, VK_NULL_HANDLE) );
+    V_ASSERT( vkQueueWaitIdle(graphicsQueues[0]) );
 }
 
-void r_Render(void)
+void r_SetAovReadback(Tanto_Aov aov, const Tanto_V_BufferRegion* regions)
 {
-    tanto_v_SubmitAndWait(&cmdPoolRender, 0);
+    // frames in flight may still copy into the old regions
+    if (readbacks.mask & R_AOV_BIT(aov))
+        r_WaitFrame(frameSubmitted);
+    readbacks.mask &= ~R_AOV_BIT(aov);
+    if (!regions)
+        return;
+    for (int i = 0; i < R_READBACK_COUNT; i++)
+        readbacks.regions[aov][i] = regions[i];
+    readbacks.mask |= R_AOV_BIT(aov);
 }
 
-void r_UpdateViewport(unsigned int width, unsigned int height,
-        Tanto_V_BufferRegion* colorBuffer)
+static void cleanUpFrames(void);
+
+void r_UpdateViewport(unsigned int width, unsigned int height)
 {
     vkDeviceWaitIdle(device);
     r_SetViewport(width, height);
+    // levels of detail are picked by their size in pixels
+    culling.version++;
 
-    r_CleanUp();
+    cleanUpFrames();
 
     initAttachments();
     initPipelines();
     initFramebuffer();
 
-    r_UpdateRenderCommands(colorBuffer);
+    r_UpdateRenderCommands();
+}
+
+// the slot draws nothing until geometry is published to it
+static Tanto_PrimId allocPrimSlot(void)
+{
+    Tanto_PrimId primId;
+    if (scene.freeCount)
+    {
+        primId = scene.freeSlots[--scene.freeCount];
+    }
+    else
+    {
+        primId = scene.primCount;
+        if (primId == scene.primCapacity)
+            growPrimStorage(scene.primCapacity + 1);
+        scene.primCount++;
+        scene.geos[primId]      = emptyGeo;
+        scene.instances[primId] = (PrimInstances){0};
+        writeDraw(primId);
+    }
+    scene.pickIds[primId] = -1;
+    scene.liveCount++;
+    return primId;
+}
+
+Tanto_PrimUpload r_ReservePrim(uint32_t vertexCount, Tanto_IndexSetId indexSet)
+{
+    return stageVertices(allocPrimSlot(), vertexCount, indexSet);
+}
+
+// the prim keeps drawing its old geometry until the upload is published
+Tanto_PrimUpload r_ReservePrimGeometry(Tanto_PrimId primId, uint32_t vertexCount, Tanto_IndexSetId indexSet)
+{
+    assert(primId < scene.primCount);
+    return stageVertices(primId, vertexCount, indexSet);
+}
+
+void r_WritePrimGeometry(Tanto_PrimUpload* upload, const Tanto_PrimGeometry* src)
+{
+    writeVertices(upload, src);
+}
+
+void r_PublishPrim(const Tanto_PrimUpload* upload)
+{
+    const Tanto_PrimId primId = upload->id;
+    assert(primId < scene.primCount);
+    // retain first, the old geometry may use the same set. the vertex set was
+    // created for the upload and its reference passes to the prim.
+    retainRange(&indexSets, upload->indexSet);
+    retireGeometry(&scene.geos[primId]);
+    scene.geos[primId] = (PrimGeo){
+        .vertexSet    = upload->vertexSet,
+        .indexSet     = upload->indexSet,
+        .meshletSet   = NO_RANGE,
+        .faceColorSet = NO_RANGE,
+        .bounds       = { .min = upload->boundsMin, .max = upload->boundsMax },
+        .hasNormals   = upload->hasNormals,
+        .hasColors    = upload->hasColors
+    };
+    writeDraw(primId);
+}
+
+Tanto_PrimId r_AddNewPrim(const Tanto_PrimGeometry* newGeo, Tanto_R_Material newMat, Mat4 xform)
+{
+    Tanto_PrimUpload upload = r_ReservePrim(newGeo->vertexCount, newGeo->indexSet);
+    writeVertices(&upload, newGeo);
+    scene.materials[upload.id]  = newMat;
+    scene.transforms[upload.id] = xform;
+    r_PublishPrim(&upload);
+    return upload.id;
+}
+
+// replaces the geometry of an existing prim. only needed when its topology
+// changes; the old ranges are released once no frame reads them.
+void r_UpdatePrimGeometry(Tanto_PrimId primId, const Tanto_PrimGeometry* newGeo)
+{
+    Tanto_PrimUpload upload = r_ReservePrimGeometry(primId, newGeo->vertexCount, newGeo->indexSet);
+    writeVertices(&upload, newGeo);
+    r_PublishPrim(&upload);
+}
+
+// releases the slot of a prim. its geometry is freed once no submitted frame
+// can read it anymore and the slot is handed out again by r_AddNewPrim.
+void r_RemovePrim(Tanto_PrimId primId)
+{
+    assert(primId < scene.primCount);
+    retireGeometry(&scene.geos[primId]);
+    retireInstances(&scene.instances[primId]);
+    scene.geos[primId] = emptyGeo;
+    writeDraw(primId);
+    scene.freeSlots[scene.freeCount++] = primId;
+    scene.liveCount--;
 }
 
-Tanto_PrimId r_AddNewPrim(Tanto_R_Primitive newPrim, Tanto_R_Material newMat, Mat4 xform)
+Tanto_PrimId r_AddPrimInstance(Tanto_PrimId source, Tanto_R_Material mat, Mat4 xform)
 {
-    const Tanto_PrimId primId = scene.primCount++;
-    assert(scene.primCount < MAX_PRIM_COUNT);
-    scene.primitive[primId]  = newPrim;
-    scene.materials[primId]  = newMat;
+    assert(source < scene.primCount);
+    const Tanto_PrimId primId = allocPrimSlot();
+    scene.materials[primId]  = mat;
     scene.transforms[primId] = xform;
+    r_SharePrimGeometry(primId, source);
     return primId;
 }
 
-void r_UpdatePrimitive(Tanto_R_Primitive newPrim)
+void r_SharePrimGeometry(Tanto_PrimId primId, Tanto_PrimId source)
 {
-    assert(0);
+    assert(primId < scene.primCount && source < scene.primCount);
+    const PrimGeo geo = scene.geos[source];
+    retainRange(&vertexSets, geo.vertexSet);
+    retainRange(&indexSets,  geo.indexSet);
+    retainRange(&meshletSets, geo.meshletSet);
+    retainRange(&faceColorSets, geo.faceColorSet);
+    for (uint32_t i = 0; i < geo.lodCount; i++) 
+        retainRange(&indexSets, geo.lodSets[i]);
+    retireGeometry(&scene.geos[primId]);
+    scene.geos[primId] = geo;
+    writeDraw(primId);
 }
 
-void r_UpdatePrimTransform(Mat4 m)
+bool r_IsPrimGeometryShared(Tanto_PrimId primId)
 {
-    assert(0);
+    assert(primId < scene.primCount);
+    const SharedRange* vertices = getRange(&vertexSets, scene.geos[primId].vertexSet);
+    return vertices && vertices->refCount > 1;
 }
 
-void r_CleanUp(void)
+Tanto_InstanceUpload r_ReservePrimInstances(Tanto_PrimId primId, uint32_t instanceCount)
+{
+    assert(primId < scene.primCount);
+    const VkDeviceSize bytes = instanceCount * sizeof(InstanceData);
+    // no instances draw nothing, and need no room in the arena
+    Tanto_InstanceUpload upload = {
+        .id     = primId,
+        .offset = instanceCount ? allocInstances(instanceCount) : 0,
+        .count  = instanceCount,
+        .ticket = r_StagingBeginWrite(bytes, 1)
+    };
+    if (instanceCount)
+        upload.data = r_StageCopy(&instanceBuffer, upload.offset * sizeof(InstanceData), 
+                bytes, VK_ACCESS_SHADER_READ_BIT);
+    return upload;
+}
+
+void r_WritePrimInstances(Tanto_InstanceUpload* upload, const double* xforms, const Vec3* colors)
+{
+    InstanceData* iter = upload->data;
+    upload->maxScale = 0.0f;
+    for (uint32_t i = 0; i < upload->count; i++, xforms += 16) 
+    {
+        // xforms are row major for row vectors, so the rows the shader needs
+        // are the columns of each matrix
+        for (int r = 0; r < 3; r++) 
+            for (int c = 0; c < 4; c++) 
+                iter->rows[r].x[c] = xforms[c * 4 + r];
+        // bounds of the translations and the largest frobenius norm of the
+        // linear parts, for culling
+        float scaleSq = 0.0f;
+        for (int r = 0; r < 3; r++) 
+        {
+            const float t = xforms[12 + r];
+            if (i == 0 || t < upload->originMin.x[r]) upload->originMin.x[r] = t;
+            if (i == 0 || t > upload->originMax.x[r]) upload->originMax.x[r] = t;
+            for (int c = 0; c < 3; c++) 
+                scaleSq += xforms[r * 4 + c] * xforms[r * 4 + c];
+        }
+        const float scale = sqrtf(scaleSq);
+        if (scale > upload->maxScale)
+            upload->maxScale = scale;
+        iter->color  = colors ? packColor(&(Vec4){{colors[i].x[0], colors[i].x[1], colors[i].x[2], 1.0}}) : 0xffffffff;
+        iter->primId = upload->id;
+        iter++;
+    }
+    r_StagingEndWrite(upload->ticket);
+}
+
+void r_PublishPrimInstances(const Tanto_InstanceUpload* upload)
+{
+    const Tanto_PrimId primId = upload->id;
+    assert(primId < scene.primCount);
+    retireInstances(&scene.instances[primId]);
+    scene.instances[primId] = (PrimInstances){
+        .offset    = upload->offset,
+        .count     = upload->count,
+        .instanced = true,
+        .origins   = { .min = upload->originMin, .max = upload->originMax },
+        .maxScale  = upload->maxScale
+    };
+    writeDraw(primId);
+}
+
+void r_ClearPrimInstances(Tanto_PrimId primId)
+{
+    assert(primId < scene.primCount);
+    if (!scene.instances[primId].instanced)
+        return;
+    retireInstances(&scene.instances[primId]);
+    writeDraw(primId);
+}
+
+Tanto_IndexSetUpload r_ReserveIndexSet(uint32_t indexCount, uint32_t vertexCount)
+{
+    // narrow sets pack two indices into each element of the arena
+    const bool narrow = compactVertices && vertexCount <= UINT16_MAX + 1;
+    const uint32_t elementCount = narrow ? (indexCount + 1) / 2 : indexCount;
+    // an empty triangulation has no set, and prims using it draw nothing
+    const uint32_t firstElement = indexCount ? allocIndices(elementCount) : 0;
+    const VkDeviceSize elementBytes = elementCount * sizeof(Tanto_R_Index);
+    Tanto_IndexSetUpload upload = {
+        .id         = indexCount ? newRange(&indexSets, firstElement, indexCount) : R_INDEX_SET_NONE,
+        .indexCount = indexCount,
+        .narrow     = narrow,
+        .ticket     = r_StagingBeginWrite(elementBytes, 1)
+    };
+    if (indexCount)
+    {
+        indexSets.ranges[upload.id].narrow = narrow;
+        upload.indices = r_StageCopy(&indexBuffer, firstElement * sizeof(Tanto_R_Index), 
+                elementBytes, VK_ACCESS_INDEX_READ_BIT);
+    }
+    return upload;
+}
+
+void r_WriteIndexSet(const Tanto_IndexSetUpload* upload, const Tanto_R_Index* indices)
+{
+    if (upload->narrow)
+    {
+        uint16_t* iter = upload->indices;
+        for (uint32_t i = 0; i < upload->indexCount; i++) 
+        {
+            assert(indices[i] <= UINT16_MAX);
+            *iter++ = (uint16_t)indices[i];
+        }
+        // the odd one out pads the last element
+        if (upload->indexCount % 2)
+            *iter = 0;
+    }
+    else if (upload->indexCount)
+        memcpy(upload->indices, indices, upload->indexCount * sizeof(Tanto_R_Index));
+    r_StagingEndWrite(upload->ticket);
+}
+
+Tanto_IndexSetId r_AddIndexSet(const Tanto_R_Index* indices, uint32_t indexCount)
+{
+    uint32_t vertexCount = 0;
+    for (uint32_t i = 0; i < indexCount; i++) 
+    {
+        if (indices[i] >= vertexCount)
+            vertexCount = indices[i] + 1;
+    }
+    const Tanto_IndexSetUpload upload = r_ReserveIndexSet(indexCount, vertexCount);
+    r_WriteIndexSet(&upload, indices);
+    return upload.id;
+}
+
+void r_ReleaseIndexSet(Tanto_IndexSetId indexSet)
+{
+    releaseRange(&indexSets, &geometry.indexArena, indexSet);
+}
+
+void r_UpdatePrimTransform(Tanto_PrimId primId, Mat4 xform)
+{
+    assert(primId < scene.primCount);
+    scene.transforms[primId] = xform;
+    touchBounds();
+}
+
+void r_UpdatePrimMaterial(Tanto_PrimId primId, Tanto_R_Material mat)
+{
+    assert(primId < scene.primCount);
+    scene.materials[primId] = mat;
+}
+
+void r_SetPrimPickId(Tanto_PrimId primId, int32_t pickId)
+{
+    assert(primId < scene.primCount);
+    scene.pickIds[primId] = pickId;
+}
+
+// rewrites the positions of a prim in place. the vertex count must match the
+// one the prim was created with and its vertices must not be shared.
+void r_UpdatePrimPoints(Tanto_PrimId primId, const Vec3* points, const Vec3* normals, uint32_t pointCount)
+{
+    assert(primId < scene.primCount);
+    const SharedRange* vertices = getRange(&vertexSets, scene.geos[primId].vertexSet);
+    if (!vertices || pointCount == 0)
+        return;
+    assert(pointCount == vertices->count && vertices->refCount == 1);
+    void* positions = r_StageCopy(&positionBuffer, vertices->offset * positionSize, 
+            pointCount * positionSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    scene.geos[primId].bounds = pointBounds(points, pointCount);
+    writePositions(positions, points, pointCount, &scene.geos[primId].bounds);
+    if (normals)
+    {
+        uint32_t* packed = r_StageCopy(&normalBuffer, vertices->offset * sizeof(uint32_t), 
+                pointCount * sizeof(uint32_t), VK_ACCESS_SHADER_READ_BIT);
+        writeNormals(packed, normals, pointCount);
+    }
+    scene.geos[primId].hasNormals = normals != NULL;
+    writeAttributes(primId);
+    touchBounds();
+}
+
+void r_SetPrimLods(Tanto_PrimId primId, const Tanto_IndexSetId* lodSets, const float* errors, uint32_t count)
+{
+    assert(primId < scene.primCount && count <= R_MAX_LODS);
+    PrimGeo* geo = &scene.geos[primId];
+    for (uint32_t i = 0; i < count; i++) 
+    {
+        assert(i == 0 || errors[i] >= errors[i - 1]);
+        retainRange(&indexSets, lodSets[i]);
+    }
+    releaseLods(geo);
+    memcpy(geo->lodSets,   lodSets, count * sizeof(Tanto_IndexSetId));
+    memcpy(geo->lodErrors, errors,  count * sizeof(float));
+    geo->lodCount = count;
+    // the levels are picked when culling
+    culling.version++;
+}
+
+Tanto_MeshletUpload r_ReservePrimMeshlets(Tanto_PrimId primId, uint32_t meshletCount)
+{
+    assert(primId < scene.primCount);
+    const uint32_t offset = allocMeshlets(meshletCount);
+    const VkDeviceSize bytes = meshletCount * sizeof(MeshletData);
+    Tanto_MeshletUpload upload = {
+        .id         = primId,
+        .ticket     = r_StagingBeginWrite(bytes, 1),
+        .meshletSet = newRange(&meshletSets, offset, meshletCount),
+        .offset     = offset,
+        .count      = meshletCount
+    };
+    if (meshletCount)
+        upload.data = r_StageCopy(&meshletBuffer, offset * sizeof(MeshletData), 
+                bytes, VK_ACCESS_SHADER_READ_BIT);
+    return upload;
+}
+
+static void writeMeshlets(MeshletData* iter, const uint32_t count, const Tanto_R_Index* indices, 
+        const uint32_t* meshletTriangles, const Vec3* positions)
+{
+    for (uint32_t i = 0; i < count; i++) 
+    {
+        const uint32_t first = meshletTriangles[i];
+        const uint32_t triangleCount = meshletTriangles[i + 1] - first;
+        assert(triangleCount <= R_MESHLET_MAX_TRIANGLES);
+        *iter++ = (MeshletData){
+            .bounds     = r_MeshletBounds(&indices[first * 3], triangleCount, positions),
+            .firstIndex = first * 3,
+            .indexCount = triangleCount * 3
+        };
+    }
+}
+
+void r_WritePrimMeshlets(Tanto_MeshletUpload* upload, const Tanto_R_Index* indices, 
+        const uint32_t* meshletTriangles, const Vec3* positions)
+{
+    writeMeshlets(upload->data, upload->count, indices, meshletTriangles, positions);
+    r_StagingEndWrite(upload->ticket);
+}
+
+void r_PublishPrimMeshlets(const Tanto_MeshletUpload* upload)
+{
+    const Tanto_PrimId primId = upload->id;
+    assert(primId < scene.primCount);
+    PrimGeo* geo = &scene.geos[primId];
+    releaseRange(&meshletSets, &geometry.meshletArena, geo->meshletSet);
+    geo->meshletSet = upload->meshletSet;
+    culling.version++;
+}
+
+// like the points, the meshlets are overwritten where they are. the culling
+// pass reads them from the meshlet buffer every frame, so nothing recorded
+// changes.
+void r_RefitPrimMeshlets(Tanto_PrimId primId, const Tanto_R_Index* indices, 
+        const uint32_t* meshletTriangles, const Vec3* positions)
+{
+    assert(primId < scene.primCount);
+    const SharedRange* set = getRange(&meshletSets, scene.geos[primId].meshletSet);
+    if (!set)
+        return;
+    assert(set->refCount == 1);
+    MeshletData* data = r_StageCopy(&meshletBuffer, set->offset * sizeof(MeshletData), 
+            set->count * sizeof(MeshletData), VK_ACCESS_SHADER_READ_BIT);
+    writeMeshlets(data, set->count, indices, meshletTriangles, positions);
+}
+
+Tanto_FaceColorUpload r_ReservePrimFaceColors(Tanto_PrimId primId, uint32_t triangleCount)
+{
+    assert(primId < scene.primCount);
+    const uint32_t offset = allocFaceColors(triangleCount);
+    const VkDeviceSize bytes = triangleCount * sizeof(uint32_t);
+    Tanto_FaceColorUpload upload = {
+        .id           = primId,
+        .ticket       = r_StagingBeginWrite(bytes, 1),
+        .faceColorSet = newRange(&faceColorSets, offset, triangleCount),
+        .count        = triangleCount
+    };
+    if (triangleCount)
+        upload.data = r_StageCopy(&faceColorBuffer, offset * sizeof(uint32_t), 
+                bytes, VK_ACCESS_SHADER_READ_BIT);
+    return upload;
+}
+
+void r_WritePrimFaceColors(Tanto_FaceColorUpload* upload, const Vec4* colors)
+{
+    uint32_t* iter = upload->data;
+    for (uint32_t i = 0; i < upload->count; i++) 
+        *iter++ = packColor(&colors[i]);
+    r_StagingEndWrite(upload->ticket);
+}
+
+void r_PublishPrimFaceColors(const Tanto_FaceColorUpload* upload)
 {
-    vkDestroyFramebuffer(device, framebuffer, NULL);
+    const Tanto_PrimId primId = upload->id;
+    assert(primId < scene.primCount);
+    PrimGeo* geo = &scene.geos[primId];
+    releaseRange(&faceColorSets, &geometry.faceColorArena, geo->faceColorSet);
+    geo->faceColorSet = upload->faceColorSet;
+    writeAttributes(primId);
+    // the prim now draws whole, without its meshlets and levels of detail
+    culling.version++;
+}
+
+// frames rendered into the targets so far are not held any longer
+static void destroyFrameTargets(void)
+{
+    for (int i = 0; i < R_FRAME_COUNT; i++)
+    {
+        vkDestroyFramebuffer(device, framebuffers[i], NULL);
+        for (int aov = 0; aov < R_AOV_COUNT; aov++)
+        {
+            if (attachmentAovs[i][aov].handle)
+                tanto_v_FreeImage(&attachmentAovs[i][aov]);
+            attachmentAovs[i][aov] = (Tanto_V_Image){0};
+        }
+    }
+    for (int aov = 0; aov < R_AOV_COUNT; aov++)
+    {
+        if (attachmentSamples[aov].handle)
+            tanto_v_FreeImage(&attachmentSamples[aov]);
+        attachmentSamples[aov] = (Tanto_V_Image){0};
+    }
     tanto_v_FreeImage(&attachmentDepth);
-    tanto_v_FreeImage(&attachmentColor);
+    tanto_v_FreeBufferRegion(&occlusion.hiz);
     vkDestroyPipeline(device, pipelineMain, NULL);
+    vkDestroyPipeline(device, pipelineCull, NULL);
+    vkDestroyPipeline(device, pipelineHiZ, NULL);
+    vkDestroyPipeline(device, pipelineMeshlet, NULL);
+    firstHeldFrame = frameSubmitted + 1;
+}
+
+// the geometry and its staging stay, so uploads go on across resizes
+static void cleanUpFrames(void)
+{
+    vkDeviceWaitIdle(device);
+    frameCompleted = frameSubmitted;
+    releaseRetiredGeometry();
+    destroyFrameTargets();
+}
+
+void r_CleanUp(void)
+{
+    // before r_InitRenderer there are no frame targets yet
+    if (renderpass != VK_NULL_HANDLE)
+        cleanUpFrames();
+    r_StagingCleanUp();
+}
+
+// after the attachments change in number, format or samples
+static void rebuildFrameTargets(void)
+{
+    // before r_InitRenderer there is nothing to rebuild yet
+    if (renderpass == VK_NULL_HANDLE)
+        return;
+    vkDeviceWaitIdle(device);
+    destroyFrameTargets();
+    vkDestroyRenderPass(device, renderpass, NULL);
+    vkDestroyRenderPass(device, renderpassOcclusion, NULL);
+    vkDestroyRenderPass(device, renderpassLoad, NULL);
+
+    initAttachments();
+    initRenderPass();
+    initFramebuffer();
+    initPipelines();
+    r_UpdateRenderCommands();
+}
+
+void r_SetAovs(uint32_t mask)
+{
+    mask |= R_AOV_BIT(R_AOV_COLOR);
+    if (mask == aovMask)
+        return;
+    aovMask = mask;
+    rebuildFrameTargets();
+}
+
+uint32_t r_GetAovs(void)
+{
+    return aovMask;
+}
+
+uint32_t r_SetSampleCount(uint32_t samples)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    const VkSampleCountFlags supported = 
+        properties.limits.framebufferColorSampleCounts & 
+        properties.limits.framebufferDepthSampleCounts;
+    // the largest supported power of two up to samples
+    VkSampleCountFlagBits count = VK_SAMPLE_COUNT_1_BIT;
+    for (uint32_t c = 2; c <= samples && c <= VK_SAMPLE_COUNT_64_BIT; c *= 2)
+    {
+        if (supported & c)
+            count = (VkSampleCountFlagBits)c;
+    }
+    if (count != sampleCount)
+    {
+        sampleCount = count;
+        rebuildFrameTargets();
+    }
+    return sampleCount;
 }
 
 void r_UpdateCamera(Tanto_Camera camera)
 {
-    scene.camera->matView = camera.view;
-    scene.camera->matProj = camera.proj;
-    scene.camera->viewInv = m_Invert4x4(&camera.view);
-    scene.camera->projInv = m_Invert4x4(&camera.proj);
+    pendingCamera.matView = camera.view;
+    pendingCamera.matProj = camera.proj;
+    pendingCamera.viewInv = m_Invert4x4(&camera.view);
+    pendingCamera.projInv = m_Invert4x4(&camera.proj);
+    culling.version++;
+}
+
+void r_SetOcclusionCulling(bool enable)
+{
+    occlusion.enabled = enable;
+    // the candidates are written differently and the frame recorded anew
+    culling.version++;
+    invalidateRenderCommands();
+}
+
+void r_SetLodThreshold(float pixels)
+{
+    lodThreshold = pixels;
+    culling.version++;
 }
 
 void  r_SetViewport(unsigned int width, unsigned int height)
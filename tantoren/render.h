@@ -13,20 +13,255 @@ typedef struct {
     Vec4 color;
 } Tanto_R_Material;
 
-typedef uint16_t Tanto_PrimId;
+typedef uint32_t Tanto_PrimId;
 
+// number of frames that may be in flight at once. each renders into an
+// image of its own, which holds the frame until R_FRAME_COUNT more frames
+// have been submitted.
+#define R_FRAME_COUNT 2
+
+// triangle indices that any number of prims can draw with. they are relative
+// to the first vertex of the prim using them.
+typedef uint32_t Tanto_IndexSetId;
+
+#define R_INDEX_SET_NONE UINT32_MAX
+
+// most levels of detail a prim can have besides its own index set
+#define R_MAX_LODS 8
+
+// source data for a prim's geometry. it is copied into the renderer's shared
+// buffers, so the pointers only need to live for the duration of the call.
+typedef struct {
+    uint32_t         vertexCount;
+    const Vec3*      positions;
+    const Vec4*      colors; // rgb and opacity. may be NULL, the material color is used
+    const Vec3*      normals; // may be NULL, the prim is shaded flat
+    Tanto_IndexSetId indexSet; // may be R_INDEX_SET_NONE
+} Tanto_PrimGeometry;
+
+// vertices reserved for a prim but not written yet. the pointers are staging
+// memory that r_WritePrimGeometry fills in the vertex format of the renderer;
+// they must not be used after. it also stores the bounds of the positions,
+// which the prim is culled with.
+typedef struct {
+    Tanto_PrimId     id;
+    uint32_t         ticket;
+    uint32_t         vertexSet;
+    uint32_t         vertexCount;
+    Tanto_IndexSetId indexSet;
+    void*            positions;
+    void*            colors;
+    void*            normals;
+    bool             hasNormals;
+    bool             hasColors;
+    Vec3             boundsMin;
+    Vec3             boundsMax;
+} Tanto_PrimUpload;
+
+// same for an index set and r_WriteIndexSet. narrow sets are stored with 16
+// bit indices.
+typedef struct {
+    Tanto_IndexSetId id;
+    uint32_t         ticket;
+    uint32_t         indexCount;
+    bool             narrow;
+    void*            indices;
+} Tanto_IndexSetUpload;
+
+// instances reserved for a prim, filled by r_WritePrimInstances. the bounds
+// of the instance translations and the largest instance scale are stored
+// along for culling.
+typedef struct {
+    Tanto_PrimId id;
+    uint32_t     ticket;
+    uint32_t     offset;
+    uint32_t     count;
+    void*        data;
+    Vec3         originMin;
+    Vec3         originMax;
+    float        maxScale;
+} Tanto_InstanceUpload;
+
+// meshlets reserved for a prim, filled by r_WritePrimMeshlets
+typedef struct {
+    Tanto_PrimId id;
+    uint32_t     ticket;
+    uint32_t     meshletSet;
+    uint32_t     offset;
+    uint32_t     count;
+    void*        data;
+} Tanto_MeshletUpload;
+
+// face colors reserved for a prim, filled by r_WritePrimFaceColors
+typedef struct {
+    Tanto_PrimId id;
+    uint32_t     ticket;
+    uint32_t     faceColorSet;
+    uint32_t     count;
+    void*        data;
+} Tanto_FaceColorUpload;
+
+// outputs of a frame. all enabled ones are written in the same pass.
+typedef enum {
+    R_AOV_COLOR,   // rgba8 unorm, always enabled
+    R_AOV_DEPTH,   // float, depth of the nearest surface in [0, 1]
+    R_AOV_PRIM_ID, // int32, pick id of the nearest prim, -1 where there is none
+    R_AOV_NORMAL,  // rgba16 float, world space normal of the nearest surface
+    R_AOV_COUNT
+} Tanto_Aov;
+
+#define R_AOV_BIT(aov) (1u << (aov))
+
+// an image a frame was rendered into. once the frame is complete the image
+// stays in layout, ready to be sampled, until its slot is reused.
+typedef struct {
+    VkImage       image;
+    VkImageView   view;
+    VkImageLayout layout;
+    VkFormat      format;
+    uint32_t      texelSize;
+    uint32_t      width;
+    uint32_t      height;
+} Tanto_FrameImage;
+
+// whether a vulkan instance can be created and has a physical device to
+// render with. for choosing MODE_SOFTWARE before tanto_v_Init, which gives
+// up on a system without a vulkan driver.
+bool r_HasVulkanDevice(void);
+// compact vertices store positions as 16 bit fractions of the prim bounds
+// and colors as 8 bit unorm, and index sets over fewer than 65536 vertices
+// with 16 bit indices. must be called before r_InitScene. off by default.
+void r_SetCompactVertices(bool enable);
 void r_InitScene(void);
 void r_InitRenderer(void);
 void r_SetViewport(unsigned int width, unsigned int height);
-void r_UpdateRenderCommands(Tanto_V_BufferRegion* colorBuffer);
+void r_UpdateRenderCommands(void);
 void r_LoadMesh(Tanto_R_Mesh mesh);
-void r_Render(void);
+// submits the geometry uploads staged since the last call on the transfer
+// queue. r_Render commits whatever is still pending.
+void r_CommitResources(void);
+// submits the next frame without waiting for it and returns its number. only
+// prims whose bounds intersect the view frustum are drawn.
+uint64_t r_Render(void);
+bool r_IsFrameComplete(uint64_t frame);
+void r_WaitFrame(uint64_t frame);
+// slot of the image a frame is written to
+uint32_t r_GetFrameSlot(uint64_t frame);
+// frames can be used until their slot is reused or the aovs or the viewport
+// change. nothing is copied to the host unless a frame is read back, which
+// waits for it and then for the copy into dst, width * height * texelSize
+// bytes of host visible memory. the aov must be enabled.
+bool r_IsFrameHeld(uint64_t frame);
+Tanto_FrameImage r_GetFrameImage(uint64_t frame, Tanto_Aov aov);
+void r_ReadbackFrame(uint64_t frame, Tanto_Aov aov, const Tanto_V_BufferRegion* dst);
+// number of regions an aov is copied to continuously, one more than frames
+// can be in flight, so the copy of the last complete frame is never written
+// to while the next ones are.
+#define R_READBACK_COUNT (R_FRAME_COUNT + 1)
+// copies the aov at the end of every frame into regions[frame %
+// R_READBACK_COUNT] until it is set to NULL, which waits for the frames in
+// flight. regions too small for the viewport are skipped.
+void r_SetAovReadback(Tanto_Aov aov, const Tanto_V_BufferRegion* regions);
+// the aovs frames write, a mask of R_AOV_BIT. disabled aovs have no images
+// and cost no fragment shader work. changing them waits for the device.
+void r_SetAovs(uint32_t aovMask);
+uint32_t r_GetAovs(void);
+// samples per pixel frames are drawn with, rounded down to a count the
+// device supports, which is returned. with more than one the aovs are
+// resolved on the GPU before anything reads them. 1 by default.
+uint32_t r_SetSampleCount(uint32_t samples);
 void r_ClearMesh(void);
+// frees the frame targets and the staging buffers. nothing may be uploaded
+// afterwards until r_InitScene.
 void r_CleanUp(void);
 void r_UpdateCamera(Tanto_Camera camera);
-Tanto_PrimId r_AddNewPrim(Tanto_R_Primitive newPrim, Tanto_R_Material newMat, Mat4 xform);
-void r_UpdateViewport(unsigned int width, unsigned int height,
-        Tanto_V_BufferRegion* colorBuffer);
+// prims hidden behind others are culled on the GPU before they are drawn.
+// the draws are then recorded anew whenever their count changes instead of
+// per chunk. off by default.
+void r_SetOcclusionCulling(bool enable);
+// prims with levels of detail draw the coarsest one whose error covers at
+// most this many pixels at their nearest point. 0 always draws the full
+// geometry. 1 by default.
+void r_SetLodThreshold(float pixels);
+Tanto_PrimId r_AddNewPrim(const Tanto_PrimGeometry* newGeo, Tanto_R_Material newMat, Mat4 xform);
+void r_UpdatePrimGeometry(Tanto_PrimId primId, const Tanto_PrimGeometry* newGeo);
+// the split form of the two calls above, for adding prims from many threads.
+// reserving and publishing must be serialized like every other r_ call, but
+// r_WritePrimGeometry may run concurrently with anything, each upload being
+// written exactly once. the prim is not drawn until it is published.
+Tanto_PrimUpload r_ReservePrim(uint32_t vertexCount, Tanto_IndexSetId indexSet);
+Tanto_PrimUpload r_ReservePrimGeometry(Tanto_PrimId primId, uint32_t vertexCount, Tanto_IndexSetId indexSet);
+void r_WritePrimGeometry(Tanto_PrimUpload* upload, const Tanto_PrimGeometry* src);
+void r_PublishPrim(const Tanto_PrimUpload* upload);
+// prims added or updated from an existing prim draw its vertices and indices
+// without copying them. they keep them alive on their own, so source may be
+// removed or given new geometry afterwards. shared vertices cannot be updated
+// in place with r_UpdatePrimPoints.
+Tanto_PrimId r_AddPrimInstance(Tanto_PrimId source, Tanto_R_Material mat, Mat4 xform);
+void r_SharePrimGeometry(Tanto_PrimId primId, Tanto_PrimId source);
+bool r_IsPrimGeometryShared(Tanto_PrimId primId);
+// instanced prims are drawn once per instance, with the instance transform
+// applied after the prim's own and the instance color multiplied in. the
+// upload follows the same rules as prim uploads. xforms are instanceCount
+// row major 4x4 matrices as Hydra computes them; colors may be NULL. a
+// prim with no instances draws nothing.
+Tanto_InstanceUpload r_ReservePrimInstances(Tanto_PrimId primId, uint32_t instanceCount);
+void r_WritePrimInstances(Tanto_InstanceUpload* upload, const double* xforms, const Vec3* colors);
+void r_PublishPrimInstances(const Tanto_InstanceUpload* upload);
+// draws the prim once again, with its own transform only
+void r_ClearPrimInstances(Tanto_PrimId primId);
+// index sets are reference counted. the caller owns one reference to a new
+// set and every prim drawing with it holds another, so a set outlives the
+// call to r_ReleaseIndexSet for as long as prims use it. reserving and
+// writing follow the same rules as for prims. vertexCount bounds the indices
+// of the set. an empty set is R_INDEX_SET_NONE.
+Tanto_IndexSetUpload r_ReserveIndexSet(uint32_t indexCount, uint32_t vertexCount);
+void r_WriteIndexSet(const Tanto_IndexSetUpload* upload, const Tanto_R_Index* indices);
+Tanto_IndexSetId r_AddIndexSet(const Tanto_R_Index* indices, uint32_t indexCount);
+void r_ReleaseIndexSet(Tanto_IndexSetId indexSet);
+void r_RemovePrim(Tanto_PrimId primId);
+void r_UpdatePrimTransform(Tanto_PrimId primId, Mat4 xform);
+void r_UpdatePrimMaterial(Tanto_PrimId primId, Tanto_R_Material mat);
+// the value the prim writes to R_AOV_PRIM_ID. -1 for new prims.
+void r_SetPrimPickId(Tanto_PrimId primId, int32_t pickId);
+// normals may be NULL, which shades the prim flat. the levels of detail of
+// the prim index the same vertices and are kept, though their errors were
+// measured on the old points. so are its meshlets, whose bounds go stale
+// until r_RefitPrimMeshlets.
+void r_UpdatePrimPoints(Tanto_PrimId primId, const Vec3* points, const Vec3* normals, uint32_t pointCount);
+// coarser index sets over the vertices of a prim, finest first, drawn in place
+// of its own set when they are small enough on screen. errors are the
+// distances of their surfaces from the full one in object space and must
+// not decrease. the prim retains the sets and shares them along with its
+// geometry; publishing new geometry drops them. count is at most R_MAX_LODS.
+void r_SetPrimLods(Tanto_PrimId primId, const Tanto_IndexSetId* lodSets, const float* errors, uint32_t count);
+// splits the index set of a prim into meshlets, which are culled one by one
+// on the GPU whenever the prim is drawn whole and without instances. indices
+// are the ones of the prim's index set, which must be in meshlet order, and
+// meshletTriangles the first triangle of each meshlet followed by the total
+// as r_BuildMeshlets writes them. positions are the points of the prim. the
+// upload follows the same rules as prim uploads; the meshlets are shared
+// along with the geometry and dropped by publishing new geometry.
+Tanto_MeshletUpload r_ReservePrimMeshlets(Tanto_PrimId primId, uint32_t meshletCount);
+void r_WritePrimMeshlets(Tanto_MeshletUpload* upload, const Tanto_R_Index* indices, 
+        const uint32_t* meshletTriangles, const Vec3* positions);
+void r_PublishPrimMeshlets(const Tanto_MeshletUpload* upload);
+// rewrites the bounds and cones of the meshlets of a prim in place for the
+// points r_UpdatePrimPoints gave it, with the arguments the meshlets were
+// written with. the triangles of each meshlet stay, as they only depend on
+// the indices. does nothing for a prim without meshlets.
+void r_RefitPrimMeshlets(Tanto_PrimId primId, const Tanto_R_Index* indices, 
+        const uint32_t* meshletTriangles, const Vec3* positions);
+// colors of the triangles of a prim, one per triangle of its index set in the
+// order of the indices, rgb and opacity. they are multiplied in like vertex
+// colors but fetched by primitive index, so the prim is always drawn whole,
+// without its meshlets and levels of detail. the upload follows the same
+// rules as prim uploads; the colors are shared along with the geometry and
+// dropped by publishing new geometry.
+Tanto_FaceColorUpload r_ReservePrimFaceColors(Tanto_PrimId primId, uint32_t triangleCount);
+void r_WritePrimFaceColors(Tanto_FaceColorUpload* upload, const Vec4* colors);
+void r_PublishPrimFaceColors(const Tanto_FaceColorUpload* upload);
+void r_UpdateViewport(unsigned int width, unsigned int height);
 const Tanto_R_Mesh* r_GetMesh(void);
 
 #endif /* end of include guard: R_COMMANDS_H */
@@ -0,0 +1,75 @@
+#version 460
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inViewPos;
+layout(location = 3) flat in float inHasNormal;
+layout(location = 4) flat in uint  inPrimId;
+
+// one per aov, at the location of its Tanto_Aov
+layout(location = 0) out vec4  outColor;
+layout(location = 1) out float outDepth;
+layout(location = 2) out int   outPrimId;
+layout(location = 3) out vec4  outNormal;
+
+// R_AOV_BIT mask of the enabled aovs, bits as in render.h. the others have
+// no attachment.
+layout(constant_id = 0) const uint aovMask = 1;
+
+const uint aovDepth  = 1 << 1;
+const uint aovPrimId = 1 << 2;
+const uint aovNormal = 1 << 3;
+
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 view;
+    mat4 proj;
+    mat4 viewInv;
+    mat4 projInv;
+} camera;
+
+// see flat.vert
+struct Attributes {
+    vec3 offset;
+    uint flags;
+    vec3 scale;
+    uint firstFaceColor;
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer PrimAttributes {
+    Attributes attributes[];
+} prims;
+
+// unorm rgba8, one per triangle of the prims that have them
+layout(std430, set = 0, binding = 6) readonly buffer FaceColors {
+    uint faceColor[];
+} faceColors;
+
+layout(std430, set = 0, binding = 7) readonly buffer PickIds {
+    int pickId[];
+} picks;
+
+// must match NO_RANGE in render.c
+const uint noFaceColors = 0xffffffff;
+
+void main()
+{
+    // prims without normals get the normal of the triangle, all in view space
+    const vec3 n = inHasNormal != 0.0 ? normalize(inNormal) : 
+        normalize(cross(dFdx(inViewPos), dFdy(inViewPos)));
+    // lit from the eye, from both sides
+    const vec3 toEye = normalize(-inViewPos);
+    const float light = 0.2 + 0.8 * abs(dot(n, toEye));
+    // prims with face colors are drawn whole, so the primitive index is the
+    // triangle of their index set
+    vec4 color = inColor;
+    const uint firstFaceColor = prims.attributes[inPrimId].firstFaceColor;
+    if (firstFaceColor != noFaceColors)
+        color *= unpackUnorm4x8(faceColors.faceColor[firstFaceColor + gl_PrimitiveID]);
+    outColor = vec4(color.rgb * light, color.a);
+    if ((aovMask & aovDepth) != 0)
+        outDepth = gl_FragCoord.z;
+    if ((aovMask & aovPrimId) != 0)
+        outPrimId = picks.pickId[inPrimId];
+    if ((aovMask & aovNormal) != 0)
+        outNormal = vec4((camera.viewInv * vec4(n, 0.0)).xyz, 0.0);
+}
@@ -0,0 +1,109 @@
+#version 460
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec4 color;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec3 outNormal;
+layout(location = 2) out vec3 outViewPos;
+// 1 if outNormal is set, otherwise the fragments are shaded flat
+layout(location = 3) flat out float outHasNormal;
+layout(location = 4) flat out uint  outPrimId;
+
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 view;
+    mat4 proj;
+    mat4 viewInv;
+    mat4 projInv;
+} camera;
+
+layout(std430, set = 0, binding = 1) readonly buffer Transforms {
+    mat4 xform[];
+} transforms;
+
+struct Material {
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Materials {
+    Material material[];
+} materials;
+
+struct Instance {
+    vec4 rows[3];
+    uint color;
+    uint primId;
+    uint pad0;
+    uint pad1;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Instances {
+    Instance instance[];
+} instances;
+
+// compact positions are fractions of the prim bounds. otherwise the scale
+// is 1 and the offset 0. normals and colors are only read if flags has them.
+struct Attributes {
+    vec3 offset;
+    uint flags;
+    vec3 scale;
+    uint firstFaceColor;
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer PrimAttributes {
+    Attributes attributes[];
+} prims;
+
+// octahedral, see packNormal in render.c. vertex buffers are not indexed by
+// the shader, gl_VertexIndex already includes the vertex offset.
+layout(std430, set = 0, binding = 5) readonly buffer Normals {
+    uint normal[];
+} normals;
+
+// must match INSTANCE_ID_BASE in render.c
+const uint instanceIdBase = 1 << 24;
+
+// must match the ATTRIBUTE_ flags in render.c
+const uint attributeNormals = 0x1;
+const uint attributeColors  = 0x2;
+
+vec3 unpackNormal(const uint packed)
+{
+    const vec2 e = unpackSnorm2x16(packed);
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    const float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+void main()
+{
+    // prims drawn once use their id as firstInstance. instance indices from
+    // instanceIdBase on address the instance buffer instead.
+    uint primId    = gl_InstanceIndex;
+    mat4 instXform = mat4(1.0);
+    vec3 instColor = vec3(1.0);
+    if (gl_InstanceIndex >= instanceIdBase)
+    {
+        const Instance inst = instances.instance[gl_InstanceIndex - instanceIdBase];
+        primId    = inst.primId;
+        instXform = transpose(mat4(inst.rows[0], inst.rows[1], inst.rows[2], vec4(0, 0, 0, 1)));
+        instColor = unpackUnorm4x8(inst.color).rgb;
+    }
+    const Attributes attr = prims.attributes[primId];
+    const vec3 objectPos = pos * attr.scale + attr.offset;
+    const mat4 modelView = camera.view * instXform * transforms.xform[primId];
+    const vec4 viewPos   = modelView * vec4(objectPos, 1.0);
+    const vec4 vertColor = (attr.flags & attributeColors) != 0 ? color : vec4(1.0);
+    gl_Position  = camera.proj * viewPos;
+    outColor     = vertColor * vec4(instColor, 1.0) * materials.material[primId].color;
+    outViewPos   = viewPos.xyz;
+    outPrimId    = primId;
+    outHasNormal = 0.0;
+    outNormal    = vec3(0.0);
+    if ((attr.flags & attributeNormals) != 0)
+    {
+        outHasNormal = 1.0;
+        outNormal    = transpose(inverse(mat3(modelView))) * unpackNormal(normals.normal[gl_VertexIndex]);
+    }
+}
@@ -0,0 +1,34 @@
+// shared by cull.comp and hiz.comp. must match CullPushConstants and the
+// pyramid layout in render.c.
+
+layout(push_constant) uniform PushConstants {
+    uint phase;        // cull pass, or the pyramid level hiz.comp builds
+    uint drawCapacity; // draws per pass in the output buffer
+    uint width;        // viewport
+    uint height;
+    uint levelCount;
+} pc;
+
+// the pyramid is stored level after level in one buffer. level 0 is half the
+// viewport, every further level halves the one before, rounding up, so a
+// texel of level l covers 2^(l + 1) pixels in each direction. each texel
+// holds the farthest depth it covers.
+uvec2 levelSize(uint level)
+{
+    uvec2 size = uvec2(pc.width, pc.height);
+    for (uint l = 0; l <= level; l++)
+        size = (size + 1) / 2;
+    return size;
+}
+
+uint levelOffset(uint level)
+{
+    uvec2 size   = uvec2(pc.width, pc.height);
+    uint  offset = 0;
+    for (uint l = 0; l < level; l++)
+    {
+        size = (size + 1) / 2;
+        offset += size.x * size.y;
+    }
+    return offset;
+}
@@ -0,0 +1,44 @@
+// the pyramid pass of hiz.comp and hizms.comp, which define loadDepth to
+// read the depth attachment
+
+layout(std430, set = 0, binding = 5) buffer HiZ {
+    float depth[];
+} hiz;
+
+// builds level pc.phase of the pyramid from the depth attachment or the
+// level below
+void main()
+{
+    const uint  level = pc.phase;
+    const uvec2 size  = levelSize(level);
+    const uvec2 texel = gl_GlobalInvocationID.xy;
+    if (any(greaterThanEqual(texel, size)))
+        return;
+
+    // odd sizes round up, so the last texel of a row may cover only one
+    float farthest = 0.0;
+    if (level == 0)
+    {
+        const uvec2 srcSize = uvec2(pc.width, pc.height);
+        for (uint y = 0; y < 2; y++)
+            for (uint x = 0; x < 2; x++)
+            {
+                const uvec2 src = texel * 2 + uvec2(x, y);
+                if (all(lessThan(src, srcSize)))
+                    farthest = max(farthest, loadDepth(ivec2(src)));
+            }
+    }
+    else
+    {
+        const uvec2 srcSize   = levelSize(level - 1);
+        const uint  srcOffset = levelOffset(level - 1);
+        for (uint y = 0; y < 2; y++)
+            for (uint x = 0; x < 2; x++)
+            {
+                const uvec2 src = texel * 2 + uvec2(x, y);
+                if (all(lessThan(src, srcSize)))
+                    farthest = max(farthest, hiz.depth[srcOffset + src.y * srcSize.x + src.x]);
+            }
+    }
+    hiz.depth[levelOffset(level) + texel.y * size.x + texel.x] = farthest;
+}
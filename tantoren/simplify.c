@@ -0,0 +1,468 @@
+#include "simplify.h"
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE UINT32_MAX
+
+// border edges are held in place by a plane through them, perpendicular to
+// their triangle, which counts this much more than the triangle's own plane
+#define BORDER_WEIGHT 10.0
+
+// a step that removes less than this share of the triangles is not worth a
+// level of its own
+#define MIN_REDUCTION 0.25
+
+// sum of weighted squared distances to a set of planes: the upper triangle of
+// a symmetric 4x4 matrix, row by row, and the sum of the weights
+typedef struct {
+    double a[10];
+    double weight;
+} Quadric;
+
+// collapse of vertex from into vertex to, with its squared error. stamp is
+// the sum of the versions of both vertices when it was queued; versions only
+// grow, so it goes stale as soon as either of them changes.
+typedef struct {
+    float    error;
+    uint32_t from;
+    uint32_t to;
+    uint32_t stamp;
+} Collapse;
+
+typedef struct {
+    uint32_t  count;
+    uint32_t  capacity;
+    Collapse* items;
+} Heap;
+
+// triangles are kept as corners, three per triangle. the corners of each
+// vertex are linked into a list starting at head, which picks up the lists
+// of the vertices collapsed into it. corners of removed triangles are
+// skipped and pruned as the lists are walked.
+typedef struct {
+    const Vec3* positions;
+    uint32_t    triangleCount;
+    uint32_t*   indices;
+    uint32_t*   next;
+    uint32_t*   head;
+    bool*       removed;
+    bool*       collapsed;
+    uint32_t*   versions;
+    uint32_t*   marks;
+    uint32_t    mark;
+    Quadric*    quadrics;
+    Heap        heap;
+} Mesh;
+
+static void heapPush(Heap* heap, const Collapse collapse)
+{
+    if (heap->count == heap->capacity)
+    {
+        heap->capacity = heap->capacity ? heap->capacity * 2 : 1024;
+        heap->items    = realloc(heap->items, heap->capacity * sizeof(Collapse));
+        assert(heap->items);
+    }
+    uint32_t i = heap->count++;
+    while (i > 0)
+    {
+        const uint32_t parent = (i - 1) / 2;
+        if (heap->items[parent].error <= collapse.error)
+            break;
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i] = collapse;
+}
+
+static Collapse heapPop(Heap* heap)
+{
+    assert(heap->count);
+    const Collapse top  = heap->items[0];
+    const Collapse last = heap->items[--heap->count];
+    uint32_t i = 0;
+    for (;;)
+    {
+        uint32_t child = 2 * i + 1;
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count && heap->items[child + 1].error < heap->items[child].error)
+            child++;
+        if (last.error <= heap->items[child].error)
+            break;
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->count)
+        heap->items[i] = last;
+    return top;
+}
+
+// n must be of unit length
+static void addPlane(Quadric* q, const double n[3], const double d, const double weight)
+{
+    q->a[0] += weight * n[0] * n[0];
+    q->a[1] += weight * n[0] * n[1];
+    q->a[2] += weight * n[0] * n[2];
+    q->a[3] += weight * n[0] * d;
+    q->a[4] += weight * n[1] * n[1];
+    q->a[5] += weight * n[1] * n[2];
+    q->a[6] += weight * n[1] * d;
+    q->a[7] += weight * n[2] * n[2];
+    q->a[8] += weight * n[2] * d;
+    q->a[9] += weight * d * d;
+    q->weight += weight;
+}
+
+static void addQuadric(Quadric* q, const Quadric* other)
+{
+    for (int i = 0; i < 10; i++)
+        q->a[i] += other->a[i];
+    q->weight += other->weight;
+}
+
+static double evalQuadric(const Quadric* q, const Vec3* p)
+{
+    const double x = p->x[0];
+    const double y = p->x[1];
+    const double z = p->x[2];
+    return q->a[0] * x * x + 2.0 * q->a[1] * x * y + 2.0 * q->a[2] * x * z + 2.0 * q->a[3] * x
+         + q->a[4] * y * y + 2.0 * q->a[5] * y * z + 2.0 * q->a[6] * y
+         + q->a[7] * z * z + 2.0 * q->a[8] * z
+         + q->a[9];
+}
+
+static void sub(const Vec3* a, const Vec3* b, double out[3])
+{
+    for (int i = 0; i < 3; i++)
+        out[i] = (double)a->x[i] - b->x[i];
+}
+
+static void cross(const double a[3], const double b[3], double out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double dot(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// unnormalized normal of the triangle a b c, twice its area long
+static void triangleNormal(const Vec3* a, const Vec3* b, const Vec3* c, double n[3])
+{
+    double ab[3], ac[3];
+    sub(b, a, ab);
+    sub(c, a, ac);
+    cross(ab, ac, n);
+}
+
+// mean squared distance of the merged vertex from the planes of both
+static float collapseError(const Mesh* mesh, const uint32_t from, const uint32_t to)
+{
+    Quadric q = mesh->quadrics[from];
+    addQuadric(&q, &mesh->quadrics[to]);
+    if (q.weight <= 0.0)
+        return 0.0f;
+    const double error = evalQuadric(&q, &mesh->positions[to]) / q.weight;
+    return error > 0.0 ? (float)error : 0.0f;
+}
+
+static void queueEdge(Mesh* mesh, const uint32_t a, const uint32_t b)
+{
+    // only the cheaper direction is queued. if it turns out to be invalid
+    // the edge waits until its neighbourhood changes.
+    const float ab = collapseError(mesh, a, b);
+    const float ba = collapseError(mesh, b, a);
+    const uint32_t stamp = mesh->versions[a] + mesh->versions[b];
+    heapPush(&mesh->heap, ab <= ba ?
+            (Collapse){ .error = ab, .from = a, .to = b, .stamp = stamp } :
+            (Collapse){ .error = ba, .from = b, .to = a, .stamp = stamp });
+}
+
+static void pruneCorners(Mesh* mesh, const uint32_t v)
+{
+    uint32_t* link = &mesh->head[v];
+    while (*link != NONE)
+    {
+        if (mesh->removed[*link / 3])
+            *link = mesh->next[*link];
+        else
+            link = &mesh->next[*link];
+    }
+}
+
+// the vertex a corner's triangle continues with, in winding order
+static uint32_t nextVertex(const Mesh* mesh, const uint32_t corner)
+{
+    return mesh->indices[corner - corner % 3 + (corner + 1) % 3];
+}
+
+static uint32_t prevVertex(const Mesh* mesh, const uint32_t corner)
+{
+    return mesh->indices[corner - corner % 3 + (corner + 2) % 3];
+}
+
+// an edge is on the border if no triangle runs along it the other way
+static bool isBorder(const Mesh* mesh, const uint32_t a, const uint32_t b)
+{
+    for (uint32_t c = mesh->head[b]; c != NONE; c = mesh->next[c])
+    {
+        if (nextVertex(mesh, c) == a)
+            return false;
+    }
+    return true;
+}
+
+static void initQuadrics(Mesh* mesh, const uint32_t triangleCount)
+{
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t* tri = &mesh->indices[t * 3];
+        const Vec3* p[3] = {
+            &mesh->positions[tri[0]], &mesh->positions[tri[1]], &mesh->positions[tri[2]]
+        };
+        double n[3];
+        triangleNormal(p[0], p[1], p[2], n);
+        const double length = sqrt(dot(n, n));
+        if (length == 0.0)
+            continue;
+        for (int i = 0; i < 3; i++)
+            n[i] /= length;
+        const double d = -(n[0] * p[0]->x[0] + n[1] * p[0]->x[1] + n[2] * p[0]->x[2]);
+        for (int k = 0; k < 3; k++)
+            addPlane(&mesh->quadrics[tri[k]], n, d, 0.5 * length);
+
+        for (int k = 0; k < 3; k++)
+        {
+            const uint32_t a = tri[k];
+            const uint32_t b = tri[(k + 1) % 3];
+            if (!isBorder(mesh, a, b))
+                continue;
+            double edge[3], m[3];
+            sub(p[(k + 1) % 3], p[k], edge);
+            cross(n, edge, m);
+            const double edgeSq = dot(edge, edge);
+            if (edgeSq == 0.0)
+                continue;
+            const double mLength = sqrt(dot(m, m));
+            for (int i = 0; i < 3; i++)
+                m[i] /= mLength;
+            const double md = -(m[0] * p[k]->x[0] + m[1] * p[k]->x[1] + m[2] * p[k]->x[2]);
+            addPlane(&mesh->quadrics[a], m, md, BORDER_WEIGHT * edgeSq);
+            addPlane(&mesh->quadrics[b], m, md, BORDER_WEIGHT * edgeSq);
+        }
+    }
+}
+
+// rejects collapses that flip a triangle or pinch the surface, which they do
+// if the two vertices have neighbours in common besides the third vertices
+// of the triangles on their edge
+static bool canCollapse(Mesh* mesh, const uint32_t from, const uint32_t to)
+{
+    const uint32_t neighbourMark = ++mesh->mark;
+    for (uint32_t c = mesh->head[to]; c != NONE; c = mesh->next[c])
+    {
+        if (mesh->removed[c / 3])
+            continue;
+        mesh->marks[nextVertex(mesh, c)] = neighbourMark;
+        mesh->marks[prevVertex(mesh, c)] = neighbourMark;
+    }
+
+    const uint32_t countedMark = ++mesh->mark;
+    uint32_t edgeTriangles = 0;
+    uint32_t common = 0;
+    const Vec3* pFrom = &mesh->positions[from];
+    const Vec3* pTo   = &mesh->positions[to];
+    for (uint32_t c = mesh->head[from]; c != NONE; c = mesh->next[c])
+    {
+        if (mesh->removed[c / 3])
+            continue;
+        const uint32_t a = nextVertex(mesh, c);
+        const uint32_t b = prevVertex(mesh, c);
+        if (a == to || b == to)
+        {
+            edgeTriangles++;
+        }
+        else
+        {
+            double before[3], after[3];
+            triangleNormal(pFrom, &mesh->positions[a], &mesh->positions[b], before);
+            triangleNormal(pTo,   &mesh->positions[a], &mesh->positions[b], after);
+            if (dot(before, after) < 0.25 * sqrt(dot(before, before) * dot(after, after)))
+                return false;
+        }
+        const uint32_t neighbours[2] = { a, b };
+        for (int i = 0; i < 2; i++)
+        {
+            const uint32_t w = neighbours[i];
+            if (w == to || mesh->marks[w] != neighbourMark)
+                continue;
+            mesh->marks[w] = countedMark;
+            common++;
+        }
+    }
+    return common <= edgeTriangles;
+}
+
+static void collapse(Mesh* mesh, const uint32_t from, const uint32_t to)
+{
+    uint32_t last = NONE;
+    for (uint32_t c = mesh->head[from]; c != NONE; c = mesh->next[c])
+    {
+        last = c;
+        const uint32_t t = c / 3;
+        if (mesh->removed[t])
+            continue;
+        if (nextVertex(mesh, c) == to || prevVertex(mesh, c) == to)
+        {
+            mesh->removed[t] = true;
+            mesh->triangleCount--;
+        }
+        else
+            mesh->indices[c] = to;
+    }
+    if (last != NONE)
+    {
+        mesh->next[last] = mesh->head[to];
+        mesh->head[to]   = mesh->head[from];
+    }
+    mesh->head[from] = NONE;
+    mesh->collapsed[from] = true;
+    mesh->versions[to]++;
+    addQuadric(&mesh->quadrics[to], &mesh->quadrics[from]);
+    pruneCorners(mesh, to);
+
+    // the error of every edge at the merged vertex changed
+    const uint32_t queuedMark = ++mesh->mark;
+    for (uint32_t c = mesh->head[to]; c != NONE; c = mesh->next[c])
+    {
+        const uint32_t neighbours[2] = { nextVertex(mesh, c), prevVertex(mesh, c) };
+        for (int i = 0; i < 2; i++)
+        {
+            const uint32_t w = neighbours[i];
+            if (w == to || mesh->marks[w] == queuedMark)
+                continue;
+            mesh->marks[w] = queuedMark;
+            queueEdge(mesh, to, w);
+        }
+    }
+}
+
+static void writeLevel(const Mesh* mesh, const uint32_t triangleCount, const float error,
+        R_SimplifiedLevel* level)
+{
+    level->indexCount = mesh->triangleCount * 3;
+    level->indices    = malloc(level->indexCount * sizeof(uint32_t));
+    level->error      = error;
+    assert(level->indices);
+    uint32_t* iter = level->indices;
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        if (mesh->removed[t])
+            continue;
+        memcpy(iter, &mesh->indices[t * 3], 3 * sizeof(uint32_t));
+        iter += 3;
+    }
+}
+
+uint32_t r_Simplify(const uint32_t* indices, uint32_t indexCount, const Vec3* positions, uint32_t vertexCount,
+        uint32_t minTriangleCount, uint32_t maxLevels, R_SimplifiedLevel* levels)
+{
+    const uint32_t triangleCount = indexCount / 3;
+    if (maxLevels == 0 || triangleCount / 2 < minTriangleCount)
+        return 0;
+    for (uint32_t i = 0; i < triangleCount * 3; i++)
+    {
+        if (indices[i] >= vertexCount)
+            return 0;
+    }
+
+    Mesh mesh = {
+        .positions     = positions,
+        .triangleCount = triangleCount,
+        .indices       = malloc(triangleCount * 3 * sizeof(uint32_t)),
+        .next          = malloc(triangleCount * 3 * sizeof(uint32_t)),
+        .head          = malloc(vertexCount * sizeof(uint32_t)),
+        .removed       = calloc(triangleCount, sizeof(bool)),
+        .collapsed     = calloc(vertexCount, sizeof(bool)),
+        .versions      = calloc(vertexCount, sizeof(uint32_t)),
+        .marks         = calloc(vertexCount, sizeof(uint32_t)),
+        .quadrics      = calloc(vertexCount, sizeof(Quadric))
+    };
+    assert(mesh.indices && mesh.next && mesh.head && mesh.removed && mesh.collapsed &&
+            mesh.versions && mesh.marks && mesh.quadrics);
+    memcpy(mesh.indices, indices, triangleCount * 3 * sizeof(uint32_t));
+    memset(mesh.head, 0xff, vertexCount * sizeof(uint32_t));
+    for (uint32_t c = triangleCount * 3; c-- > 0; )
+    {
+        mesh.next[c] = mesh.head[mesh.indices[c]];
+        mesh.head[mesh.indices[c]] = c;
+    }
+
+    initQuadrics(&mesh, triangleCount);
+
+    // interior edges show up once in each direction
+    for (uint32_t c = 0; c < triangleCount * 3; c++)
+    {
+        const uint32_t a = mesh.indices[c];
+        const uint32_t b = nextVertex(&mesh, c);
+        if (a != b && (a < b || isBorder(&mesh, a, b)))
+            queueEdge(&mesh, a, b);
+    }
+
+    uint32_t levelCount = 0;
+    uint32_t target = triangleCount / 2;
+    float maxError = 0.0f;
+    while (levelCount < maxLevels && target >= minTriangleCount)
+    {
+        while (mesh.triangleCount > target && mesh.heap.count)
+        {
+            const Collapse c = heapPop(&mesh.heap);
+            if (mesh.collapsed[c.from] || mesh.collapsed[c.to] ||
+                    mesh.versions[c.from] + mesh.versions[c.to] != c.stamp)
+                continue;
+            if (!canCollapse(&mesh, c.from, c.to))
+                continue;
+            collapse(&mesh, c.from, c.to);
+            if (c.error > maxError)
+                maxError = c.error;
+        }
+        const bool reached = mesh.triangleCount <= target;
+        if (!reached)
+        {
+            // nothing left to collapse
+            const uint32_t previous = levelCount ? levels[levelCount - 1].indexCount / 3 : triangleCount;
+            if (mesh.triangleCount > previous - (uint32_t)(previous * MIN_REDUCTION))
+                break;
+        }
+        writeLevel(&mesh, triangleCount, sqrtf(maxError), &levels[levelCount++]);
+        if (!reached)
+            break;
+        target = mesh.triangleCount / 2;
+    }
+
+    free(mesh.indices);
+    free(mesh.next);
+    free(mesh.head);
+    free(mesh.removed);
+    free(mesh.collapsed);
+    free(mesh.versions);
+    free(mesh.marks);
+    free(mesh.quadrics);
+    free(mesh.heap.items);
+    return levelCount;
+}
+
+void r_FreeSimplified(R_SimplifiedLevel* levels, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        free(levels[i].indices);
+        levels[i] = (R_SimplifiedLevel){0};
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef VIEWER_R_SIMPLIFY_H
+#define VIEWER_R_SIMPLIFY_H
+
+#include <stdint.h>
+#include <tanto/m_math.h>
+
+// quadric error simplification of triangle meshes by edge collapse, used to
+// build the levels of detail of large prims. vertices are only ever merged
+// into one another, never moved, so every level indexes the vertices of the
+// input and draws with them as they are. it touches nothing but its
+// arguments and may run on any number of threads at once.
+
+typedef struct {
+    uint32_t  indexCount;
+    uint32_t* indices;
+    // estimated distance of the level from the input surface, in the units
+    // of the positions
+    float     error;
+} R_SimplifiedLevel;
+
+// simplifies the triangles down to half their count, then half of that and
+// so on, writing one level per step. stops once a step would go below
+// minTriangleCount, the mesh cannot be reduced much further or maxLevels
+// levels are written. returns the number of levels, coarsest last; their
+// indices must be freed with r_FreeSimplified.
+uint32_t r_Simplify(const uint32_t* indices, uint32_t indexCount, const Vec3* positions, uint32_t vertexCount,
+        uint32_t minTriangleCount, uint32_t maxLevels, R_SimplifiedLevel* levels);
+void r_FreeSimplified(R_SimplifiedLevel* levels, uint32_t count);
+
+#endif /* end of include guard: VIEWER_R_SIMPLIFY_H */
@@ -0,0 +1,531 @@
+#include "softras.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LANE_COUNT R_SR_LANE_COUNT
+#define TILE_SIZE  R_SR_TILE_SIZE
+
+typedef float   Lanes __attribute__((vector_size(LANE_COUNT * sizeof(float))));
+typedef int32_t Mask  __attribute__((vector_size(LANE_COUNT * sizeof(int32_t))));
+
+// attributes interpolated over triangles: the world position, the world
+// normal and the color
+#define ATTR_POSITION 0
+#define ATTR_NORMAL   3
+#define ATTR_COLOR    6
+#define ATTR_COUNT    10
+
+// a triangle clipped by the near plane has up to four corners
+#define MAX_CORNERS 4
+
+// bins start with room for this many triangles
+#define BIN_MIN_CAPACITY 64
+
+// outcodes of the planes of the clip volume
+#define OUT_LEFT   0x01
+#define OUT_RIGHT  0x02
+#define OUT_BOTTOM 0x04
+#define OUT_TOP    0x08
+#define OUT_NEAR   0x10
+#define OUT_FAR    0x20
+
+// as the raster path clears its attachments
+#define CLEAR_DEPTH   1.0f
+#define CLEAR_PRIM_ID -1
+
+static const Vec4 clearColor = {{0.002f, 0.023f, 0.009f, 1.0f}};
+
+struct R_SrTriangle {
+    // pixels from the bottom left corner of the target
+    float   x[3];
+    float   y[3];
+    float   z[3]; // clip z over w
+    float   invW[3];
+    // attributes of the corners divided by their w, so that interpolating
+    // them is correct in perspective
+    float   attrs[3][ATTR_COUNT];
+    int32_t pickId;
+};
+
+typedef struct {
+    float clip[4];
+    float attrs[ATTR_COUNT];
+} Corner;
+
+// what is in front of each pixel of a tile, by rows of TILE_SIZE. u and v
+// are the screen space weights of the second and third corners.
+typedef struct {
+    float depth[TILE_SIZE * TILE_SIZE] __attribute__((aligned(sizeof(Lanes))));
+    float u[TILE_SIZE * TILE_SIZE]     __attribute__((aligned(sizeof(Lanes))));
+    float v[TILE_SIZE * TILE_SIZE]     __attribute__((aligned(sizeof(Lanes))));
+    const R_SrTriangle* front[TILE_SIZE * TILE_SIZE];
+} Tile;
+
+static void freeBinner(R_SrBinner* binner, const uint32_t tileCount)
+{
+    if (binner->bins)
+    {
+        for (uint32_t tile = 0; tile < tileCount; tile++)
+            free(binner->bins[tile].triangles);
+    }
+    free(binner->bins);
+    free(binner->triangles);
+    memset(binner, 0, sizeof(*binner));
+}
+
+void r_SrBeginFrame(R_SrFrame* frame, const R_RtTarget* target, uint32_t binnerCount)
+{
+    const uint32_t across = (target->width  + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t up     = (target->height + TILE_SIZE - 1) / TILE_SIZE;
+    if (across * up != frame->tilesAcross * frame->tilesUp)
+        r_SrFreeFrame(frame);
+    frame->width       = target->width;
+    frame->height      = target->height;
+    frame->tilesAcross = across;
+    frame->tilesUp     = up;
+
+    const uint32_t tileCount = across * up;
+    if (binnerCount > frame->binnerCapacity)
+    {
+        frame->binners = realloc(frame->binners, binnerCount * sizeof(R_SrBinner));
+        for (uint32_t b = frame->binnerCapacity; b < binnerCount; b++)
+        {
+            memset(&frame->binners[b], 0, sizeof(R_SrBinner));
+            frame->binners[b].bins = calloc(tileCount ? tileCount : 1, sizeof(R_SrBin));
+        }
+        frame->binnerCapacity = binnerCount;
+    }
+    for (uint32_t b = 0; b < binnerCount; b++)
+    {
+        R_SrBinner* binner = &frame->binners[b];
+        binner->triangleCount = 0;
+        for (uint32_t tile = 0; tile < tileCount; tile++)
+            binner->bins[tile].count = 0;
+    }
+    frame->binnerCount = binnerCount;
+}
+
+void r_SrFreeFrame(R_SrFrame* frame)
+{
+    const uint32_t tileCount = frame->tilesAcross * frame->tilesUp;
+    for (uint32_t b = 0; b < frame->binnerCapacity; b++)
+        freeBinner(&frame->binners[b], tileCount);
+    free(frame->binners);
+    memset(frame, 0, sizeof(*frame));
+}
+
+static void pushBin(R_SrBin* bin, const uint32_t triangle)
+{
+    if (bin->count == bin->capacity)
+    {
+        bin->capacity  = bin->capacity ? 2 * bin->capacity : BIN_MIN_CAPACITY;
+        bin->triangles = realloc(bin->triangles, bin->capacity * sizeof(uint32_t));
+    }
+    bin->triangles[bin->count++] = triangle;
+}
+
+static uint32_t pushTriangle(R_SrBinner* binner, const R_SrTriangle* triangle)
+{
+    if (binner->triangleCount == binner->triangleCapacity)
+    {
+        binner->triangleCapacity = binner->triangleCapacity ? 2 * binner->triangleCapacity : BIN_MIN_CAPACITY;
+        binner->triangles = realloc(binner->triangles, binner->triangleCapacity * sizeof(R_SrTriangle));
+    }
+    binner->triangles[binner->triangleCount] = *triangle;
+    return binner->triangleCount++;
+}
+
+// point p, with a w of 1, times the row vector transform m
+static void transformPoint(const Mat4* m, const float p[3], float out[4])
+{
+    for (int c = 0; c < 4; c++)
+        out[c] = p[0] * m->x[0][c] + p[1] * m->x[1][c] + p[2] * m->x[2][c] + m->x[3][c];
+}
+
+static uint32_t outcode(const float clip[4])
+{
+    const float w = clip[3];
+    return (clip[0] < -w ? OUT_LEFT   : 0) | (clip[0] > w ? OUT_RIGHT : 0) |
+           (clip[1] < -w ? OUT_BOTTOM : 0) | (clip[1] > w ? OUT_TOP   : 0) |
+           (clip[2] < -w ? OUT_NEAR   : 0) | (clip[2] > w ? OUT_FAR   : 0);
+}
+
+// the part of the triangle in front of the near plane, a polygon of up to
+// MAX_CORNERS corners
+static uint32_t clipNear(const Corner in[3], Corner out[MAX_CORNERS])
+{
+    uint32_t count = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        const Corner* a = &in[i];
+        const Corner* b = &in[(i + 1) % 3];
+        const float da = a->clip[2] + a->clip[3];
+        const float db = b->clip[2] + b->clip[3];
+        if (da >= 0.0f)
+            out[count++] = *a;
+        if ((da >= 0.0f) != (db >= 0.0f))
+        {
+            const float t = da / (da - db);
+            Corner* c = &out[count++];
+            for (int k = 0; k < 4; k++)
+                c->clip[k] = a->clip[k] + t * (b->clip[k] - a->clip[k]);
+            for (int k = 0; k < ATTR_COUNT; k++)
+                c->attrs[k] = a->attrs[k] + t * (b->attrs[k] - a->attrs[k]);
+        }
+    }
+    assert(count <= MAX_CORNERS);
+    return count;
+}
+
+// projects a triangle in front of the near plane to the screen and bins it
+// by the tiles of the pixels it may cover. triangles that cover no pixel
+// centers are dropped.
+static void binTriangle(const R_SrFrame* frame, R_SrBinner* binner, const Corner* c0, const Corner* c1,
+        const Corner* c2, const int32_t pickId)
+{
+    const Corner* corners[3] = {c0, c1, c2};
+    R_SrTriangle t;
+    for (int i = 0; i < 3; i++)
+    {
+        const float* clip = corners[i]->clip;
+        if (clip[3] <= 0.0f)
+            return;
+        const float invW = 1.0f / clip[3];
+        t.x[i]    = (clip[0] * invW * 0.5f + 0.5f) * frame->width;
+        t.y[i]    = (clip[1] * invW * 0.5f + 0.5f) * frame->height;
+        t.z[i]    = clip[2] * invW;
+        t.invW[i] = invW;
+        for (int k = 0; k < ATTR_COUNT; k++)
+            t.attrs[i][k] = corners[i]->attrs[k] * invW;
+    }
+    t.pickId = pickId;
+
+    const float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+    if (!(area != 0.0f) || !isfinite(area))
+        return;
+
+    const float minX = fminf(t.x[0], fminf(t.x[1], t.x[2]));
+    const float maxX = fmaxf(t.x[0], fmaxf(t.x[1], t.x[2]));
+    const float minY = fminf(t.y[0], fminf(t.y[1], t.y[2]));
+    const float maxY = fmaxf(t.y[0], fmaxf(t.y[1], t.y[2]));
+    const float x0 = ceilf(fmaxf(minX - 0.5f, 0.0f));
+    const float x1 = floorf(fminf(maxX - 0.5f, frame->width - 1.0f));
+    const float y0 = ceilf(fmaxf(minY - 0.5f, 0.0f));
+    const float y1 = floorf(fminf(maxY - 0.5f, frame->height - 1.0f));
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    const uint32_t index = pushTriangle(binner, &t);
+    for (uint32_t ty = (uint32_t)y0 / TILE_SIZE; ty <= (uint32_t)y1 / TILE_SIZE; ty++)
+        for (uint32_t tx = (uint32_t)x0 / TILE_SIZE; tx <= (uint32_t)x1 / TILE_SIZE; tx++)
+            pushBin(&binner->bins[ty * frame->tilesAcross + tx], index);
+}
+
+void r_SrSetup(R_SrFrame* frame, uint32_t binner, const R_RtMesh* mesh, const R_RtInstance* instance,
+        const R_RtView* view, uint32_t firstTriangle, uint32_t triangleCount)
+{
+    assert(binner < frame->binnerCount);
+    R_SrBinner* bins = &frame->binners[binner];
+    const float (*toObject)[4] = instance->toObject.x;
+    for (uint32_t triangle = firstTriangle; triangle < firstTriangle + triangleCount; triangle++)
+    {
+        const uint32_t* tri = &mesh->indices[triangle * 3];
+        Corner corners[3];
+        uint32_t outAll = ~0u;
+        uint32_t outAny = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            Corner* c = &corners[i];
+            float world[4];
+            transformPoint(&instance->toWorld, mesh->positions[tri[i]].x, world);
+            transformPoint(&view->toClip, world, c->clip);
+            const uint32_t out = outcode(c->clip);
+            outAll &= out;
+            outAny |= out;
+            for (int a = 0; a < 3; a++)
+                c->attrs[ATTR_POSITION + a] = world[a];
+        }
+        // wholly outside one of the planes
+        if (outAll)
+            continue;
+
+        float flat[3] = {0};
+        if (!mesh->normals)
+        {
+            const float* p0 = &corners[0].attrs[ATTR_POSITION];
+            const float* p1 = &corners[1].attrs[ATTR_POSITION];
+            const float* p2 = &corners[2].attrs[ATTR_POSITION];
+            const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            flat[0] = e1[1] * e2[2] - e1[2] * e2[1];
+            flat[1] = e1[2] * e2[0] - e1[0] * e2[2];
+            flat[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            Corner* c = &corners[i];
+            if (mesh->normals)
+            {
+                // normals go to the world by the transpose of the inverse
+                const float* n = mesh->normals[tri[i]].x;
+                for (int a = 0; a < 3; a++)
+                    c->attrs[ATTR_NORMAL + a] = n[0] * toObject[a][0] + n[1] * toObject[a][1] +
+                        n[2] * toObject[a][2];
+            }
+            else
+            {
+                for (int a = 0; a < 3; a++)
+                    c->attrs[ATTR_NORMAL + a] = flat[a];
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                float color = instance->color.x[k];
+                if (mesh->pointColors)
+                    color *= mesh->pointColors[tri[i]].x[k];
+                if (mesh->triangleColors)
+                    color *= mesh->triangleColors[triangle].x[k];
+                c->attrs[ATTR_COLOR + k] = color;
+            }
+        }
+
+        if (!(outAny & OUT_NEAR))
+        {
+            binTriangle(frame, bins, &corners[0], &corners[1], &corners[2], instance->pickId);
+            continue;
+        }
+        Corner clipped[MAX_CORNERS];
+        const uint32_t count = clipNear(corners, clipped);
+        for (uint32_t i = 1; i + 1 < count; i++)
+            binTriangle(frame, bins, &clipped[0], &clipped[i], &clipped[i + 1], instance->pickId);
+    }
+}
+
+uint32_t r_SrTileCount(const R_SrFrame* frame)
+{
+    return frame->tilesAcross * frame->tilesUp;
+}
+
+// as in raytrace.c, no lanes are passed or returned by value, which the
+// base x86-64 abi does in memory and warns about with -Wpsabi
+#define SPLAT(x)       ((Lanes){0} + (x))
+#define BLEND(m, a, b) ((Lanes)(((m) & (Mask)(a)) | (~(m) & (Mask)(b))))
+
+static bool anyLane(const Mask* m)
+{
+    for (int lane = 0; lane < LANE_COUNT; lane++)
+        if ((*m)[lane])
+            return true;
+    return false;
+}
+
+// tests the pixels of the tile the triangle may cover against the depths
+// so far, and keeps the triangle in front of those it is nearer at. pixels
+// on an edge belong to the triangle to its left when going along the edge,
+// so that triangles that share it do not both take them.
+static void rasterizeTriangle(const R_SrTriangle* t, const uint32_t x0, const uint32_t y0,
+        const uint32_t width, const uint32_t height, Tile* tile)
+{
+    const float area = (t->x[1] - t->x[0]) * (t->y[2] - t->y[0]) - (t->x[2] - t->x[0]) * (t->y[1] - t->y[0]);
+    // triangles are drawn from both sides, as the raster path draws them
+    const float sign = area > 0.0f ? 1.0f : -1.0f;
+    const float invArea = 1.0f / fabsf(area);
+    float a[3], b[3];
+    Mask onEdge[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const int j = (i + 1) % 3;
+        a[i] = (t->y[i] - t->y[j]) * sign;
+        b[i] = (t->x[j] - t->x[i]) * sign;
+        onEdge[i] = (Mask){0} - (a[i] > 0.0f || (a[i] == 0.0f && b[i] < 0.0f));
+    }
+
+    const float minX = fminf(t->x[0], fminf(t->x[1], t->x[2])) - x0;
+    const float maxX = fmaxf(t->x[0], fmaxf(t->x[1], t->x[2])) - x0;
+    const float minY = fminf(t->y[0], fminf(t->y[1], t->y[2])) - y0;
+    const float maxY = fmaxf(t->y[0], fmaxf(t->y[1], t->y[2])) - y0;
+    const float left   = ceilf(fmaxf(minX - 0.5f, 0.0f));
+    const float right  = floorf(fminf(maxX - 0.5f, width - 1.0f));
+    const float bottom = ceilf(fmaxf(minY - 0.5f, 0.0f));
+    const float top    = floorf(fminf(maxY - 0.5f, height - 1.0f));
+    if (left > right || bottom > top)
+        return;
+
+    Lanes offsets;
+    for (int lane = 0; lane < LANE_COUNT; lane++)
+        offsets[lane] = lane;
+    for (uint32_t ty = bottom; ty <= (uint32_t)top; ty++)
+    {
+        const float cy = y0 + ty + 0.5f;
+        const Lanes ey[3] = {SPLAT(b[0] * (cy - t->y[0])), SPLAT(b[1] * (cy - t->y[1])),
+            SPLAT(b[2] * (cy - t->y[2]))};
+        for (uint32_t tx = (uint32_t)left & ~(LANE_COUNT - 1); tx <= (uint32_t)right; tx += LANE_COUNT)
+        {
+            const Lanes column = (float)tx + offsets;
+            const Lanes cx = x0 + 0.5f + column;
+            Mask inside = (column >= left) & (column <= right);
+            Lanes e[3];
+            for (int i = 0; i < 3; i++)
+            {
+                e[i] = a[i] * (cx - t->x[i]) + ey[i];
+                inside &= (e[i] > 0.0f) | ((e[i] == 0.0f) & onEdge[i]);
+            }
+            if (!anyLane(&inside))
+                continue;
+            // each edge weighs the corner across from it
+            const Lanes u = e[2] * invArea;
+            const Lanes v = e[0] * invArea;
+            const Lanes z = (1.0f - u - v) * t->z[0] + u * t->z[1] + v * t->z[2];
+            const uint32_t first = ty * TILE_SIZE + tx;
+            Lanes* depth = (Lanes*)&tile->depth[first];
+            const Mask nearer = inside & (z <= *depth);
+            if (!anyLane(&nearer))
+                continue;
+            *depth = BLEND(nearer, z, *depth);
+            *(Lanes*)&tile->u[first] = BLEND(nearer, u, *(Lanes*)&tile->u[first]);
+            *(Lanes*)&tile->v[first] = BLEND(nearer, v, *(Lanes*)&tile->v[first]);
+            for (int lane = 0; lane < LANE_COUNT; lane++)
+                if (nearer[lane])
+                    tile->front[first + lane] = t;
+        }
+    }
+}
+
+static float dot3(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void normalize3(float v[3])
+{
+    const float length = sqrtf(dot3(v, v));
+    const float scale  = length > 0.0f ? 1.0f / length : 0.0f;
+    for (int a = 0; a < 3; a++)
+        v[a] *= scale;
+}
+
+static uint32_t toUnorm8(const float x)
+{
+    return x <= 0.0f ? 0 : x >= 1.0f ? 255 : (uint32_t)(x * 255.0f + 0.5f);
+}
+
+static uint32_t packColor(const float color[4], const float light)
+{
+    return toUnorm8(color[0] * light) | toUnorm8(color[1] * light) << 8 |
+        toUnorm8(color[2] * light) << 16 | toUnorm8(color[3]) << 24;
+}
+
+// rounds to nearest. values too small for a normal half are flushed to
+// zero and nans are not expected.
+static uint16_t toHalf(const float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const uint16_t sign     = (bits >> 16) & 0x8000;
+    const int32_t  exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    const uint32_t mantissa = bits & 0x7fffff;
+    if (exponent <= 0)
+        return sign;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    const uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    return sign | (uint16_t)(half + ((mantissa >> 12) & 1));
+}
+
+// the eye is the point that clips to (0, 0, 1, 0). an orthographic eye is
+// at infinity and eye holds the direction towards it.
+static bool findEye(const R_RtView* view, float eye[3])
+{
+    const float* e = view->fromClip.x[2];
+    const float size = fabsf(e[0]) + fabsf(e[1]) + fabsf(e[2]);
+    const bool atInfinity = fabsf(e[3]) <= 1e-6f * size;
+    for (int a = 0; a < 3; a++)
+        eye[a] = atInfinity ? e[a] : e[a] / e[3];
+    return atInfinity;
+}
+
+void r_SrRasterizeTile(const R_SrFrame* frame, const R_RtView* view, const R_RtTarget* target, uint32_t tile)
+{
+    assert(target->width == frame->width && target->height == frame->height);
+    const uint32_t x0 = (tile % frame->tilesAcross) * TILE_SIZE;
+    const uint32_t y0 = (tile / frame->tilesAcross) * TILE_SIZE;
+    const uint32_t width  = x0 + TILE_SIZE < frame->width  ? TILE_SIZE : frame->width  - x0;
+    const uint32_t height = y0 + TILE_SIZE < frame->height ? TILE_SIZE : frame->height - y0;
+
+    Tile buffers;
+    for (uint32_t i = 0; i < TILE_SIZE * TILE_SIZE; i++)
+    {
+        buffers.depth[i] = CLEAR_DEPTH;
+        buffers.u[i]     = 0.0f;
+        buffers.v[i]     = 0.0f;
+        buffers.front[i] = NULL;
+    }
+    for (uint32_t b = 0; b < frame->binnerCount; b++)
+    {
+        const R_SrBinner* binner = &frame->binners[b];
+        const R_SrBin*    bin    = &binner->bins[tile];
+        for (uint32_t i = 0; i < bin->count; i++)
+            rasterizeTriangle(&binner->triangles[bin->triangles[i]], x0, y0, width, height, &buffers);
+    }
+
+    float eye[3];
+    const bool eyeAtInfinity = findEye(view, eye);
+    for (uint32_t ty = 0; ty < height; ty++)
+    {
+        for (uint32_t tx = 0; tx < width; tx++)
+        {
+            const uint32_t i     = ty * TILE_SIZE + tx;
+            const uint32_t pixel = (y0 + ty) * target->width + x0 + tx;
+            const R_SrTriangle* t = buffers.front[i];
+            if (!t)
+            {
+                if (target->color)
+                    target->color[pixel] = packColor(clearColor.x, 1.0f);
+                if (target->depth)
+                    target->depth[pixel] = CLEAR_DEPTH;
+                if (target->primId)
+                    target->primId[pixel] = CLEAR_PRIM_ID;
+                if (target->normal)
+                    memset(&target->normal[pixel * 4], 0, 4 * sizeof(uint16_t));
+                continue;
+            }
+
+            const float u = buffers.u[i];
+            const float v = buffers.v[i];
+            const float w = 1.0f - u - v;
+            const float depthW = 1.0f / (w * t->invW[0] + u * t->invW[1] + v * t->invW[2]);
+            float attrs[ATTR_COUNT];
+            for (int k = 0; k < ATTR_COUNT; k++)
+                attrs[k] = (w * t->attrs[0][k] + u * t->attrs[1][k] + v * t->attrs[2][k]) * depthW;
+
+            float* normal = &attrs[ATTR_NORMAL];
+            float toEye[3];
+            for (int a = 0; a < 3; a++)
+                toEye[a] = eyeAtInfinity ? eye[a] : eye[a] - attrs[ATTR_POSITION + a];
+            normalize3(normal);
+            normalize3(toEye);
+            const float facing = dot3(normal, toEye);
+            if (facing < 0.0f)
+                for (int a = 0; a < 3; a++)
+                    normal[a] = -normal[a];
+
+            if (target->color)
+            {
+                // lit from the eye, from both sides, as the raster path
+                const float light = 0.2f + 0.8f * fabsf(facing);
+                target->color[pixel] = packColor(&attrs[ATTR_COLOR], light);
+            }
+            if (target->depth)
+                target->depth[pixel] = buffers.depth[i];
+            if (target->primId)
+                target->primId[pixel] = t->pickId;
+            if (target->normal)
+            {
+                for (int a = 0; a < 3; a++)
+                    target->normal[pixel * 4 + a] = toHalf(normal[a]);
+                target->normal[pixel * 4 + 3] = toHalf(0.0f);
+            }
+        }
+    }
+}
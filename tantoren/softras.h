@@ -0,0 +1,66 @@
+#ifndef VIEWER_R_SOFTRAS_H
+#define VIEWER_R_SOFTRAS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <tanto/m_math.h>
+#include "raytrace.h"
+
+// rasterization on the cpu, for MODE_SOFTWARE, where there is no vulkan
+// device to draw with. it draws the meshes and instances of raytrace.h into
+// the same targets, shaded as the raster path shades them. a frame goes in
+// two passes. first the triangles are set up in screen space and sorted into
+// bins by the tiles of R_SR_TILE_SIZE squared pixels they touch; setup works
+// on ranges of triangles, each range into a binner of its own. then the
+// tiles are rasterized against depth buffers of their own, R_SR_LANE_COUNT
+// pixels of a row at a time in the lanes of a SIMD vector, and each pixel
+// is shaded once for the triangle left in front. the ranges of the first
+// pass and the tiles of the second touch nothing but their arguments and
+// their own binner or tile, so any number of them may run on threads at
+// once.
+
+#define R_SR_TILE_SIZE  64
+#define R_SR_LANE_COUNT 8
+
+typedef struct R_SrTriangle R_SrTriangle;
+
+// triangles of a tile, as indices into the triangles of their binner
+typedef struct {
+    uint32_t  count;
+    uint32_t  capacity;
+    uint32_t* triangles;
+} R_SrBin;
+
+typedef struct {
+    uint32_t      triangleCount;
+    uint32_t      triangleCapacity;
+    R_SrTriangle* triangles;
+    R_SrBin*      bins; // one per tile
+} R_SrBinner;
+
+// binners keep their memory from one frame to the next while the size of
+// the target stays the same
+typedef struct {
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    tilesAcross;
+    uint32_t    tilesUp;
+    uint32_t    binnerCount;
+    uint32_t    binnerCapacity;
+    R_SrBinner* binners;
+} R_SrFrame;
+
+// empties binnerCount binners for a frame into target
+void r_SrBeginFrame(R_SrFrame* frame, const R_RtTarget* target, uint32_t binnerCount);
+// sets up triangleCount triangles of the mesh of instance from firstTriangle
+// on into binner. the triangles of a binner are drawn in the order they are
+// set up, and those of lower binners first.
+void r_SrSetup(R_SrFrame* frame, uint32_t binner, const R_RtMesh* mesh, const R_RtInstance* instance,
+        const R_RtView* view, uint32_t firstTriangle, uint32_t triangleCount);
+uint32_t r_SrTileCount(const R_SrFrame* frame);
+// draws every pixel of the tile, including those no triangle covers. the
+// ambient occlusion of the view is not drawn.
+void r_SrRasterizeTile(const R_SrFrame* frame, const R_RtView* view, const R_RtTarget* target, uint32_t tile);
+void r_SrFreeFrame(R_SrFrame* frame);
+
+#endif /* end of include guard: VIEWER_R_SOFTRAS_H */
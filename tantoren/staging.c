@@ -0,0 +1,369 @@
+#include "staging.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tanto/v_video.h>
+#include <tanto/v_command.h>
+#include <tanto/t_def.h>
+#include <vulkan/vulkan_core.h>
+
+#define STAGING_BUFFER_COUNT 3
+#define STAGING_BUFFER_SIZE  (1 << 25)
+#define STAGING_ALIGNMENT    16
+
+typedef struct {
+    VkBuffer      dstBuffer;
+    VkAccessFlags dstAccess;
+    VkBufferCopy  region;
+} StagedCopy;
+
+// each staging buffer is reused once the fence of the batch it carried has
+// signaled and the graphics queue has waited on its semaphore.
+static struct {
+    Tanto_V_BufferRegion buffers[STAGING_BUFFER_COUNT];
+    Tanto_V_CommandPool  cmdPools[STAGING_BUFFER_COUNT];
+    VkFence              fences[STAGING_BUFFER_COUNT];
+    VkSemaphore          semaphores[STAGING_BUFFER_COUNT];
+    // the stages that read what each batch wrote, which wait on its semaphore
+    VkPipelineStageFlags waitStages[STAGING_BUFFER_COUNT];
+    bool                 waitPending[STAGING_BUFFER_COUNT];
+    atomic_uint          writers[STAGING_BUFFER_COUNT];
+    uint32_t             current;
+    VkDeviceSize         offset;
+    uint32_t             copyCount;
+    uint32_t             copyCapacity;
+    StagedCopy*          copies;
+} staging;
+
+// graphics side of the ownership handoff
+static struct {
+    Tanto_V_CommandPool    cmdPools[STAGING_BUFFER_COUNT];
+    VkFence                fences[STAGING_BUFFER_COUNT];
+    uint32_t               current;
+    uint32_t               barrierCount;
+    uint32_t               barrierCapacity;
+    VkBufferMemoryBarrier* barriers;
+    VkPipelineStageFlags   stages; // of the barriers
+} acquire;
+
+static bool ownershipTransfer;
+
+static void waitAndResetFence(const VkFence fence)
+{
+    V_ASSERT( vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) );
+    V_ASSERT( vkResetFences(device, 1, &fence) );
+}
+
+void r_StagingInit(void)
+{
+    const VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = VK_FENCE_CREATE_SIGNALED_BIT
+    };
+
+    const VkSemaphoreCreateInfo semaphoreInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+    };
+
+    for (int i = 0; i < STAGING_BUFFER_COUNT; i++) 
+    {
+        staging.buffers[i] = tanto_v_RequestBufferRegion(STAGING_BUFFER_SIZE, 
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, TANTO_V_MEMORY_HOST_TRANSFER_TYPE);
+        staging.cmdPools[i] = tanto_v_RequestCommandPool(TANTO_V_QUEUE_TRANSFER_TYPE);
+        acquire.cmdPools[i] = tanto_v_RequestCommandPool(TANTO_V_QUEUE_GRAPHICS_TYPE);
+        V_ASSERT( vkCreateFence(device, &fenceInfo, NULL, &staging.fences[i]) );
+        V_ASSERT( vkCreateFence(device, &fenceInfo, NULL, &acquire.fences[i]) );
+        V_ASSERT( vkCreateSemaphore(device, &semaphoreInfo, NULL, &staging.semaphores[i]) );
+    }
+
+    // the first buffer is written to right away
+    V_ASSERT( vkResetFences(device, 1, &staging.fences[0]) );
+
+    ownershipTransfer = transferQueueFamilyIndex != graphicsQueueFamilyIndex;
+}
+
+// the stages of the graphics queue that read a range with access. shader
+// reads come from the compute culling passes as well as from drawing.
+static VkPipelineStageFlags readStages(const VkAccessFlags access)
+{
+    VkPipelineStageFlags stages = 0;
+    if (access & (VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT))
+        stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    if (access & (VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT))
+        stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | 
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    if (access & VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+        stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    assert(stages);
+    return stages;
+}
+
+static void pushAcquire(const StagedCopy* copy)
+{
+    if (acquire.barrierCount == acquire.barrierCapacity)
+    {
+        acquire.barrierCapacity = acquire.barrierCapacity ? acquire.barrierCapacity * 2 : 256;
+        acquire.barriers = realloc(acquire.barriers, acquire.barrierCapacity * sizeof(VkBufferMemoryBarrier));
+        assert(acquire.barriers);
+    }
+    acquire.barriers[acquire.barrierCount++] = (VkBufferMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = copy->dstAccess,
+        .srcQueueFamilyIndex = transferQueueFamilyIndex,
+        .dstQueueFamilyIndex = graphicsQueueFamilyIndex,
+        .buffer = copy->dstBuffer,
+        .offset = copy->region.dstOffset,
+        .size   = copy->region.size
+    };
+    acquire.stages |= readStages(copy->dstAccess);
+}
+
+static VkDeviceSize alignStaging(const VkDeviceSize size)
+{
+    return (size + STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)(STAGING_ALIGNMENT - 1);
+}
+
+static void makeRoom(const VkDeviceSize size)
+{
+    if (staging.offset + size <= staging.buffers[staging.current].size)
+        return;
+    r_StagingFlush();
+    Tanto_V_BufferRegion* buffer = &staging.buffers[staging.current];
+    if (size > buffer->size)
+    {
+        // oversized upload. the fence of this buffer was waited on by the
+        // flush, so it can be replaced right away.
+        tanto_v_FreeBufferRegion(buffer);
+        *buffer = tanto_v_RequestBufferRegion(size, 
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, TANTO_V_MEMORY_HOST_TRANSFER_TYPE);
+    }
+}
+
+void* r_StageCopy(const Tanto_V_BufferRegion* dst, VkDeviceSize dstOffset, VkDeviceSize size, 
+        VkAccessFlags dstAccess)
+{
+    assert(dstOffset + size <= dst->size);
+    const VkDeviceSize alignedSize = alignStaging(size);
+
+    makeRoom(alignedSize);
+
+    const Tanto_V_BufferRegion* buffer = &staging.buffers[staging.current];
+
+    if (staging.copyCount == staging.copyCapacity)
+    {
+        staging.copyCapacity = staging.copyCapacity ? staging.copyCapacity * 2 : 256;
+        staging.copies = realloc(staging.copies, staging.copyCapacity * sizeof(StagedCopy));
+        assert(staging.copies);
+    }
+    staging.copies[staging.copyCount++] = (StagedCopy){
+        .dstBuffer = dst->buffer,
+        .dstAccess = dstAccess,
+        .region = {
+            .srcOffset = buffer->offset + staging.offset,
+            .dstOffset = dst->offset + dstOffset,
+            .size      = size
+        }
+    };
+
+    void* hostData = buffer->hostData + staging.offset;
+    staging.offset += alignedSize;
+    return hostData;
+}
+
+uint32_t r_StagingBeginWrite(VkDeviceSize size, uint32_t copyCount)
+{
+    makeRoom(alignStaging(size) + copyCount * STAGING_ALIGNMENT);
+    atomic_fetch_add_explicit(&staging.writers[staging.current], 1, memory_order_relaxed);
+    return staging.current;
+}
+
+void r_StagingEndWrite(uint32_t ticket)
+{
+    assert(ticket < STAGING_BUFFER_COUNT);
+    // publishes the writes to the thread that flushes the buffer
+    atomic_fetch_sub_explicit(&staging.writers[ticket], 1, memory_order_release);
+}
+
+bool r_StagingFlush(void)
+{
+    if (staging.copyCount == 0)
+        return false;
+
+    const uint32_t slot = staging.current;
+    const Tanto_V_CommandPool* cmdPool = &staging.cmdPools[slot];
+
+    // writers outside the lock are only ever copying into staging memory,
+    // so this wait is short
+    while (atomic_load_explicit(&staging.writers[slot], memory_order_acquire))
+        sched_yield();
+
+    vkResetCommandPool(device, cmdPool->handle, 0);
+
+    const VkCommandBufferBeginInfo cbbi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    V_ASSERT( vkBeginCommandBuffer(cmdPool->buffer, &cbbi) );
+
+    // one copy command per run of copies into the same buffer
+    VkBufferCopy* regions = malloc(staging.copyCount * sizeof(VkBufferCopy));
+    assert(regions);
+    uint32_t first = 0;
+    while (first < staging.copyCount)
+    {
+        uint32_t count = 0;
+        while (first + count < staging.copyCount && 
+                staging.copies[first + count].dstBuffer == staging.copies[first].dstBuffer)
+        {
+            regions[count] = staging.copies[first + count].region;
+            count++;
+        }
+        vkCmdCopyBuffer(cmdPool->buffer, staging.buffers[slot].buffer, 
+                staging.copies[first].dstBuffer, count, regions);
+        first += count;
+    }
+    free(regions);
+
+    VkAccessFlags        dstAccess = 0;
+    VkPipelineStageFlags dstStages = 0;
+    for (uint32_t i = 0; i < staging.copyCount; i++) 
+    {
+        dstAccess |= staging.copies[i].dstAccess;
+        dstStages |= readStages(staging.copies[i].dstAccess);
+    }
+    staging.waitStages[slot] = dstStages;
+
+    if (ownershipTransfer)
+    {
+        // the written ranges never need their previous contents, so only the
+        // transfer -> graphics direction of the handoff is required.
+        VkBufferMemoryBarrier* releases = malloc(staging.copyCount * sizeof(VkBufferMemoryBarrier));
+        assert(releases);
+        for (uint32_t i = 0; i < staging.copyCount; i++) 
+        {
+            const StagedCopy* copy = &staging.copies[i];
+            releases[i] = (VkBufferMemoryBarrier){
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = 0,
+                .srcQueueFamilyIndex = transferQueueFamilyIndex,
+                .dstQueueFamilyIndex = graphicsQueueFamilyIndex,
+                .buffer = copy->dstBuffer,
+                .offset = copy->region.dstOffset,
+                .size   = copy->region.size
+            };
+            pushAcquire(copy);
+        }
+        vkCmdPipelineBarrier(cmdPool->buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, staging.copyCount, releases, 0, NULL);
+        free(releases);
+    }
+    else
+    {
+        // the queue is of the graphics family, which takes the reading
+        // stages as they are
+        const VkMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = dstAccess
+        };
+        vkCmdPipelineBarrier(cmdPool->buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0, 
+                1, &barrier, 0, NULL, 0, NULL);
+    }
+
+    V_ASSERT( vkEndCommandBuffer(cmdPool->buffer) );
+
+    const VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdPool->buffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &staging.semaphores[slot]
+    };
+
+    V_ASSERT( vkQueueSubmit(transferQueues[0], 1, &submitInfo, staging.fences[slot]) );
+    staging.waitPending[slot] = true;
+    staging.copyCount = 0;
+
+    // move on to the next staging buffer. its semaphore must have been
+    // waited on before it can be signaled again.
+    staging.current = (slot + 1) % STAGING_BUFFER_COUNT;
+    staging.offset  = 0;
+    if (staging.waitPending[staging.current])
+        r_StagingSubmitAcquires();
+    waitAndResetFence(staging.fences[staging.current]);
+
+    return true;
+}
+
+void r_StagingSubmitAcquires(void)
+{
+    VkSemaphore          waits[STAGING_BUFFER_COUNT];
+    VkPipelineStageFlags waitStages[STAGING_BUFFER_COUNT];
+    uint32_t             waitCount = 0;
+
+    for (int i = 0; i < STAGING_BUFFER_COUNT; i++) 
+    {
+        if (!staging.waitPending[i])
+            continue;
+        waits[waitCount]      = staging.semaphores[i];
+        waitStages[waitCount] = staging.waitStages[i];
+        waitCount++;
+        staging.waitPending[i] = false;
+    }
+
+    if (waitCount == 0)
+        return;
+
+    const uint32_t slot = acquire.current;
+    acquire.current = (slot + 1) % STAGING_BUFFER_COUNT;
+    const Tanto_V_CommandPool* cmdPool = &acquire.cmdPools[slot];
+
+    waitAndResetFence(acquire.fences[slot]);
+    vkResetCommandPool(device, cmdPool->handle, 0);
+
+    const VkCommandBufferBeginInfo cbbi = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    V_ASSERT( vkBeginCommandBuffer(cmdPool->buffer, &cbbi) );
+    // the barriers start at the stages that waited on the semaphores, which
+    // orders them after the transfers
+    if (acquire.barrierCount)
+        vkCmdPipelineBarrier(cmdPool->buffer, acquire.stages, 
+                acquire.stages, 0, 0, NULL, 
+                acquire.barrierCount, acquire.barriers, 0, NULL);
+    V_ASSERT( vkEndCommandBuffer(cmdPool->buffer) );
+    acquire.barrierCount = 0;
+    acquire.stages       = 0;
+
+    const VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = waitCount,
+        .pWaitSemaphores = waits,
+        .pWaitDstStageMask = waitStages,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdPool->buffer
+    };
+
+    V_ASSERT( vkQueueSubmit(graphicsQueues[0], 1, &submitInfo, acquire.fences[slot]) );
+}
+
+void r_StagingCleanUp(void)
+{
+    vkDeviceWaitIdle(device);
+    for (int i = 0; i < STAGING_BUFFER_COUNT; i++) 
+    {
+        tanto_v_FreeBufferRegion(&staging.buffers[i]);
+        vkDestroyFence(device, staging.fences[i], NULL);
+        vkDestroyFence(device, acquire.fences[i], NULL);
+        vkDestroySemaphore(device, staging.semaphores[i], NULL);
+    }
+    free(staging.copies);
+    free(acquire.barriers);
+    memset(&staging, 0, sizeof(staging));
+    memset(&acquire, 0, sizeof(acquire));
+}
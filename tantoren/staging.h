@@ -0,0 +1,32 @@
+#ifndef VIEWER_R_STAGING_H
+#define VIEWER_R_STAGING_H
+
+#include <stdbool.h>
+#include <tanto/v_memory.h>
+
+// uploads into device local buffers. data is written into a ring of host
+// visible staging buffers and the copies are batched into a single transfer
+// submission by r_StagingFlush. written ranges are handed over to the
+// graphics queue family, which picks them up in r_StagingSubmitAcquires
+// before the next frame.
+
+void  r_StagingInit(void);
+// returns size bytes of host memory that will be copied to dst at dstOffset
+// by the next flush. dstAccess is how the graphics queue reads the range.
+void* r_StageCopy(const Tanto_V_BufferRegion* dst, VkDeviceSize dstOffset, VkDeviceSize size, 
+        VkAccessFlags dstAccess);
+// makes room for copyCount copies totalling size bytes in the current staging
+// buffer, so that they can be staged without an intervening flush. the buffer
+// is not flushed until r_StagingEndWrite is called with the returned ticket,
+// which lets the data be written without holding any lock.
+uint32_t r_StagingBeginWrite(VkDeviceSize size, uint32_t copyCount);
+// thread safe
+void     r_StagingEndWrite(uint32_t ticket);
+// submits the batched copies on the transfer queue. returns false if there
+// was nothing to submit.
+bool  r_StagingFlush(void);
+// makes every flushed batch visible to graphics work submitted afterwards.
+void  r_StagingSubmitAcquires(void);
+void  r_StagingCleanUp(void);
+
+#endif /* end of include guard: VIEWER_R_STAGING_H */
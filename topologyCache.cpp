@@ -0,0 +1,140 @@
+#include "topologyCache.h"
+#include "renderer.h"
+#include <pxr/imaging/hd/meshUtil.h>
+
+extern "C" 
+{
+#include "tantoren/meshlet.h"
+#include "tantoren/normals.h"
+}
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+HdTantoTopologyCache::HdTantoTopologyCache(HdTantoRenderer& renderer)
+    : _renderer(renderer)
+{
+}
+
+HdTantoTopologyCache::~HdTantoTopologyCache()
+{
+    if (!_entries.empty())
+        TF_WARN("%zu triangulations still referenced at exit", _entries.size());
+}
+
+// Reorders the triangles into meshlets, keeping the primitive params in step.
+static void _BuildMeshlets(HdTantoTriangulation* triangulation)
+{
+    const uint32_t triangleCount = triangulation->indices.size();
+    std::vector<uint32_t> order(triangleCount);
+    std::vector<uint32_t> meshlets(triangleCount + 1);
+    const uint32_t meshletCount = r_BuildMeshlets((const uint32_t*)triangulation->indices.cdata(), 
+            triangleCount * 3, triangulation->pointCount, order.data(), meshlets.data());
+    if (meshletCount == 0)
+        return;
+
+    const bool hasParams = triangulation->primitiveParams.size() == triangleCount;
+    VtVec3iArray indices(triangleCount);
+    VtIntArray   params(hasParams ? triangleCount : 0);
+    const GfVec3i* srcIndices = triangulation->indices.cdata();
+    const int*     srcParams  = triangulation->primitiveParams.cdata();
+    GfVec3i* dstIndices = indices.data();
+    int*     dstParams  = params.data();
+    for (uint32_t i = 0; i < triangleCount; i++)
+    {
+        dstIndices[i] = srcIndices[order[i]];
+        if (hasParams)
+            dstParams[i] = srcParams[order[i]];
+    }
+    triangulation->indices = indices;
+    if (hasParams)
+        triangulation->primitiveParams = params;
+    meshlets.resize(meshletCount + 1);
+    triangulation->meshlets = std::move(meshlets);
+}
+
+HdTantoTriangulationSharedPtr
+HdTantoTopologyCache::_Build(const HdMeshTopology& topology, const SdfPath& id)
+{
+    auto triangulation = std::make_shared<HdTantoTriangulation>();
+    triangulation->topology   = topology;
+    triangulation->pointCount = topology.GetNumPoints();
+    HdMeshUtil meshUtil(&topology, id);
+    meshUtil.ComputeTriangleIndices(&triangulation->indices, &triangulation->primitiveParams);
+    if (triangulation->indices.size() >= _meshletMinTriangles)
+        _BuildMeshlets(triangulation.get());
+    // after the triangles found their final order
+    const uint32_t indexCount = triangulation->indices.size() * 3;
+    triangulation->pointTriangleOffsets.resize(triangulation->pointCount + 1);
+    triangulation->pointTriangles.resize(indexCount);
+    if (!r_VertexTriangles((const uint32_t*)triangulation->indices.cdata(), indexCount, triangulation->pointCount,
+            triangulation->pointTriangleOffsets.data(), triangulation->pointTriangles.data()))
+    {
+        TF_WARN("Indices of %s exceed its points, normals are not generated", id.GetText());
+        triangulation->pointTriangleOffsets.clear();
+        triangulation->pointTriangles.clear();
+    }
+    triangulation->indexSet = _renderer.AddIndexSet(triangulation->indices, triangulation->pointCount);
+    return triangulation;
+}
+
+HdTantoTriangulationSharedPtr
+HdTantoTopologyCache::Acquire(const HdMeshTopology& topology, const SdfPath& id)
+{
+    const HdMeshTopology::ID key = topology.ComputeHash();
+
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(key);
+        if (it != _entries.end() && it->second.triangulation->topology == topology)
+        {
+            it->second.refCount++;
+            return it->second.triangulation;
+        }
+    }
+
+    // triangulate without holding the lock. another thread may be building
+    // the same topology; whichever finishes second throws its copy away.
+    HdTantoTriangulationSharedPtr built = _Build(topology, id);
+    HdTantoTriangulationSharedPtr shared;
+
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(key);
+        if (it == _entries.end())
+        {
+            _entries.emplace(key, _Entry{built, 1});
+            return built;
+        }
+        // hash collision. the mesh keeps a private triangulation.
+        if (!(it->second.triangulation->topology == topology))
+            return built;
+        it->second.refCount++;
+        shared = it->second.triangulation;
+    }
+
+    _renderer.ReleaseIndexSet(built->indexSet);
+    return shared;
+}
+
+void
+HdTantoTopologyCache::Release(const HdTantoTriangulationSharedPtr& triangulation)
+{
+    if (!triangulation)
+        return;
+
+    {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(triangulation->topology.ComputeHash());
+        if (it != _entries.end() && it->second.triangulation == triangulation)
+        {
+            if (--it->second.refCount)
+                return;
+            _entries.erase(it);
+        }
+    }
+
+    // last user of a cached triangulation, or a private one
+    _renderer.ReleaseIndexSet(triangulation->indexSet);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
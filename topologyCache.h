@@ -0,0 +1,82 @@
+#ifndef TANTO_TOPOLOGY_CACHE_H
+#define TANTO_TOPOLOGY_CACHE_H
+
+#include "pxr/pxr.h"
+#include "pxr/imaging/hd/meshTopology.h"
+#include "pxr/usd/sdf/path.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+extern "C" 
+{
+#include "tantoren/render.h"
+}
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class HdTantoRenderer;
+
+/// Triangulation of one mesh topology and the index set it was uploaded to.
+/// Shared by every mesh with that topology; never modified once built.
+/// Large meshes have their triangles in meshlet order and meshlets holds the
+/// first triangle of each meshlet followed by the triangle count, as
+/// r_BuildMeshlets writes them; it is empty for the others. The triangles
+/// around each point are kept as r_VertexTriangles writes them, for
+/// generating smooth normals; both are empty if an index is out of range.
+struct HdTantoTriangulation {
+    HdMeshTopology        topology;
+    VtVec3iArray          indices;
+    VtIntArray            primitiveParams;
+    std::vector<uint32_t> meshlets;
+    std::vector<uint32_t> pointTriangleOffsets;
+    std::vector<uint32_t> pointTriangles;
+    uint32_t              pointCount;
+    Tanto_IndexSetId      indexSet;
+};
+
+using HdTantoTriangulationSharedPtr = std::shared_ptr<const HdTantoTriangulation>;
+
+/// \class HdTantoTopologyCache
+///
+/// Triangulates each unique topology once and uploads its indices once,
+/// keyed by HdMeshTopology::ComputeHash. Entries are reference counted by
+/// the meshes using them and dropped with the last one. Safe to call from
+/// the Sync threads.
+///
+class HdTantoTopologyCache final {
+public:
+    HdTantoTopologyCache(HdTantoRenderer& renderer);
+    ~HdTantoTopologyCache();
+
+    /// Get the triangulation of topology, building it if no other mesh
+    /// uses it. Every call must be matched by a call to Release.
+    ///   \param id The mesh asking, for error reporting.
+    HdTantoTriangulationSharedPtr Acquire(const HdMeshTopology& topology, const SdfPath& id);
+
+    void Release(const HdTantoTriangulationSharedPtr& triangulation);
+
+private:
+    struct _Entry {
+        HdTantoTriangulationSharedPtr triangulation;
+        size_t                        refCount;
+    };
+
+    HdTantoTriangulationSharedPtr _Build(const HdMeshTopology& topology, const SdfPath& id);
+
+    // Meshes with fewer triangles than this are culled as a whole only.
+    static constexpr size_t _meshletMinTriangles = 8192;
+
+    HdTantoRenderer& _renderer;
+    std::mutex       _mutex;
+    std::unordered_map<HdMeshTopology::ID, _Entry> _entries;
+
+    HdTantoTopologyCache(const HdTantoTopologyCache&) = delete;
+    HdTantoTopologyCache &operator =(const HdTantoTopologyCache&) = delete;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // TANTO_TOPOLOGY_CACHE_H